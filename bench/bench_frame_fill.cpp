@@ -0,0 +1,125 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per frame time to fill an image message, with a new message per
+// frame as before the message pool, with recycled pool messages, and
+// for the first frame into a new buffer with and without preparing it
+// (pre-faulting, huge pages, locking).
+
+#include <benchmark/benchmark.h>
+#include <flir_spinnaker_ros2/buffer_memory.h>
+#include <flir_spinnaker_ros2/message_pool.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::MessagePool;
+using flir_spinnaker_ros2::prepare_buffer;
+using flir_spinnaker_ros2::unlock_buffer;
+
+namespace
+{
+struct Frame  // the part of an image message that matters here
+{
+  std::vector<uint8_t> data;
+};
+
+const std::vector<uint8_t> & camera_buffer(size_t size)
+{
+  static std::vector<uint8_t> buf;
+  if (buf.size() != size) {
+    buf.assign(size, 0x5A);
+  }
+  return (buf);
+}
+
+void fill(Frame * f, const std::vector<uint8_t> & src)
+{
+  f->data.resize(src.size());
+  std::memcpy(&f->data[0], src.data(), src.size());
+}
+
+// frame size in bytes from the benchmark argument in units of 100kB
+size_t frame_size(const benchmark::State & state)
+{
+  return (static_cast<size_t>(state.range(0)) * 100000);
+}
+
+// a fresh message per frame, as without the pool
+void BM_FillNew(benchmark::State & state)
+{
+  const auto & src = camera_buffer(frame_size(state));
+  for (auto _ : state) {
+    Frame f;
+    fill(&f, src);
+    benchmark::DoNotOptimize(f.data.data());
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+}
+
+// recycled pool messages, steady state
+void BM_FillPooled(benchmark::State & state)
+{
+  const auto & src = camera_buffer(frame_size(state));
+  MessagePool<Frame> pool(4);
+  for (auto _ : state) {
+    Frame * f = pool.acquire();
+    fill(f, src);
+    benchmark::DoNotOptimize(f->data.data());
+    pool.release(f);
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+}
+
+// First frame into a new buffer, e.g. after startup or a resolution
+// change. Args: size, prepare (0: no, 1: pre-fault, 2: + huge pages,
+// 3: + huge pages and lock).
+void BM_FirstFill(benchmark::State & state)
+{
+  const auto & src = camera_buffer(frame_size(state));
+  const int prepare = static_cast<int>(state.range(1));
+  std::string error;
+  for (auto _ : state) {
+    state.PauseTiming();
+    Frame f;
+    if (prepare > 0) {
+      const std::string ret =
+        prepare_buffer(&f.data, src.size(), prepare >= 2, prepare >= 3);
+      if (ret != "OK") {
+        error = ret;  // e.g. RLIMIT_MEMLOCK too low, still usable
+      }
+    }
+    state.ResumeTiming();
+    fill(&f, src);
+    benchmark::DoNotOptimize(f.data.data());
+    state.PauseTiming();
+    if (prepare >= 3) {
+      unlock_buffer(f.data);
+    }
+    state.ResumeTiming();
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+  state.SetLabel(error);
+}
+}  // namespace
+
+// 1440x1080, 2448x2048 and 5472x3648 mono8
+BENCHMARK(BM_FillNew)->Arg(16)->Arg(50)->Arg(200);
+BENCHMARK(BM_FillPooled)->Arg(16)->Arg(50)->Arg(200);
+BENCHMARK(BM_FirstFill)->ArgsProduct({{16, 50, 200}, {0, 1, 2, 3}});
+
+BENCHMARK_MAIN();
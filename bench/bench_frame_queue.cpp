@@ -0,0 +1,151 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares the lock-free frame ring with the mutex and condition
+// variable protected deque it replaced, for handing frames from the
+// camera callback thread to the publishing thread.
+
+#include <benchmark/benchmark.h>
+#include <flir_spinnaker_ros2/frame_ring.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using flir_spinnaker_ros2::FrameRing;
+
+namespace
+{
+using Item = std::shared_ptr<const int>;  // stands in for an image
+const std::chrono::milliseconds timeout(100);
+
+// the queue as it was before the frame ring
+class DequeQueue
+{
+public:
+  explicit DequeQueue(size_t capacity) : capacity_(capacity) {}
+  bool push(Item && item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.size() >= capacity_) {
+      return (false);
+    }
+    queue_.push_back(std::move(item));
+    cv_.notify_all();
+    return (true);
+  }
+  bool waitPop(Item * item, std::chrono::milliseconds t)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.empty()) {
+      cv_.wait_for(lock, t);
+    }
+    if (queue_.empty()) {
+      return (false);
+    }
+    *item = std::move(queue_.front());
+    queue_.pop_front();
+    return (true);
+  }
+  void wakeup() { cv_.notify_all(); }
+
+private:
+  size_t capacity_;
+  std::deque<Item> queue_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+// Consumer thread that pops until stopped, counting what it got.
+template <typename Queue>
+class Consumer
+{
+public:
+  explicit Consumer(Queue * q) : queue_(q), thread_([this]() { run(); }) {}
+  ~Consumer()
+  {
+    keepRunning_ = false;
+    queue_->wakeup();
+    thread_.join();
+  }
+  uint64_t received() const { return (received_.load()); }
+
+private:
+  void run()
+  {
+    while (keepRunning_) {
+      Item item;
+      if (queue_->waitPop(&item, timeout)) {
+        received_++;
+      }
+    }
+  }
+  Queue * queue_;
+  std::atomic<bool> keepRunning_{true};
+  std::atomic<uint64_t> received_{0};
+  std::thread thread_;
+};
+
+// Frames pushed back to back, dropped if the queue is full. Measures
+// the time the producer spends per push.
+template <typename Queue>
+void BM_Push(benchmark::State & state)
+{
+  Queue queue(state.range(0));
+  Consumer<Queue> consumer(&queue);
+  const Item item = std::make_shared<const int>(0);
+  uint64_t dropped = 0;
+  for (auto _ : state) {
+    Item i(item);
+    if (!queue.push(std::move(i))) {
+      dropped++;
+    }
+  }
+  state.counters["dropped"] = benchmark::Counter(
+    static_cast<double>(dropped), benchmark::Counter::kAvgIterations);
+}
+
+// One frame at a time, with the consumer asleep in waitPop() as it is
+// between camera frames. Measures push to pop latency including the
+// wakeup.
+template <typename Queue>
+void BM_Handoff(benchmark::State & state)
+{
+  Queue queue(2);
+  Consumer<Queue> consumer(&queue);
+  const Item item = std::make_shared<const int>(0);
+  uint64_t sent = 0;
+  for (auto _ : state) {
+    Item i(item);
+    if (queue.push(std::move(i))) {
+      sent++;
+    }
+    while (consumer.received() < sent) {
+      std::this_thread::yield();
+    }
+  }
+}
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_Push, DequeQueue)->Arg(2)->Arg(16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Push, FrameRing<Item>)->Arg(2)->Arg(16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Handoff, DequeQueue)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Handoff, FrameRing<Item>)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,80 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Unpacking of 12 bit packed images. The kernel is selected at compile
+// time, so this is built once per instruction set (see CMakeLists.txt),
+// and the label shows which kernel ran.
+
+#include <benchmark/benchmark.h>
+#include <flir_spinnaker_ros2/pixel_formats.h>
+
+#include <cstdint>
+#include <vector>
+
+using flir_spinnaker_ros2::Packing;
+using flir_spinnaker_ros2::PACKING_12P;
+using flir_spinnaker_ros2::PACKING_12PACKED;
+using flir_spinnaker_ros2::pack12_row;
+using flir_spinnaker_ros2::unpack12_rows;
+
+namespace
+{
+const char * kernel_name()
+{
+#if defined(__SSSE3__)
+  return ("ssse3");
+#elif defined(__SSE2__)
+  return ("sse2");
+#elif defined(__ARM_NEON)
+  return ("neon");
+#else
+  return ("scalar");
+#endif
+}
+
+// Args: width, height, packing
+void BM_Unpack12(benchmark::State & state)
+{
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const Packing packing = static_cast<Packing>(state.range(2));
+  const size_t srcStep = (3 * static_cast<size_t>(width) + 1) / 2;
+  std::vector<uint16_t> row(width);
+  for (int x = 0; x < width; x++) {
+    row[x] = (x * 37) & 0x0FFF;
+  }
+  std::vector<uint8_t> src(srcStep * height);
+  for (int y = 0; y < height; y++) {
+    pack12_row(row.data(), width, packing, &src[y * srcStep]);
+  }
+  const size_t dstStep = 2 * width;
+  std::vector<uint8_t> dst(dstStep * height);
+  for (auto _ : state) {
+    unpack12_rows(
+      src.data(), srcStep, width, packing, dst.data(), dstStep, 0, height);
+    benchmark::DoNotOptimize(dst.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+  state.SetLabel(kernel_name());
+}
+}  // namespace
+
+BENCHMARK(BM_Unpack12)
+  ->ArgNames({"width", "height", "packing"})
+  ->ArgsProduct({{1440, 2448}, {1080}, {PACKING_12P, PACKING_12PACKED}})
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,65 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__ACQUISITION_BACKEND_H_
+#define FLIR_SPINNAKER_ROS2__ACQUISITION_BACKEND_H_
+
+#include <flir_spinnaker_common/driver.h>
+
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Everything the CameraDriver node needs from the camera. The interface
+// follows flir_spinnaker_common::Driver, which is what real cameras use.
+// The set* functions return "OK" or an error message.
+//
+class AcquisitionBackend
+{
+public:
+  typedef flir_spinnaker_common::Driver::Callback Callback;
+  virtual ~AcquisitionBackend() {}
+
+  virtual std::string getLibraryVersion() const = 0;
+  virtual void refreshCameraList() = 0;
+  virtual std::vector<std::string> getSerialNumbers() const = 0;
+  virtual void setDebug(bool b) = 0;
+  virtual void setComputeBrightness(bool b) = 0;
+  virtual void setAcquisitionTimeout(double sec) = 0;
+
+  virtual bool initCamera(const std::string & serialNumber) = 0;
+  virtual bool deInitCamera() = 0;
+  virtual bool startCamera(const Callback & cb) = 0;
+  virtual bool stopCamera() = 0;
+  virtual std::string getNodeMapAsString() = 0;
+
+  virtual std::string setEnum(
+    const std::string & nodeName, const std::string & val,
+    std::string * retVal) = 0;
+  virtual std::string setDouble(
+    const std::string & nodeName, double val, double * retVal) = 0;
+  virtual std::string setInt(
+    const std::string & nodeName, int val, int * retVal) = 0;
+  virtual std::string setBool(
+    const std::string & nodeName, bool val, bool * retVal) = 0;
+
+  virtual double getReceiveFrameRate() const = 0;
+  virtual std::string getPixelFormat() const = 0;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__ACQUISITION_BACKEND_H_
@@ -0,0 +1,39 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__BINNING_H_
+#define FLIR_SPINNAKER_ROS2__BINNING_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace flir_spinnaker_ros2
+{
+// Size of the 2x2 binned image. Bayer images keep whole 2x2 cells.
+void bin2x2_size(int width, int height, bool bayer, int * w, int * h);
+
+// Computes rows [rowBegin, rowEnd) of an 8 bit image binned 2x2, i.e.
+// every output pixel is the rounded average of four input pixels.
+// bytesPerPixel = 1 (mono) or 3 (rgb/bgr). For Bayer images, the four
+// pixels of the same color within each 4x4 block are averaged, so the
+// result is again a Bayer image with the same pattern. dst points to
+// the output for row rowBegin.
+void bin2x2_rows(
+  const uint8_t * src, size_t srcStep, int width, int height,
+  int bytesPerPixel, bool bayer, uint8_t * dst, size_t dstStep, int rowBegin,
+  int rowEnd);
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__BINNING_H_
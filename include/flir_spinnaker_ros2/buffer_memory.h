@@ -0,0 +1,37 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__BUFFER_MEMORY_H_
+#define FLIR_SPINNAKER_ROS2__BUFFER_MEMORY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+// Grows the buffer to the given size such that the memory is resident
+// before the first frame is copied into it: the pages are (optionally)
+// advised to be backed by transparent huge pages, pre-faulted, and
+// (optionally) locked. Returns "OK" or an error message. The buffer
+// is usable even if an error is returned.
+std::string prepare_buffer(
+  std::vector<uint8_t> * buf, size_t size, bool hugePages, bool lock);
+// undo the locking before the buffer is freed or reallocated
+void unlock_buffer(const std::vector<uint8_t> & buf);
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__BUFFER_MEMORY_H_
@@ -18,18 +18,45 @@
 
 #include <flir_spinnaker_common/driver.h>
 #include <flir_spinnaker_common/image.h>
+#include <flir_spinnaker_ros2/acquisition_backend.h>
+#include <flir_spinnaker_ros2/binning.h>
+#include <flir_spinnaker_ros2/change_detector.h>
+#include <flir_spinnaker_ros2/demosaic.h>
+#include <flir_spinnaker_ros2/exposure_controller.h>
+#include <flir_spinnaker_ros2/flat_field.h>
+#include <flir_spinnaker_ros2/focus.h>
+#include <flir_spinnaker_ros2/frame_ring.h>
+#include <flir_spinnaker_ros2/jpeg_encoder.h>
+#include <flir_spinnaker_ros2/latency_stats.h>
+#include <flir_spinnaker_ros2/message_pool.h>
+#include <flir_spinnaker_ros2/pixel_formats.h>
+#include <flir_spinnaker_ros2/polarization.h>
+#include <flir_spinnaker_ros2/rate_limiter.h>
+#include <flir_spinnaker_ros2/raw_compressor.h>
+#include <flir_spinnaker_ros2/rectify.h>
+#include <flir_spinnaker_ros2/reorder_buffer.h>
+#include <flir_spinnaker_ros2/statistics.h>
+#include <flir_spinnaker_ros2/thread_config.h>
+#include <flir_spinnaker_ros2/worker_pool.h>
+#include <flir_spinnaker_ros2/yuv.h>
 
 #include <camera_control_msgs_ros2/msg/camera_control.hpp>
 #include <camera_info_manager/camera_info_manager.hpp>
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <flir_spinnaker_ros2/msg/focus_metric.hpp>
+#include <flir_spinnaker_ros2/msg/image_statistics.hpp>
 #include <image_meta_msgs_ros2/msg/image_meta_data.hpp>
 #include <image_transport/image_transport.hpp>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <rclcpp/rclcpp.hpp>
 #include <sensor_msgs/msg/camera_info.hpp>
+#include <sensor_msgs/msg/compressed_image.hpp>
 #include <sensor_msgs/msg/image.hpp>
 #include <std_msgs/msg/float64.hpp>
+#include <std_srvs/srv/trigger.hpp>
 #include <thread>
 
 namespace flir_spinnaker_ros2
@@ -38,6 +65,10 @@ class CameraDriver : public rclcpp::Node
 {
 public:
   typedef flir_spinnaker_common::ImageConstPtr ImageConstPtr;
+  typedef PoolAllocator<void> MessageAllocator;
+  template <typename T>
+  using PooledPtr =
+    std::unique_ptr<T, rclcpp::allocator::Deleter<PoolAllocator<T>, T>>;
   explicit CameraDriver(const rclcpp::NodeOptions & options);
   ~CameraDriver();
 
@@ -53,8 +84,51 @@ private:
     NodeType type{INVALID};
     rcl_interfaces::msg::ParameterDescriptor descriptor;
   };
+  enum QueuePolicy { LATEST, FIFO, MAX_AGE };
+  struct QueuedFrame
+  {
+    ImageConstPtr image;
+    std::chrono::steady_clock::time_point arrivalTime;
+  };
+  struct Roi
+  {
+    explicit Roi(const std::string & n) : name(n) {}
+    std::string name;
+    int x{0};  // geometry is guarded by roiMutex_
+    int y{0};
+    int width{0};
+    int height{0};
+    image_transport::CameraPublisher pub;
+    std::atomic<size_t> numSubscribers{0};
+    SharedMessageRing<sensor_msgs::msg::Image> images{4};
+    SharedMessageRing<sensor_msgs::msg::CameraInfo> infos{4};
+  };
+  // optional output that is computed on the worker pool
+  struct OutputStage
+  {
+    std::atomic<size_t> numSubscribers{0};
+    std::atomic<int> inFlight{0};
+    int maxInFlight{1};  // frames processed at the same time
+    std::atomic<uint32_t> dropped{0};
+    LatencyStats time;
+    RateLimiter rate;  // publishing thread only
+  };
+  // averages frames into a new dark frame or flat field
+  struct ReferenceCapture
+  {
+    bool dark{true};
+    int numFrames{0};
+    int count{0};
+    ReferenceImage image;  // size and depth of the frames
+    std::vector<uint32_t> sum;
+  };
   void publishImage(const ImageConstPtr & image);
+  void publishImageInline(const ImageConstPtr & image);
   void readParameters();
+  std::shared_ptr<AcquisitionBackend> makeBackend();
+  ThreadConfig readThreadConfig(const std::string & prefix);
+  void applyThreadConfig(const std::string & name, const ThreadConfig & tc);
+  void configureAcquisitionThread();
   void printCameraInfo();
   void startCamera();
   bool stopCamera();
@@ -70,15 +144,102 @@ private:
 
   rcl_interfaces::msg::SetParametersResult parameterChanged(
     const std::vector<rclcpp::Parameter> & params);
+  void readRateLimit(const std::string & output, RateLimiter * limiter);
+  void readExposureControlParameters();
+  void startExposureControl();
+  bool applyExposure(
+    const ExposureController::Setting & s,
+    ExposureController::Setting * applied);
+  void updateExposure(const ImageConstPtr & im);
   void controlCallback(
     const camera_control_msgs_ros2::msg::CameraControl::UniquePtr msg);
   void printStatus();
-  void doPublish(const ImageConstPtr & im);
+  void updateSubscriberCounts();
+  void updateCameraInfo();
+  void doPublish(const ImageConstPtr & frame);
+  const PixelFormatInfo * findPixelFormat(const ImageConstPtr & im) const;
+  void updatePixelFormat();
+  PooledPtr<sensor_msgs::msg::Image> makeFrameMessage(
+    const ImageConstPtr & im, const std::string & encoding, size_t step);
+  ImageConstPtr wrapFrameMessage(
+    const ImageConstPtr & im, const sensor_msgs::msg::Image::SharedPtr & msg,
+    int bitsPerPixel);
+  PooledPtr<sensor_msgs::msg::Image> convertFrame(
+    const ImageConstPtr & im, const std::string & encoding, Packing packing,
+    const FlatField * flatField, size_t step);
+  std::shared_ptr<const FlatField> findFlatField(
+    const ImageConstPtr & im, const std::string & encoding);
+  void loadReferences();
+  void updateFlatField();
+  void captureReference(
+    bool dark, const std::shared_ptr<std_srvs::srv::Trigger::Request> req,
+    std::shared_ptr<std_srvs::srv::Trigger::Response> res);
+  void accumulateReference(
+    const ImageConstPtr & im, const std::string & encoding);
+  void publishDirect(
+    const ImageConstPtr & im, const std::string & encoding,
+    PooledPtr<sensor_msgs::msg::Image> converted);
+  void publishDirectCameraInfo();
+  sensor_msgs::msg::CameraInfo::SharedPtr makeSharedCameraInfo(
+    SharedMessageRing<sensor_msgs::msg::CameraInfo> * ring);
+  bool fillImageMsg(
+    sensor_msgs::msg::Image * msg, const std::string & encoding,
+    const ImageConstPtr & im);
+  void prepareImagePool(size_t size);
+  bool submitToStage(OutputStage * stage, WorkerPool::Job job);
+  void printStageStatus(const std::string & name, OutputStage * stage);
+  void publishColor(const ImageConstPtr & im, const std::string & encoding);
+  void publishPyramid(const ImageConstPtr & im, const std::string & encoding);
+  void publishPolarization(
+    const ImageConstPtr & im, const std::string & encoding);
+  void publishJpeg(const ImageConstPtr & im, const std::string & encoding);
+  void publishZstd(const ImageConstPtr & im, const std::string & encoding);
+  void publishYuv(const ImageConstPtr & im, const std::string & encoding);
+  void publishRectified(
+    const ImageConstPtr & im, const std::string & encoding);
+  bool updateRectifyMap(int width, int height);
+  bool hasProcessingStages() const;
+  std::string setRoi(
+    const std::string & name, const std::vector<int64_t> & geometry);
+  void publishRois(const ImageConstPtr & im, const std::string & encoding);
+  void publishStatistics(
+    const ImageConstPtr & im, const std::string & encoding, int bits);
+  bool frameChanged(
+    const ImageConstPtr & frame, const PixelFormatInfo * pf, int64_t stamp);
+  void publishFocus(
+    const ImageConstPtr & im, const std::string & encoding, int bits);
+  template <typename T>
+  PooledPtr<T> makePooled(
+    const std::shared_ptr<MessagePool<T>> & pool,
+    const std::shared_ptr<PoolAllocator<T>> & alloc);
   // ----- variables --
   std::shared_ptr<rclcpp::Node> node_;
   image_transport::CameraPublisher pub_;
+  // plain publishers used instead of pub_ for pooled messages
+  bool directPublishing_{false};
+  rclcpp::Publisher<sensor_msgs::msg::Image, MessageAllocator>::SharedPtr
+    imagePub_;
+  rclcpp::Publisher<sensor_msgs::msg::CameraInfo, MessageAllocator>::SharedPtr
+    cameraInfoPub_;
+  int messagePoolSize_{0};
+  bool poolLockMemory_{false};
+  bool poolHugePages_{false};
+  size_t preparedBufferSize_{0};  // frame size the pool is ready for
+  LatencyStats fillTime_;
+  std::shared_ptr<MessagePool<sensor_msgs::msg::Image>> imagePool_;
+  std::shared_ptr<MessagePool<sensor_msgs::msg::CameraInfo>> cameraInfoPool_;
+  std::shared_ptr<PoolAllocator<sensor_msgs::msg::Image>> imageAllocator_;
+  std::shared_ptr<PoolAllocator<sensor_msgs::msg::CameraInfo>>
+    cameraInfoAllocator_;
+  // messages for unpacked or corrected frames
+  std::shared_ptr<MessagePool<sensor_msgs::msg::Image>> framePool_;
+  std::shared_ptr<PoolAllocator<sensor_msgs::msg::Image>> frameAllocator_;
   rclcpp::Publisher<image_meta_msgs_ros2::msg::ImageMetaData>::SharedPtr
     metaPub_;
+  // ----- per output rate limits, publishing thread only
+  RateLimiter rawRate_;
+  RateLimiter metaRate_;
+  RateLimiter statisticsRate_;
   std::string serial_;
   std::string cameraInfoURL_;
   std::string frameId_;
@@ -89,29 +250,151 @@ private:
   bool dumpNodeMap_{false};
   bool debug_{false};
   bool computeBrightness_{false};
+  bool useLoanedMessages_{false};
   double acquisitionTimeout_{3.0};
   uint32_t currentExposureTime_{0};
   float currentGain_{std::numeric_limits<float>::lowest()};
-  std::shared_ptr<flir_spinnaker_common::Driver> driver_;
+  // ----- in-driver exposure control
+  bool exposureControlEnabled_{false};
+  bool exposureControlMaster_{true};
+  std::string exposureControlGroupName_;
+  std::unique_ptr<ExposureController> exposureController_;  // master only
+  std::shared_ptr<ExposureControlGroup> exposureControlGroup_;
+  int exposureFollowerId_{-1};
+  std::mutex exposureMutex_;  // serializes exposure and gain changes
+  std::string backend_{"spinnaker"};
+  std::shared_ptr<AcquisitionBackend> driver_;
+  // format the camera is configured to, for those the library does not
+  // identify itself
+  std::atomic<const PixelFormatInfo *> cameraPixelFormat_{nullptr};
+  bool unpackPackedFormats_{true};
   std::shared_ptr<camera_info_manager::CameraInfoManager> infoManager_;
   sensor_msgs::msg::Image imageMsg_;
-  sensor_msgs::msg::CameraInfo cameraInfoMsg_;
+  // Immutable, replaced (never modified) when the calibration changes.
+  // Access with std::atomic_load/store, the version is bumped afterwards.
+  std::shared_ptr<const sensor_msgs::msg::CameraInfo> cameraInfo_;
+  std::atomic<uint64_t> cameraInfoVersion_{0};
+  // recycled messages for pub_, publishing thread only
+  SharedMessageRing<sensor_msgs::msg::Image> rawImageRing_{4};
+  SharedMessageRing<sensor_msgs::msg::CameraInfo> cameraInfoRing_{4};
   image_meta_msgs_ros2::msg::ImageMetaData metaMsg_;
   rclcpp::Node::OnSetParametersCallbackHandle::SharedPtr
     callbackHandle_;  // keep alive callbacks
   rclcpp::TimerBase::SharedPtr statusTimer_;
+  rclcpp::TimerBase::SharedPtr subscriberTimer_;
+  double subscriberCheckInterval_{0.5};  // in seconds
+  std::atomic<size_t> numImageSubscribers_{0};
+  std::atomic<size_t> numMetaSubscribers_{0};
   bool cameraRunning_{false};
-  std::mutex mutex_;
-  std::condition_variable cv_;
-  std::deque<ImageConstPtr> imageQueue_;
+  std::unique_ptr<FrameRing<QueuedFrame>> imageRing_;
+  std::unique_ptr<LatestFrame<QueuedFrame>> latestFrame_;  // LATEST only
+  QueuePolicy queuePolicy_{FIFO};
+  int queueDepth_{2};
+  std::chrono::nanoseconds maxFrameAge_{0};
   std::shared_ptr<std::thread> thread_;
-  bool keepRunning_{true};
+  std::atomic<bool> keepRunning_{true};
+  bool inlinePublishing_{false};  // publish from the Spinnaker callback
+  ThreadConfig publishThreadConfig_;
+  ThreadConfig acquisitionThreadConfig_;
+  std::thread::id acquisitionThreadId_;  // last thread configured
+  bool lockMemory_{false};
+  LatencyStats callbackTime_;
+  // ----- processing stages
+  std::unique_ptr<WorkerPool> workerPool_;
+  int numWorkerThreads_{2};
+  ThreadConfig workerThreadConfig_;
+  bool demosaicEnabled_{false};
+  DemosaicMethod demosaicMethod_{DEMOSAIC_BILINEAR};
+  std::string colorEncoding_;
+  image_transport::Publisher colorPub_;
+  OutputStage colorStage_;
+  int pyramidLevels_{0};
+  std::vector<image_transport::Publisher> pyramidPubs_;  // level 1, 2, ...
+  std::atomic<uint32_t> pyramidSubscribed_{0};  // bit n: level n + 1 wanted
+  OutputStage pyramidStage_;
+  bool polarizationEnabled_{false};
+  std::vector<image_transport::Publisher> polarizationPubs_;  // by output
+  std::atomic<uint32_t> polarizationSubscribed_{0};  // bit n: output n
+  OutputStage polarizationStage_;
+  bool jpegEnabled_{false};
+  int jpegQuality_{90};
+  JpegEncoder::Subsampling jpegSubsampling_{JpegEncoder::S420};
+  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr jpegPub_;
+  OutputStage jpegStage_;
+  std::atomic<uint64_t> jpegBytes_{0};
+  // frames are encoded in parallel but must go out in order
+  std::unique_ptr<ReorderBuffer<sensor_msgs::msg::CompressedImage::UniquePtr>>
+    jpegOrder_;
+  bool zstdEnabled_{false};
+  int zstdLevel_{1};
+  bool zstdBayerSplit_{true};
+  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr zstdPub_;
+  OutputStage zstdStage_;
+  std::atomic<uint64_t> zstdBytesIn_{0};
+  std::atomic<uint64_t> zstdBytesOut_{0};
+  std::unique_ptr<ReorderBuffer<sensor_msgs::msg::CompressedImage::UniquePtr>>
+    zstdOrder_;
+  bool yuvEnabled_{false};
+  YuvFormat yuvFormat_{YUV_NV12};
+  YuvMatrix yuvMatrix_{YUV_BT709};
+  image_transport::Publisher yuvPub_;
+  OutputStage yuvStage_;
+  bool rectifyEnabled_{false};
+  image_transport::Publisher rectifyPub_;
+  std::string rectifyBadEncoding_;  // warned that it cannot be rectified
+  OutputStage rectifyStage_;  // one frame in flight, owns the fields below
+  RectifyMap rectifyMap_;
+  bool rectifyMapValid_{false};
+  uint64_t rectifyMapVersion_{0};  // camera info version of the map
+  int rectifyMapWidth_{0};         // image size of the map
+  int rectifyMapHeight_{0};
+  std::vector<uint8_t> rectifyColor_;  // demosaiced Bayer image
+  // ----- dark frame and flat field correction
+  std::string darkFrameFile_;
+  std::string flatFieldFile_;
+  int referenceFrames_{16};  // number of frames averaged by a capture
+  // Immutable, replaced when a reference changes. Access with
+  // std::atomic_load/store.
+  std::shared_ptr<const FlatField> flatField_;
+  bool flatFieldMismatch_{false};  // warned that the frames do not match
+  LatencyStats flatFieldTime_;
+  std::mutex referenceMutex_;  // guards the references and the capture
+  ReferenceImage darkFrame_;
+  ReferenceImage flatFrame_;
+  std::unique_ptr<ReferenceCapture> capture_;
+  std::atomic<bool> capturing_{false};
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr captureDarkService_;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr captureFlatService_;
+  bool statisticsEnabled_{false};
+  StatisticsConfig statisticsConfig_;
+  rclcpp::Publisher<msg::ImageStatistics>::SharedPtr statisticsPub_;
+  std::atomic<size_t> numStatisticsSubscribers_{0};
+  LatencyStats statisticsTime_;
+  // ----- change detection, publishing thread only
+  bool changeDetection_{false};
+  ChangeDetector changeDetector_;
+  double changeThreshold_{0.001};  // fraction of changed samples
+  int64_t changeKeepalive_{0};     // in nanoseconds, 0: never
+  int64_t lastChangePublished_{0};
+  std::atomic<uint32_t> changeFrames_{0};
+  std::atomic<uint32_t> changePublished_{0};
+  LatencyStats changeTime_;
+  bool focusEnabled_{false};
+  FocusConfig focusConfig_;
+  RateLimiter focusRate_;
+  rclcpp::Publisher<msg::FocusMetric>::SharedPtr focusPub_;
+  std::atomic<size_t> numFocusSubscribers_{0};
+  LatencyStats focusTime_;
+  std::vector<std::unique_ptr<Roi>> rois_;  // never changes after startup
+  RateLimiter roiRate_;
+  std::mutex roiMutex_;
   std::map<std::string, NodeInfo> parameterMap_;
   std::vector<std::string> parameterList_;  // remember original ordering
   rclcpp::Subscription<camera_control_msgs_ros2::msg::CameraControl>::SharedPtr
     controlSub_;
-  uint32_t publishedCount_{0};
-  uint32_t droppedCount_{0};
+  std::atomic<uint32_t> publishedCount_{0};
+  std::atomic<uint32_t> droppedQueueFullCount_{0};
+  std::atomic<uint32_t> droppedTooOldCount_{0};
   rclcpp::Time lastStatusTime_;
   int qosDepth_{4};
 };
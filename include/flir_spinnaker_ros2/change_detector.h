@@ -0,0 +1,62 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__CHANGE_DETECTOR_H_
+#define FLIR_SPINNAKER_ROS2__CHANGE_DETECTOR_H_
+
+#include <flir_spinnaker_ros2/pixel_formats.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Tells how much an image differs from a reference image, e.g. the
+// last one published: the fraction of samples whose absolute
+// difference exceeds a threshold. Counting pixels over a threshold
+// (rather than averaging the differences) ignores sensor noise but
+// still notices small objects. Every subsample'th row is compared, all
+// of its values, scaled to 8 bits.
+//
+class ChangeDetector
+{
+public:
+  // pixelThreshold is in 8 bit units
+  void configure(int subsample, int pixelThreshold);
+  // Samples an image with 8 or 16 bit values (bits significant) or a 12
+  // bit packed one (width in pixels). Returns the fraction of changed
+  // samples, 1 if the reference is missing or of a different size.
+  double compare(
+    const uint8_t * src, size_t step, int width, int height, int channels,
+    int bits, Packing packing);
+  // makes the image of the last compare() the reference
+  void accept();
+
+private:
+  int subsample_{8};
+  int pixelThreshold_{16};
+  std::vector<uint8_t> current_;    // sampled rows, 8 bits per value
+  std::vector<uint8_t> reference_;  // same for the reference
+  std::vector<uint8_t> unpacked_;   // one unpacked row
+  size_t currentRowLength_{0};
+  size_t referenceRowLength_{0};
+  bool currentValid_{false};
+  bool referenceValid_{false};
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__CHANGE_DETECTOR_H_
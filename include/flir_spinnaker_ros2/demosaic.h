@@ -0,0 +1,46 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__DEMOSAIC_H_
+#define FLIR_SPINNAKER_ROS2__DEMOSAIC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace flir_spinnaker_ros2
+{
+// naming follows the color of the top left 2x2 block, row by row
+enum BayerPattern { RGGB, GRBG, GBRG, BGGR };
+enum DemosaicMethod {
+  DEMOSAIC_BILINEAR,    // plain 4-neighbor / diagonal averages
+  DEMOSAIC_EDGE_AWARE,  // green interpolated along the weaker gradient
+};
+
+// Converts rows [rowBegin, rowEnd) of an 8 bit Bayer image into packed
+// 3-channel RGB (or BGR) at full resolution. The whole source image must
+// be readable since neighboring rows are used, dst points to the output
+// for row rowBegin. Disjoint row ranges can be converted concurrently.
+// Width and height must be even.
+void demosaic_rows(
+  const uint8_t * src, size_t srcStep, int width, int height,
+  BayerPattern pattern, DemosaicMethod method, bool bgr, uint8_t * dst,
+  size_t dstStep, int rowBegin, int rowEnd);
+
+// returns false if the string is not a valid method name
+bool demosaic_method_from_string(const std::string & s, DemosaicMethod * m);
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__DEMOSAIC_H_
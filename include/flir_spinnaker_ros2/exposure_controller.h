@@ -0,0 +1,105 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__EXPOSURE_CONTROLLER_H_
+#define FLIR_SPINNAKER_ROS2__EXPOSURE_CONTROLLER_H_
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Closed loop auto exposure, with the same limits and gain priority
+// as the exposure_control_ros2 node. Exposure time is in usec, gain in
+// dB. After a change, the controller waits for the first frame that
+// was taken with the new setting (going by the exposure time and gain
+// the camera reports for each frame) before it adjusts again, so it
+// does not overshoot when the new setting takes a few frames to land.
+//
+class ExposureController
+{
+public:
+  struct Config
+  {
+    double brightnessTarget{100};  // 0..255
+    double brightnessTolerance{5};
+    double minExposureTime{100};
+    double maxExposureTime{10000};
+    double maxGain{10};
+    bool gainPriority{false};  // raise gain before exposure time
+    int maxFramesSkip{10};     // wait at most this long for a change
+  };
+  struct Setting
+  {
+    double exposureTime{0};
+    double gain{0};
+  };
+  struct Stats
+  {
+    int numChanges{0};
+    int numLanded{0};      // changes seen in a frame
+    double avgLatency{0};  // frames until a change was seen
+  };
+  explicit ExposureController(const Config & config) : config_(config) {}
+  // Call for every frame with its brightness and the exposure time and
+  // gain it was taken with. Returns true if the setting should change.
+  bool update(
+    double brightness, double exposureTime, double gain, Setting * next);
+  // the setting that was actually applied, after update() returned true
+  void setApplied(const Setting & s) { applied_ = s; }
+  // can be called from a different thread than update()
+  Stats getAndResetStats();
+
+private:
+  bool hasLanded(double exposureTime, double gain) const;
+  Config config_;
+  Setting applied_;
+  bool pending_{false};  // waiting for the applied setting to show
+  int framesWaited_{0};
+  std::atomic<int> numChanges_{0};
+  std::atomic<int> numLanded_{0};
+  std::atomic<int> latencySum_{0};
+};
+
+//
+// Cameras in the same process that use the same group name share the
+// settings of one controller: its camera (the master) applies every
+// change to the cameras that follow it, e.g. for a synchronized stereo
+// pair that needs identical exposure.
+//
+class ExposureControlGroup
+{
+public:
+  typedef std::function<void(const ExposureController::Setting &)> Callback;
+  // creates the group if it does not exist yet
+  static std::shared_ptr<ExposureControlGroup> get(const std::string & name);
+  int addFollower(const Callback & cb);
+  void removeFollower(int id);
+  // calls all followers, from the thread of the master
+  void apply(const ExposureController::Setting & s);
+
+private:
+  std::mutex mutex_;
+  int nextId_{0};
+  std::map<int, Callback> followers_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__EXPOSURE_CONTROLLER_H_
@@ -0,0 +1,76 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__FLAT_FIELD_H_
+#define FLIR_SPINNAKER_ROS2__FLAT_FIELD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+// single channel 8 or 16 bit image, e.g. a dark frame
+struct ReferenceImage
+{
+  bool empty() const { return (data.empty()); }
+  int width{0};
+  int height{0};
+  int bytesPerPixel{1};
+  std::vector<uint16_t> data;  // width * height, no padding
+};
+
+// Binary PGM (P5) files, 16 bit if the maximum value exceeds 255.
+// Return "OK" or an error message.
+std::string read_pgm(const std::string & fileName, ReferenceImage * img);
+std::string write_pgm(const std::string & fileName, const ReferenceImage & img);
+
+//
+// Dark frame and flat field correction of mono and Bayer images:
+//
+//   out = (in - dark) * gain,   gain = mean(flat - dark) / (flat - dark)
+//
+// Dark and gain are stored per pixel, the gain in fixed point with 12
+// fractional bits (up to 16x), so correcting needs no floating point.
+// The mean is taken separately for each of the four pixels of a 2x2
+// block, which keeps the color balance of Bayer images.
+//
+class FlatField
+{
+public:
+  // Either reference may be empty, but not both. Returns "OK" or an
+  // error message.
+  std::string init(const ReferenceImage & dark, const ReferenceImage & flat);
+  // Corrects rows [rowBegin, rowEnd). src and dst point to row
+  // rowBegin and may be the same. Disjoint row ranges can be corrected
+  // concurrently.
+  void correctRows(
+    const uint8_t * src, size_t srcStep, uint8_t * dst, size_t dstStep,
+    int rowBegin, int rowEnd) const;
+  int getWidth() const { return (width_); }
+  int getHeight() const { return (height_); }
+  int getBytesPerPixel() const { return (bytesPerPixel_); }
+
+private:
+  int width_{0};
+  int height_{0};
+  int bytesPerPixel_{1};
+  std::vector<uint16_t> dark_;
+  std::vector<uint16_t> gain_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__FLAT_FIELD_H_
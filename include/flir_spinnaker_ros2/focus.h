@@ -0,0 +1,61 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__FOCUS_H_
+#define FLIR_SPINNAKER_ROS2__FOCUS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace flir_spinnaker_ros2
+{
+struct FocusConfig
+{
+  int x{0};  // region, in pixels
+  int y{0};
+  int width{0};   // 0: up to the right border
+  int height{0};  // 0: up to the bottom border
+  int stride{1};  // every stride'th row
+};
+
+struct FocusResult
+{
+  double laplacianVariance{0};
+  double mean{0};  // of the sampled pixels
+  uint64_t count{0};
+  int x{0};  // region actually used
+  int y{0};
+  int width{0};
+  int height{0};
+};
+
+//
+// Sharpness of a region of an 8 or 16 bit image with 1 or 3 channels,
+// or of a Bayer image: the variance of the Laplacian
+//
+//   L = 4 c - n - s - w - e
+//
+// with the neighbors of the same color (two pixels away for Bayer
+// images). It drops when the image gets blurry, e.g. from defocus, fog
+// or dirt on the lens. Only every stride'th row is sampled, but all of
+// its pixels, so the loops stay contiguous. bits is the number of
+// significant bits per value. Returns false if the region is too small.
+//
+bool compute_focus(
+  const FocusConfig & config, const uint8_t * src, size_t step, int width,
+  int height, int channels, bool bayer, int bits, FocusResult * result);
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__FOCUS_H_
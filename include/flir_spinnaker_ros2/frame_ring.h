@@ -0,0 +1,220 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__FRAME_RING_H_
+#define FLIR_SPINNAKER_ROS2__FRAME_RING_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Thin wrapper around a linux eventfd. Signaling is a single write()
+// syscall and never blocks, so it is safe to call from the Spinnaker
+// callback thread.
+//
+class EventWakeup
+{
+public:
+  EventWakeup();
+  ~EventWakeup();
+  EventWakeup(const EventWakeup &) = delete;
+  EventWakeup & operator=(const EventWakeup &) = delete;
+  void signal();
+  // returns true if signaled, false on timeout
+  bool wait(std::chrono::milliseconds timeout);
+
+private:
+  int fd_{-1};
+};
+
+//
+// Lock-free single-producer/single-consumer ring buffer. The producer
+// never waits: if the ring is full, push() fails and the caller decides
+// what to do with the element. The consumer can block in waitPop(), the
+// producer only pays for a wakeup syscall when the consumer is asleep.
+//
+template <typename T>
+class FrameRing
+{
+public:
+  explicit FrameRing(size_t capacity) : capacity_(capacity)
+  {
+    size_t n = 1;
+    while (n < capacity_) {
+      n <<= 1;
+    }
+    slots_.resize(n);
+    mask_ = n - 1;
+  }
+  FrameRing(const FrameRing &) = delete;
+  FrameRing & operator=(const FrameRing &) = delete;
+
+  // producer side
+  bool push(T && t)
+  {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= capacity_) {
+      return (false);  // full
+    }
+    slots_[tail & mask_] = std::move(t);
+    tail_.store(tail + 1, std::memory_order_release);
+    // pairs with the fence in waitPop(): either the consumer sees the new
+    // tail, or we see that it went to sleep and must be woken up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumerWaiting_.load(std::memory_order_relaxed)) {
+      wakeup_.signal();
+    }
+    return (true);
+  }
+
+  // consumer side
+  bool pop(T * t)
+  {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return (false);  // empty
+    }
+    *t = std::move(slots_[head & mask_]);
+    slots_[head & mask_] = T();  // drop reference right away
+    head_.store(head + 1, std::memory_order_release);
+    return (true);
+  }
+
+  // consumer side: blocks until an element arrives, timeout, or wakeup()
+  bool waitPop(T * t, std::chrono::milliseconds timeout)
+  {
+    if (pop(t)) {
+      return (true);
+    }
+    consumerWaiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pop(t)) {
+      consumerWaiting_.store(false, std::memory_order_relaxed);
+      return (true);
+    }
+    wakeup_.wait(timeout);
+    consumerWaiting_.store(false, std::memory_order_relaxed);
+    return (pop(t));
+  }
+
+  // unblock a consumer sitting in waitPop(), e.g. on shutdown
+  void wakeup() { wakeup_.signal(); }
+
+  size_t size() const
+  {
+    return (
+      tail_.load(std::memory_order_acquire) -
+      head_.load(std::memory_order_acquire));
+  }
+  size_t capacity() const { return (capacity_); }
+
+private:
+  std::vector<T> slots_;
+  size_t capacity_;
+  size_t mask_;
+  // padding keeps producer and consumer indices on separate cache lines
+  char pad0_[64];
+  std::atomic<size_t> head_{0};  // written by consumer only
+  char pad1_[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail_{0};  // written by producer only
+  char pad2_[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<bool> consumerWaiting_{false};
+  EventWakeup wakeup_;
+};
+
+//
+// Lock-free single-producer/single-consumer mailbox that only holds the
+// newest element: push() replaces an element the consumer has not
+// picked up yet. Triple buffered, so neither side ever waits for the
+// other. Wakeups work as in FrameRing.
+//
+template <typename T>
+class LatestFrame
+{
+public:
+  LatestFrame() = default;
+  LatestFrame(const LatestFrame &) = delete;
+  LatestFrame & operator=(const LatestFrame &) = delete;
+
+  // producer side, returns false if an unconsumed element was replaced
+  bool push(T && t)
+  {
+    slots_[back_] = std::move(t);
+    const int old =
+      middle_.exchange(back_ | FRESH, std::memory_order_acq_rel);
+    back_ = old & INDEX;
+    const bool replaced = (old & FRESH) != 0;
+    if (replaced) {
+      slots_[back_] = T();  // drop reference right away
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumerWaiting_.load(std::memory_order_relaxed)) {
+      wakeup_.signal();
+    }
+    return (!replaced);
+  }
+
+  // consumer side
+  bool pop(T * t)
+  {
+    // only the producer sets FRESH, only the consumer clears it
+    if (!(middle_.load(std::memory_order_relaxed) & FRESH)) {
+      return (false);  // empty
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+    *t = std::move(slots_[front_]);
+    slots_[front_] = T();
+    return (true);
+  }
+
+  // consumer side: blocks until an element arrives, timeout, or wakeup()
+  bool waitPop(T * t, std::chrono::milliseconds timeout)
+  {
+    if (pop(t)) {
+      return (true);
+    }
+    consumerWaiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pop(t)) {
+      consumerWaiting_.store(false, std::memory_order_relaxed);
+      return (true);
+    }
+    wakeup_.wait(timeout);
+    consumerWaiting_.store(false, std::memory_order_relaxed);
+    return (pop(t));
+  }
+
+  void wakeup() { wakeup_.signal(); }
+
+private:
+  static constexpr int INDEX = 3;
+  static constexpr int FRESH = 4;  // middle slot holds an unconsumed element
+  T slots_[3];
+  int back_{0};  // owned by producer
+  char pad0_[64];
+  std::atomic<int> middle_{1};
+  char pad1_[64 - sizeof(std::atomic<int>)];
+  int front_{2};  // owned by consumer
+  std::atomic<bool> consumerWaiting_{false};
+  EventWakeup wakeup_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__FRAME_RING_H_
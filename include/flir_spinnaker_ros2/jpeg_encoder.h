@@ -0,0 +1,67 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__JPEG_ENCODER_H_
+#define FLIR_SPINNAKER_ROS2__JPEG_ENCODER_H_
+
+#include <flir_spinnaker_ros2/demosaic.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Encodes 8 bit images to JPEG with libjpeg(-turbo). An encoder keeps
+// its libjpeg state and buffers between images, so it should be reused,
+// but it must not be used by more than one thread at a time.
+//
+class JpegEncoder
+{
+public:
+  enum InputType { MONO, RGB, BGR, BAYER };
+  enum Subsampling { S444, S422, S420, GRAY };
+  struct Input
+  {
+    const uint8_t * data{nullptr};
+    size_t step{0};
+    int width{0};
+    int height{0};
+    InputType type{MONO};
+    BayerPattern pattern{RGGB};  // only used for Bayer input
+  };
+  JpegEncoder();
+  ~JpegEncoder();
+  JpegEncoder(const JpegEncoder &) = delete;
+  JpegEncoder & operator=(const JpegEncoder &) = delete;
+
+  // Replaces the contents of out with the JPEG stream. Bayer images are
+  // demosaiced (bilinear) on the fly. Returns "OK" or an error message.
+  std::string encode(
+    const Input & in, int quality, Subsampling sub, std::vector<uint8_t> * out);
+
+  // returns false if the string is not one of 444, 422, 420, gray
+  static bool subsamplingFromString(const std::string & s, Subsampling * sub);
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__JPEG_ENCODER_H_
@@ -0,0 +1,67 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__LATENCY_STATS_H_
+#define FLIR_SPINNAKER_ROS2__LATENCY_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Lock-free accumulator for timing measurements. add() can be called
+// from a time critical thread, getAndReset() from the status timer.
+//
+class LatencyStats
+{
+public:
+  struct Summary
+  {
+    uint64_t count{0};
+    double mean{0};  // in microseconds
+    double max{0};   // in microseconds
+  };
+
+  void add(std::chrono::nanoseconds dt)
+  {
+    const int64_t ns = dt.count();
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(ns, std::memory_order_relaxed);
+    int64_t prev = max_.load(std::memory_order_relaxed);
+    while (ns > prev &&
+           !max_.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+  }
+
+  Summary getAndReset()
+  {
+    Summary s;
+    s.count = count_.exchange(0, std::memory_order_relaxed);
+    const int64_t sum = sum_.exchange(0, std::memory_order_relaxed);
+    s.max = max_.exchange(0, std::memory_order_relaxed) * 1e-3;
+    s.mean = s.count > 0 ? sum * 1e-3 / s.count : 0;
+    return (s);
+  }
+
+private:
+  std::atomic<uint64_t> count_{0};
+  std::atomic<int64_t> sum_{0};
+  std::atomic<int64_t> max_{0};
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__LATENCY_STATS_H_
@@ -0,0 +1,287 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__MESSAGE_POOL_H_
+#define FLIR_SPINNAKER_ROS2__MESSAGE_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Type-erased interface so a PoolAllocator can hand memory back to
+// whatever pool it was created for, no matter what type it was rebound to.
+//
+class PoolBase
+{
+public:
+  virtual ~PoolBase() {}
+  virtual bool owns(const void * p) const = 0;
+  virtual bool release(const void * p) = 0;
+};
+
+//
+// Fixed-size pool of preallocated messages. Messages handed out keep their
+// contents (and the capacity of their vectors and strings) when they come
+// back, so refilling them at frame rate does not touch the heap.
+//
+template <typename T>
+class MessagePool : public PoolBase
+{
+public:
+  struct Stats
+  {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    size_t highWater{0};  // max number of messages in use at the same time
+    size_t size{0};
+  };
+
+  explicit MessagePool(size_t n) : messages_(n), inUse_(n, false), tags_(n, 0)
+  {
+  }
+
+  // returns nullptr if all messages are in use
+  T * acquire()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    T * msg = take();
+    if (msg) {
+      highWater_ = std::max(highWater_, numInUse_);
+      hits_++;
+    } else {
+      misses_++;
+    }
+    return (msg);
+  }
+
+  // Like acquire(), but not counted in the statistics. For maintenance
+  // of idle messages, e.g. preparing their buffers.
+  T * acquireIdle()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return (take());
+  }
+
+  bool owns(const void * p) const override { return (index(p) >= 0); }
+
+  bool release(const void * p) override
+  {
+    const int idx = index(p);
+    if (idx < 0) {
+      return (false);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    inUse_[idx] = false;
+    numInUse_--;
+    return (true);
+  }
+
+  Stats getAndResetStats()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Stats s;
+    s.hits = hits_;
+    s.misses = misses_;
+    s.highWater = highWater_;
+    s.size = messages_.size();
+    hits_ = 0;
+    misses_ = 0;
+    highWater_ = numInUse_;
+    return (s);
+  }
+
+  size_t size() const { return (messages_.size()); }
+
+  // Per-message tag for the user, e.g. to remember what version of the
+  // content a recycled message holds. Returns nullptr if not from the pool.
+  uint64_t * tag(const T * p)
+  {
+    const int idx = index(p);
+    return (idx < 0 ? nullptr : &tags_[idx]);
+  }
+
+private:
+  // must hold the mutex
+  T * take()
+  {
+    for (size_t i = 0; i < messages_.size(); i++) {
+      if (!inUse_[i]) {
+        inUse_[i] = true;
+        numInUse_++;
+        return (&messages_[i]);
+      }
+    }
+    return (nullptr);
+  }
+  int index(const void * p) const
+  {
+    if (messages_.empty()) {
+      return (-1);
+    }
+    const uintptr_t a = reinterpret_cast<uintptr_t>(p);
+    const uintptr_t first = reinterpret_cast<uintptr_t>(&messages_[0]);
+    const uintptr_t last = reinterpret_cast<uintptr_t>(&messages_.back());
+    if (a < first || a > last) {
+      return (-1);
+    }
+    return (static_cast<int>((a - first) / sizeof(T)));
+  }
+  // ------- variables
+  std::vector<T> messages_;  // never resized after construction
+  std::vector<bool> inUse_;
+  std::vector<uint64_t> tags_;
+  std::mutex mutex_;
+  size_t numInUse_{0};
+  size_t highWater_{0};
+  uint64_t hits_{0};
+  uint64_t misses_{0};
+};
+
+//
+// Small set of shared messages for publishers that take a ConstSharedPtr,
+// such as image_transport. A message is handed out again once no one
+// else holds a reference to it, so the caller only rewrites what changed,
+// e.g. the time stamp, and the tag tells what version of the content the
+// message holds. If all messages are still referenced, a new one is
+// made, up to the size of the ring, after which it replaces the oldest.
+// Not thread safe, meant for a single publisher.
+//
+template <typename T>
+class SharedMessageRing
+{
+public:
+  static constexpr uint64_t NO_TAG = ~uint64_t(0);
+  explicit SharedMessageRing(size_t n)
+  : messages_(std::max(n, size_t(1))), tags_(messages_.size(), NO_TAG)
+  {
+  }
+
+  // never returns nullptr, *tag is NO_TAG for a new message
+  std::shared_ptr<T> acquire(uint64_t ** tag)
+  {
+    for (size_t i = 0; i < messages_.size(); i++) {
+      const size_t idx = (next_ + i) % messages_.size();
+      if (messages_[idx] && messages_[idx].use_count() == 1) {
+        // the last reader has dropped its reference, make sure it
+        // has also finished reading
+        std::atomic_thread_fence(std::memory_order_acquire);
+        next_ = (idx + 1) % messages_.size();
+        *tag = &tags_[idx];
+        return (messages_[idx]);
+      }
+    }
+    // all referenced, new messages go to empty slots first
+    for (size_t i = 0; i < messages_.size(); i++) {
+      if (!messages_[i]) {
+        return (replace(i, tag));
+      }
+    }
+    return (replace(next_, tag));
+  }
+
+  size_t size() const { return (messages_.size()); }
+
+private:
+  std::shared_ptr<T> replace(size_t idx, uint64_t ** tag)
+  {
+    messages_[idx] = std::make_shared<T>();
+    tags_[idx] = NO_TAG;
+    next_ = (idx + 1) % messages_.size();
+    *tag = &tags_[idx];
+    return (messages_[idx]);
+  }
+  // ------- variables
+  std::vector<std::shared_ptr<T>> messages_;
+  std::vector<uint64_t> tags_;
+  size_t next_{0};
+};
+
+template <typename T>
+constexpr uint64_t SharedMessageRing<T>::NO_TAG;
+
+//
+// Allocator for rclcpp publishers. Messages that belong to the pool are
+// neither destroyed nor freed when the middleware (or an intra-process
+// subscriber) lets go of them, but go back to the pool instead. Everything
+// else, including rcl's internal allocations, goes to the regular heap.
+//
+template <typename T>
+class PoolAllocator
+{
+public:
+  using value_type = T;
+  template <typename U>
+  struct rebind
+  {
+    typedef PoolAllocator<U> other;
+  };
+
+  PoolAllocator() = default;
+  explicit PoolAllocator(const std::shared_ptr<PoolBase> & pool) : pool_(pool)
+  {
+  }
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> & a) : pool_(a.getPool())  // NOLINT
+  {
+  }
+
+  T * allocate(size_t n)
+  {
+    return (static_cast<T *>(::operator new(n * sizeof(T))));
+  }
+
+  void deallocate(T * p, size_t)
+  {
+    if (!pool_ || !pool_->release(p)) {
+      ::operator delete(p);
+    }
+  }
+
+  template <typename U>
+  void destroy(U * p)
+  {
+    if (!pool_ || !pool_->owns(p)) {
+      p->~U();
+    }
+  }
+
+  const std::shared_ptr<PoolBase> & getPool() const { return (pool_); }
+
+private:
+  std::shared_ptr<PoolBase> pool_;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> & a, const PoolAllocator<U> & b)
+{
+  return (a.getPool() == b.getPool());
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> & a, const PoolAllocator<U> & b)
+{
+  return (a.getPool() != b.getPool());
+}
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__MESSAGE_POOL_H_
@@ -0,0 +1,62 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__PIXEL_FORMATS_H_
+#define FLIR_SPINNAKER_ROS2__PIXEL_FORMATS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+enum Packing {
+  PACKING_NONE,
+  PACKING_12P,       // GenICam "12p": LSB first bit stream
+  PACKING_12PACKED,  // GigE Vision "12Packed": high bytes, shared nibbles
+};
+
+struct PixelFormatInfo
+{
+  const char * name;            // as in the camera's PixelFormat node
+  const char * encoding;        // ROS encoding, after unpacking
+  const char * packedEncoding;  // when published without unpacking
+  int bitsPerPixel;             // as transmitted, all channels
+  Packing packing;
+  bool polarized{false};  // 2x2 pattern of polarizer angles
+};
+
+// Returns nullptr for pixel formats the driver does not know.
+const PixelFormatInfo * find_pixel_format(const std::string & name);
+
+// all known formats, e.g. for listing them in error messages
+const std::vector<PixelFormatInfo> & get_pixel_formats();
+
+// Unpacks rows [rowBegin, rowEnd) of a 12 bit packed image into 16 bit
+// pixels with values 0..4095. dst points to the output for row
+// rowBegin, dstStep is in bytes. Disjoint row ranges can be unpacked
+// concurrently.
+void unpack12_rows(
+  const uint8_t * src, size_t srcStep, int width, Packing packing,
+  uint8_t * dst, size_t dstStep, int rowBegin, int rowEnd);
+
+// Packs one row of 16 bit pixels (using the lower 12 bits), e.g. to
+// simulate a camera. dst must hold (3 * width + 1) / 2 bytes.
+void pack12_row(
+  const uint16_t * src, int width, Packing packing, uint8_t * dst);
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__PIXEL_FORMATS_H_
@@ -0,0 +1,52 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__POLARIZATION_H_
+#define FLIR_SPINNAKER_ROS2__POLARIZATION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace flir_spinnaker_ros2
+{
+// Outputs computed from a polarized image. The sensors of polarized
+// cameras (e.g. Sony IMX250MZR in the Blackfly S) have a polarizer in
+// front of every pixel, repeating in a 2x2 pattern:
+//
+//    90  45
+//   135   0
+//
+enum PolarizationOutput {
+  POL_ANGLE_0,
+  POL_ANGLE_45,
+  POL_ANGLE_90,
+  POL_ANGLE_135,
+  POL_DOLP,  // degree of linear polarization, 0..1 as 0..255
+  POL_AOLP,  // angle of linear polarization, 0..180deg as 0..255
+  POL_NUM_OUTPUTS
+};
+
+// Computes rows [rowBegin, rowEnd) of the half resolution outputs from
+// a polarized image with 8 or 16 bit values. dst[i] points to row 0 of
+// output i, or is nullptr if that output is not wanted. The outputs
+// have no row padding. The angle images have the bytes per value of
+// the input, DoLP and AoLP are 8 bit. Disjoint row ranges can be
+// computed concurrently.
+void polarization_rows(
+  const uint8_t * src, size_t srcStep, int width, int bytesPerValue,
+  uint8_t * const dst[POL_NUM_OUTPUTS], int rowBegin, int rowEnd);
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__POLARIZATION_H_
@@ -0,0 +1,72 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__RATE_LIMITER_H_
+#define FLIR_SPINNAKER_ROS2__RATE_LIMITER_H_
+
+#include <algorithm>
+#include <cstdint>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Picks the frames that go out on an output which does not need all of
+// them: every n'th frame, and at most maxRate frames per second going
+// by the frame time stamps. The rate keeps a schedule, and frames may
+// be up to half a period early, so jitter does not halve the rate when
+// the limit is close to the frame rate. Used from the publishing
+// thread only.
+//
+class RateLimiter
+{
+public:
+  // everyN: 1 for all frames, maxRate: 0 for no limit
+  void configure(int everyN, double maxRate)
+  {
+    everyN_ = std::max(everyN, 1);
+    period_ = maxRate > 0 ? static_cast<int64_t>(1e9 / maxRate) : 0;
+    count_ = 0;
+    next_ = 0;
+  }
+  bool isLimited() const { return (everyN_ > 1 || period_ > 0); }
+  // Call only for frames that would be published otherwise, with their
+  // time in nanoseconds. Returns true if the frame should go out.
+  bool pass(int64_t t)
+  {
+    if ((count_++ % everyN_) != 0) {
+      return (false);
+    }
+    if (period_ > 0) {
+      const int64_t dt = t - next_;
+      if (dt >= period_ || dt < -2 * period_) {
+        next_ = t + period_;  // first frame, after a gap or a time jump
+      } else if (dt >= -period_ / 2) {
+        next_ += period_;
+      } else {
+        return (false);
+      }
+    }
+    return (true);
+  }
+
+private:
+  uint32_t everyN_{1};
+  uint32_t count_{0};
+  int64_t period_{0};  // in nanoseconds
+  int64_t next_{0};    // scheduled time of the next frame
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__RATE_LIMITER_H_
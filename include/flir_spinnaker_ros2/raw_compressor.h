@@ -0,0 +1,73 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__RAW_COMPRESSOR_H_
+#define FLIR_SPINNAKER_ROS2__RAW_COMPRESSOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Lossless zstd compression of raw frames. Row padding is dropped, and
+// Bayer images can be split into their four color planes first, which
+// makes neighboring bytes more similar and improves the ratio. The
+// format string describes the layout, e.g.
+//
+//   bayer_rggb8; zstd; width=1440 height=1080 bytes_per_pixel=1 split=1
+//
+// so decompress() can restore the image exactly. A compressor keeps its
+// zstd context and buffers, and must only be used by one thread at a time.
+//
+class RawCompressor
+{
+public:
+  struct Input
+  {
+    const uint8_t * data{nullptr};
+    size_t step{0};
+    int width{0};
+    int height{0};
+    int bytesPerPixel{1};
+    std::string encoding;
+    bool bayerSplit{false};  // ignored for odd width or height
+  };
+  RawCompressor();
+  ~RawCompressor();
+  RawCompressor(const RawCompressor &) = delete;
+  RawCompressor & operator=(const RawCompressor &) = delete;
+
+  // returns "OK" or an error message
+  std::string compress(
+    const Input & in, int level, std::vector<uint8_t> * out,
+    std::string * format);
+
+  // Restores the image (with step = width * bytesPerPixel). Returns
+  // "OK" or an error message.
+  static std::string decompress(
+    const std::string & format, const std::vector<uint8_t> & compressed,
+    std::string * encoding, int * width, int * height, int * bytesPerPixel,
+    std::vector<uint8_t> * data);
+
+private:
+  void * context_{nullptr};  // ZSTD_CCtx
+  std::vector<uint8_t> packed_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__RAW_COMPRESSOR_H_
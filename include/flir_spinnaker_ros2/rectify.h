@@ -0,0 +1,73 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__RECTIFY_H_
+#define FLIR_SPINNAKER_ROS2__RECTIFY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Lookup table that undistorts and rectifies images, with the same
+// camera model as sensor_msgs/CameraInfo and OpenCV. For every output
+// pixel it holds the top left source pixel and the bilinear weights in
+// fixed point (1/64 pixel), so applying it needs no floating point.
+// Source pixels outside of the image produce black.
+//
+class RectifyMap
+{
+public:
+  // K and R are row major 3x3, P is row major 3x4. An all zero R or P
+  // is replaced by the identity or K. Supports the "plumb_bob" and
+  // "rational_polynomial" models. Returns "OK" or an error message.
+  // The table is not valid until buildRows() has covered all rows.
+  std::string init(
+    const std::string & distortionModel, const double * K,
+    const std::vector<double> & D, const double * R, const double * P,
+    int width, int height);
+  // Fills rows [rowBegin, rowEnd) of the table. Disjoint row ranges
+  // can be built concurrently.
+  void buildRows(int rowBegin, int rowEnd);
+  // Remaps rows [rowBegin, rowEnd) of an 8 bit image with 1 or 3
+  // channels. dst points to the output for row rowBegin. Disjoint row
+  // ranges can be remapped concurrently.
+  void remapRows(
+    const uint8_t * src, size_t srcStep, int channels, uint8_t * dst,
+    size_t dstStep, int rowBegin, int rowEnd) const;
+  int getWidth() const { return (width_); }
+  int getHeight() const { return (height_); }
+
+private:
+  struct Entry
+  {
+    int16_t x;   // top left source pixel, -1 if outside of the image
+    int16_t y;   // top left source pixel
+    uint8_t wx;  // weight of the right neighbor, 0..64
+    uint8_t wy;  // weight of the lower neighbor, 0..64
+  };
+  double K_[9];
+  double D_[8];    // k1, k2, p1, p2, k3, k4, k5, k6
+  double iPR_[9];  // inverse of P * R
+  int width_{0};
+  int height_{0};
+  std::vector<Entry> table_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__RECTIFY_H_
@@ -0,0 +1,67 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__REORDER_BUFFER_H_
+#define FLIR_SPINNAKER_ROS2__REORDER_BUFFER_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Restores the original frame order for stages that process several
+// frames in parallel. Each frame draws a sequence number before it is
+// handed to a worker, and every sequence number must be finished
+// exactly once, with an empty message if the frame was dropped.
+//
+template <typename MsgPtr>
+class ReorderBuffer
+{
+public:
+  typedef std::function<void(MsgPtr)> PublishFunction;
+  explicit ReorderBuffer(const PublishFunction & publish) : publish_(publish)
+  {
+  }
+  // not thread safe, call from the thread that submits the frames
+  uint64_t nextSequence() { return (nextSeq_++); }
+
+  // publishes everything that is complete up to the first gap
+  void finish(uint64_t seq, MsgPtr msg)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_[seq] = std::move(msg);
+    for (auto it = done_.begin(); it != done_.end() && it->first == publishSeq_;
+         it = done_.erase(it)) {
+      if (it->second) {
+        publish_(std::move(it->second));
+      }
+      publishSeq_++;
+    }
+  }
+
+private:
+  PublishFunction publish_;
+  uint64_t nextSeq_{0};
+  std::mutex mutex_;
+  uint64_t publishSeq_{0};
+  std::map<uint64_t, MsgPtr> done_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__REORDER_BUFFER_H_
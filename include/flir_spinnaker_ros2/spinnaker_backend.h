@@ -0,0 +1,65 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__SPINNAKER_BACKEND_H_
+#define FLIR_SPINNAKER_ROS2__SPINNAKER_BACKEND_H_
+
+#include <flir_spinnaker_common/driver.h>
+#include <flir_spinnaker_ros2/acquisition_backend.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+// backend for real cameras, forwards to the flir_spinnaker_common driver
+class SpinnakerBackend : public AcquisitionBackend
+{
+public:
+  SpinnakerBackend();
+
+  std::string getLibraryVersion() const override;
+  void refreshCameraList() override;
+  std::vector<std::string> getSerialNumbers() const override;
+  void setDebug(bool b) override;
+  void setComputeBrightness(bool b) override;
+  void setAcquisitionTimeout(double sec) override;
+
+  bool initCamera(const std::string & serialNumber) override;
+  bool deInitCamera() override;
+  bool startCamera(const Callback & cb) override;
+  bool stopCamera() override;
+  std::string getNodeMapAsString() override;
+
+  std::string setEnum(
+    const std::string & nodeName, const std::string & val,
+    std::string * retVal) override;
+  std::string setDouble(
+    const std::string & nodeName, double val, double * retVal) override;
+  std::string setInt(
+    const std::string & nodeName, int val, int * retVal) override;
+  std::string setBool(
+    const std::string & nodeName, bool val, bool * retVal) override;
+
+  double getReceiveFrameRate() const override;
+  std::string getPixelFormat() const override;
+
+private:
+  std::shared_ptr<flir_spinnaker_common::Driver> driver_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__SPINNAKER_BACKEND_H_
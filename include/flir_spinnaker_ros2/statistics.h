@@ -0,0 +1,85 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__STATISTICS_H_
+#define FLIR_SPINNAKER_ROS2__STATISTICS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+struct StatisticsConfig
+{
+  int subsample{1};  // every n-th row and column (2x2 block for Bayer)
+  int gridRows{1};
+  int gridCols{1};
+  int saturationBin{255};  // histogram bins >= this count as saturated
+  int blackBin{0};         // histogram bins <= this count as black
+};
+
+//
+// Statistics of an 8 or 16 bit image with 1 or 3 channels, or of a
+// Bayer image: a 256 bin histogram of the upper 8 significant bits,
+// the mean of each channel (of each pixel of the 2x2 block for Bayer
+// images), the fraction of saturated and black samples, and the means
+// of a grid of regions. Rows and columns can be subsampled to bound
+// the cost.
+//
+class ImageStatistics
+{
+public:
+  // Prepares for a new image. bits is the number of significant bits
+  // per value (e.g. 12 for unpacked 12 bit formats).
+  void reset(
+    const StatisticsConfig & config, int width, int height, int channels,
+    bool bayer, int bits);
+  // Adds rows [rowBegin, rowEnd) of the image that src points to.
+  // Disjoint row ranges can be accumulated concurrently into copies of
+  // a freshly reset object, and merged afterwards.
+  void accumulate(const uint8_t * src, size_t step, int rowBegin, int rowEnd);
+  void merge(const ImageStatistics & other);
+
+  std::vector<uint32_t> getHistogram() const;
+  std::vector<float> getChannelMeans() const;
+  std::vector<float> getGridMeans() const;
+  float getSaturatedFraction() const;
+  float getBlackFraction() const;
+  const StatisticsConfig & getConfig() const { return (config_); }
+  int getBits() const { return (bits_); }
+  // first row of a block of rows that are sampled together
+  int getRowAlignment() const { return (unit_ * config_.subsample); }
+
+private:
+  template <typename T, int UNIT, int CH>
+  void accumulateRows(
+    const uint8_t * src, size_t step, int rowBegin, int rowEnd);
+  StatisticsConfig config_;
+  int width_{0};
+  int height_{0};
+  int channels_{1};
+  int unit_{1};  // 2 for Bayer images
+  int bits_{8};
+  std::vector<uint32_t> histogram_;  // four partial histograms
+  std::vector<uint64_t> channelSum_;
+  std::vector<uint64_t> channelCount_;
+  std::vector<uint64_t> gridSum_;
+  std::vector<uint64_t> gridCount_;
+  std::vector<int> blockCell_;  // grid column of each sampled block
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__STATISTICS_H_
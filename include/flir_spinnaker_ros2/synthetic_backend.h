@@ -0,0 +1,105 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__SYNTHETIC_BACKEND_H_
+#define FLIR_SPINNAKER_ROS2__SYNTHETIC_BACKEND_H_
+
+#include <flir_spinnaker_ros2/acquisition_backend.h>
+#include <flir_spinnaker_ros2/pixel_formats.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Camera simulator for testing and benchmarking the node without
+// hardware. Frames are pre-rendered at startup, so generating them at
+// run time costs next to nothing. Exposure, gain and frame rate can be
+// set through the usual parameters, and the reported brightness follows
+// exposure and gain like a real camera looking at a static scene would.
+//
+class SyntheticBackend : public AcquisitionBackend
+{
+public:
+  struct Config
+  {
+    std::string serial;
+    size_t width{1440};
+    size_t height{1080};
+    std::string pixelFormat{"BayerRG8"};
+    double frameRate{30.0};
+  };
+  explicit SyntheticBackend(const Config & config);
+  ~SyntheticBackend();
+
+  std::string getLibraryVersion() const override;
+  void refreshCameraList() override {}
+  std::vector<std::string> getSerialNumbers() const override;
+  void setDebug(bool) override {}
+  void setComputeBrightness(bool b) override { computeBrightness_ = b; }
+  void setAcquisitionTimeout(double) override {}
+
+  bool initCamera(const std::string & serialNumber) override;
+  bool deInitCamera() override { return (true); }
+  bool startCamera(const Callback & cb) override;
+  bool stopCamera() override;
+  std::string getNodeMapAsString() override;
+
+  std::string setEnum(
+    const std::string & nodeName, const std::string & val,
+    std::string * retVal) override;
+  std::string setDouble(
+    const std::string & nodeName, double val, double * retVal) override;
+  std::string setInt(
+    const std::string & nodeName, int val, int * retVal) override;
+  std::string setBool(
+    const std::string & nodeName, bool val, bool * retVal) override;
+
+  double getReceiveFrameRate() const override;
+  std::string getPixelFormat() const override { return (config_.pixelFormat); }
+
+private:
+  void renderFrames();
+  void run();  // thread
+  // ----- variables --
+  Config config_;
+  size_t bitsPerPixel_{8};
+  size_t numChannels_{1};
+  size_t stride_{0};
+  Packing packing_{PACKING_NONE};
+  std::vector<std::vector<uint8_t>> frames_;  // never modified once rendered
+  Callback callback_;
+  std::shared_ptr<std::thread> thread_;
+  std::atomic<bool> keepRunning_{false};
+  std::atomic<bool> computeBrightness_{false};
+  mutable std::mutex mutex_;  // protects the variables below
+  double exposureTime_{5000.0};  // in usec
+  double gain_{0.0};             // in db
+  double frameRate_;
+  std::map<std::string, std::string> nodeValues_;  // for the node map dump
+  uint64_t frameId_{0};
+  mutable uint64_t framesSinceQuery_{0};
+  mutable std::chrono::steady_clock::time_point lastQueryTime_;
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__SYNTHETIC_BACKEND_H_
@@ -0,0 +1,38 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__THREAD_CONFIG_H_
+#define FLIR_SPINNAKER_ROS2__THREAD_CONFIG_H_
+
+#include <string>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+struct ThreadConfig
+{
+  std::vector<int> cpus;  // empty means: leave affinity alone
+  std::string policy;     // SCHED_OTHER, SCHED_FIFO, SCHED_RR, or empty
+  int priority{0};
+};
+
+// These functions work on the calling thread and, like the Spinnaker
+// driver, return "OK" on success or else an error message.
+std::string set_thread_affinity(const std::vector<int> & cpus);
+std::string set_thread_scheduling(const std::string & policy, int priority);
+std::string lock_all_memory();
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__THREAD_CONFIG_H_
@@ -0,0 +1,67 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__WORKER_POOL_H_
+#define FLIR_SPINNAKER_ROS2__WORKER_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flir_spinnaker_ros2
+{
+//
+// Small fixed-size thread pool for the image processing stages that
+// hang off the publishing thread. The queue is bounded so a slow stage
+// can never pile up frames: submit() fails instead and the caller
+// drops the frame.
+//
+class WorkerPool
+{
+public:
+  typedef std::function<void()> Job;
+  // onStart is run by each worker thread before it picks up jobs,
+  // e.g. to set its affinity and scheduling policy
+  WorkerPool(int numThreads, size_t maxQueued, const Job & onStart = Job());
+  ~WorkerPool();
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool & operator=(const WorkerPool &) = delete;
+
+  // returns false (and does not run the job) if the queue is full
+  bool submit(Job job);
+  // Calls f(begin, end) for consecutive chunks of [0, n) and blocks
+  // until all chunks are done. The calling thread works on chunks as
+  // well, so this can safely be called from inside a submitted job.
+  void parallelFor(
+    int n, int chunkSize, const std::function<void(int, int)> & f);
+  int getNumThreads() const { return (static_cast<int>(threads_.size())); }
+
+private:
+  void run(Job onStart);
+  void enqueueHelpers(int num, const Job & helper);
+  // ------- variables
+  std::vector<std::thread> threads_;
+  std::deque<Job> queue_;
+  size_t maxQueued_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool keepRunning_{true};
+};
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__WORKER_POOL_H_
@@ -0,0 +1,51 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLIR_SPINNAKER_ROS2__YUV_H_
+#define FLIR_SPINNAKER_ROS2__YUV_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace flir_spinnaker_ros2
+{
+enum YuvFormat {
+  YUV_NV12,  // Y plane, then interleaved U V plane at half resolution
+  YUV_UYVY,  // 4:2:2, ROS "yuv422"
+  YUV_YUYV,  // 4:2:2, ROS "yuv422_yuy2"
+};
+enum YuvMatrix { YUV_BT601, YUV_BT709 };
+
+// returns false if the string is not a valid format / matrix name
+bool yuv_format_from_string(const std::string & s, YuvFormat * f);
+bool yuv_matrix_from_string(const std::string & s, YuvMatrix * m);
+
+const char * yuv_encoding(YuvFormat f);
+size_t yuv_step(int width, YuvFormat f);  // of the Y (or only) plane
+size_t yuv_size(int width, int height, YuvFormat f);
+
+// Converts rows [rowBegin, rowEnd) of an 8 bit image with 1 (mono) or 3
+// (rgb or bgr) channels to limited range ("video") YUV. src points to
+// input row rowBegin, dst to the start of the whole output image since
+// NV12 has two planes. Width must be even, and for NV12 the height and
+// rowBegin as well. Disjoint row ranges can be converted concurrently.
+void yuv_from_rows(
+  const uint8_t * src, size_t srcStep, int width, int height, int channels,
+  bool bgr, YuvMatrix matrix, YuvFormat format, uint8_t * dst, int rowBegin,
+  int rowEnd);
+}  // namespace flir_spinnaker_ros2
+
+#endif  // FLIR_SPINNAKER_ROS2__YUV_H_
@@ -50,6 +50,21 @@ camera_params = {
     'chunk_enable_timestamp': True,
     }
 
+# To use the exposure control built into the driver instead of the
+# exposure_control node, remove that node and the '~/control'
+# remappings, and add these to the parameters of camera 0
+# (the master) and camera 1 (with 'exposure_control_master': False).
+exposure_control_params = {
+    'exposure_control': True,
+    'exposure_control_group': 'stereo',
+    'exposure_control_master': True,
+    'exposure_control_max_gain': 20.0,
+    'exposure_control_gain_priority': False,
+    'exposure_control_brightness_target': 100,
+    'exposure_control_max_exposure_time': 9500.0,
+    'exposure_control_min_exposure_time': 1000.0,
+    }
+
 
 def generate_launch_description():
     """Create synchronized stereo camera."""
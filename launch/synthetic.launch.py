@@ -0,0 +1,54 @@
+# -----------------------------------------------------------------------------
+# Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+#
+
+from launch_ros.actions import Node
+from launch.substitutions import LaunchConfiguration as LaunchConfig
+from launch.actions import DeclareLaunchArgument as LaunchArg
+from launch import LaunchDescription
+from ament_index_python.packages import get_package_share_directory
+
+camera_params = {
+    'debug': False,
+    'compute_brightness': True,
+    'backend': 'synthetic',
+    'synthetic_width': 2448,
+    'synthetic_height': 2048,
+    'synthetic_pixel_format': 'BayerRG8',
+    'synthetic_frame_rate': 75.0,
+    # set parameters defined in synthetic.cfg
+    'exposure_time': 5000.0,
+    'gain': 0.0,
+    }
+
+
+def generate_launch_description():
+    """Launch synthetic camera node for testing without hardware."""
+    flir_dir = get_package_share_directory('flir_spinnaker_ros2')
+    config_dir = flir_dir + '/config/'
+    name_arg = LaunchArg('camera_name', default_value='synthetic',
+                         description='camera name')
+
+    node = Node(package='flir_spinnaker_ros2',
+                executable='camera_driver_node',
+                output='screen',
+                name=[LaunchConfig('camera_name')],
+                parameters=[camera_params,
+                            {'parameter_file': config_dir + 'synthetic.cfg',
+                             'serial_number': 'synthetic'}],
+                remappings=[('~/control', '/exposure_control/control'), ])
+
+    return LaunchDescription([name_arg, node])
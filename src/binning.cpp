@@ -0,0 +1,124 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/binning.h>
+
+#include "simd.h"
+
+//
+// All variants first average two rows, then pairs of columns. For
+// mono images the columns are adjacent bytes, for Bayer images they
+// are two bytes apart, which is a deinterleave of 16 bit units. Both
+// steps round up, the scalar tail does the same so that the result does
+// not depend on the vector width.
+//
+
+namespace flir_spinnaker_ros2
+{
+namespace
+{
+inline uint8_t average(int a, int b)
+{
+  return (static_cast<uint8_t>((a + b + 1) >> 1));
+}
+
+void bin_row_mono(
+  const uint8_t * r0, const uint8_t * r1, int w, uint8_t * out)
+{
+  using namespace simd;
+  int x = 0;
+  for (; x + simd::width <= w; x += simd::width) {
+    const u8v a = avg(load(r0 + 2 * x), load(r1 + 2 * x));
+    const u8v b =
+      avg(load(r0 + 2 * x + simd::width), load(r1 + 2 * x + simd::width));
+    u8v even, odd;
+    deinterleave8(a, b, &even, &odd);
+    store(out + x, avg(even, odd));
+  }
+  for (; x < w; x++) {
+    out[x] = average(
+      average(r0[2 * x], r1[2 * x]), average(r0[2 * x + 1], r1[2 * x + 1]));
+  }
+}
+
+void bin_row_bayer(
+  const uint8_t * r0, const uint8_t * r1, int w, uint8_t * out)
+{
+  using namespace simd;
+  int x = 0;
+  for (; x + simd::width <= w; x += simd::width) {
+    const u8v a = avg(load(r0 + 2 * x), load(r1 + 2 * x));
+    const u8v b =
+      avg(load(r0 + 2 * x + simd::width), load(r1 + 2 * x + simd::width));
+    u8v even, odd;
+    deinterleave16(a, b, &even, &odd);
+    store(out + x, avg(even, odd));
+  }
+  for (; x < w; x++) {
+    const int x0 = 2 * x - (x & 1);
+    out[x] = average(
+      average(r0[x0], r1[x0]), average(r0[x0 + 2], r1[x0 + 2]));
+  }
+}
+
+void bin_row_generic(
+  const uint8_t * r0, const uint8_t * r1, int w, int bpp, uint8_t * out)
+{
+  for (int x = 0; x < w; x++) {
+    for (int c = 0; c < bpp; c++) {
+      const int i0 = 2 * x * bpp + c;
+      const int i1 = i0 + bpp;
+      out[x * bpp + c] =
+        average(average(r0[i0], r1[i0]), average(r0[i1], r1[i1]));
+    }
+  }
+}
+}  // namespace
+
+void bin2x2_size(int width, int height, bool bayer, int * w, int * h)
+{
+  if (bayer) {
+    *w = (width / 4) * 2;
+    *h = (height / 4) * 2;
+  } else {
+    *w = width / 2;
+    *h = height / 2;
+  }
+}
+
+void bin2x2_rows(
+  const uint8_t * src, size_t srcStep, int width, int height,
+  int bytesPerPixel, bool bayer, uint8_t * dst, size_t dstStep, int rowBegin,
+  int rowEnd)
+{
+  int w, h;
+  bin2x2_size(width, height, bayer, &w, &h);
+  for (int y = rowBegin; y < rowEnd && y < h; y++) {
+    uint8_t * out = dst + (y - rowBegin) * dstStep;
+    if (bayer) {
+      // same color rows are two apart
+      const uint8_t * r0 = src + (2 * y - (y & 1)) * srcStep;
+      bin_row_bayer(r0, r0 + 2 * srcStep, w, out);
+    } else {
+      const uint8_t * r0 = src + 2 * y * srcStep;
+      if (bytesPerPixel == 1) {
+        bin_row_mono(r0, r0 + srcStep, w, out);
+      } else {
+        bin_row_generic(r0, r0 + srcStep, w, bytesPerPixel, out);
+      }
+    }
+  }
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,91 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/buffer_memory.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace flir_spinnaker_ros2
+{
+static const uintptr_t huge_page_size = 2 * 1024 * 1024;
+
+// madvise() and friends only operate on whole pages
+static bool page_range(
+  const void * p, size_t size, uintptr_t align, uintptr_t * start,
+  size_t * len)
+{
+  const uintptr_t a = reinterpret_cast<uintptr_t>(p);
+  const uintptr_t s = (a + align - 1) & ~(align - 1);
+  const uintptr_t e = (a + size) & ~(align - 1);
+  if (e <= s) {
+    return (false);
+  }
+  *start = s;
+  *len = e - s;
+  return (true);
+}
+
+std::string prepare_buffer(
+  std::vector<uint8_t> * buf, size_t size, bool hugePages, bool lock)
+{
+  if (buf->capacity() >= size) {
+    buf->resize(size);
+    return ("OK");
+  }
+  unlock_buffer(*buf);
+  std::vector<uint8_t>().swap(*buf);  // free old memory first
+  buf->reserve(size);
+  std::string msg("OK");
+  uintptr_t start;
+  size_t len;
+#ifdef MADV_HUGEPAGE
+  // The vector's memory is not 2MB aligned, so only the aligned
+  // interior of larger buffers can end up on huge pages.
+  if (
+    hugePages && page_range(buf->data(), size, huge_page_size, &start, &len)) {
+    if (madvise(reinterpret_cast<void *>(start), len, MADV_HUGEPAGE) != 0) {
+      msg = std::string("madvise(MADV_HUGEPAGE) failed: ") + strerror(errno);
+    }
+  }
+#else
+  if (hugePages) {
+    msg = "huge pages not supported on this platform";
+  }
+#endif
+  buf->resize(size);  // writes zeros, i.e. faults in all pages now
+  const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  if (lock && page_range(buf->data(), size, pageSize, &start, &len)) {
+    if (mlock(reinterpret_cast<void *>(start), len) != 0) {
+      msg = std::string("mlock failed: ") + strerror(errno);
+    }
+  }
+  return (msg);
+}
+
+void unlock_buffer(const std::vector<uint8_t> & buf)
+{
+  uintptr_t start;
+  size_t len;
+  const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  if (
+    buf.capacity() > 0 &&
+    page_range(buf.data(), buf.capacity(), pageSize, &start, &len)) {
+    munlock(reinterpret_cast<void *>(start), len);  // ok if not locked
+  }
+}
+}  // namespace flir_spinnaker_ros2
@@ -13,9 +13,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <flir_spinnaker_ros2/buffer_memory.h>
 #include <flir_spinnaker_ros2/camera_driver.h>
+#include <flir_spinnaker_ros2/spinnaker_backend.h>
+#include <flir_spinnaker_ros2/synthetic_backend.h>
 
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <image_transport/image_transport.hpp>
@@ -91,6 +95,15 @@ static std::pair<bool, bool> get_bool_int_param(const rclcpp::Parameter & p)
   return (bb);
 }
 
+// e.g. "PixelFormat", or a path ending in it
+static bool is_pixel_format_node(const std::string & nodeName)
+{
+  const std::string pf("PixelFormat");
+  return (
+    nodeName.size() >= pf.size() &&
+    nodeName.compare(nodeName.size() - pf.size(), pf.size(), pf) == 0);
+}
+
 CameraDriver::NodeInfo::NodeInfo(
   const std::string & n, const std::string & nodeType)
 : name(n)
@@ -132,6 +145,11 @@ CameraDriver::~CameraDriver()
 
 bool CameraDriver::stop()
 {
+  if (exposureControlGroup_ && exposureFollowerId_ >= 0) {
+    // waits until a running update from the master is done
+    exposureControlGroup_->removeFollower(exposureFollowerId_);
+    exposureFollowerId_ = -1;
+  }
   stopCamera();
   if (driver_) {
     driver_->deInitCamera();
@@ -139,11 +157,20 @@ bool CameraDriver::stop()
   if (!statusTimer_->is_canceled()) {
     statusTimer_->cancel();
   }
+  if (subscriberTimer_ && !subscriberTimer_->is_canceled()) {
+    subscriberTimer_->cancel();
+  }
   keepRunning_ = false;
   if (thread_) {
+    if (latestFrame_) {
+      latestFrame_->wakeup();
+    } else {
+      imageRing_->wakeup();
+    }
     thread_->join();
     thread_ = 0;
   }
+  workerPool_.reset();  // finishes the jobs in progress
   return (true);
 }
 
@@ -159,25 +186,150 @@ bool CameraDriver::stopCamera()
 void CameraDriver::printStatus()
 {
   if (driver_) {
-    const double dropRate = (publishedCount_ > 0)
-                              ? (static_cast<double>(droppedCount_) /
-                                 static_cast<double>(publishedCount_))
+    const uint32_t published = publishedCount_.exchange(0);
+    const uint32_t droppedQueueFull = droppedQueueFullCount_.exchange(0);
+    const uint32_t droppedTooOld = droppedTooOldCount_.exchange(0);
+    const uint32_t droppedCount = droppedQueueFull + droppedTooOld;
+    const double dropRate = (published > 0)
+                              ? (static_cast<double>(droppedCount) /
+                                 static_cast<double>(published))
                               : 0;
     const rclcpp::Time t = now();
     const rclcpp::Duration dt = t - lastStatusTime_;
     double dtns = std::max(dt.nanoseconds(), (int64_t)1);
-    double outRate = publishedCount_ * 1e9 / dtns;
+    double outRate = published * 1e9 / dtns;
     LOG_INFO(
       "frame rate in: " << driver_->getReceiveFrameRate() << " Hz, out:"
-                        << outRate << " Hz, drop: " << dropRate * 100 << "%");
+                        << outRate << " Hz, drop: " << dropRate * 100
+                        << "% (queue full: " << droppedQueueFull
+                        << ", too old: " << droppedTooOld << ")");
+    const auto ft = fillTime_.getAndReset();
+    if (ft.count > 0) {
+      LOG_INFO(
+        "image fill time avg: " << ft.mean << "us, max: " << ft.max << "us");
+    }
+    const auto fft = flatFieldTime_.getAndReset();
+    if (fft.count > 0) {
+      LOG_INFO(
+        "flat field correction avg: " << fft.mean << "us, max: " << fft.max
+                                      << "us");
+    }
+    if (exposureController_) {
+      const auto es = exposureController_->getAndResetStats();
+      if (es.numChanges > 0) {
+        LOG_INFO(
+          "exposure control changes: " << es.numChanges << " seen in frame: "
+                                       << es.numLanded << " latency avg: "
+                                       << es.avgLatency << " frames");
+      }
+    }
+    if (changeDetection_) {
+      const auto ct = changeTime_.getAndReset();
+      LOG_INFO(
+        "change detection published: "
+        << changePublished_.exchange(0) << " of " << changeFrames_.exchange(0)
+        << " frames, time avg: " << ct.mean << "us, max: " << ct.max << "us");
+    }
+    const auto fct = focusTime_.getAndReset();
+    if (fct.count > 0) {
+      LOG_INFO(
+        "focus metric time avg: " << fct.mean << "us, max: " << fct.max
+                                  << "us");
+    }
+    const auto stt = statisticsTime_.getAndReset();
+    if (stt.count > 0) {
+      LOG_INFO(
+        "statistics time avg: " << stt.mean << "us, max: " << stt.max << "us");
+    }
+    if (inlinePublishing_) {
+      const auto cb = callbackTime_.getAndReset();
+      LOG_INFO(
+        "inline publish time avg: " << cb.mean << "us, max: " << cb.max
+                                    << "us over " << cb.count << " frames");
+    }
+    if (framePool_) {
+      const auto fs = framePool_->getAndResetStats();
+      if (fs.hits + fs.misses > 0) {
+        LOG_INFO(
+          "frame pool hits: " << fs.hits << " misses: " << fs.misses
+                              << " max used: " << fs.highWater << "/"
+                              << fs.size);
+      }
+    }
+    if (imagePool_) {
+      const auto is = imagePool_->getAndResetStats();
+      const auto cs = cameraInfoPool_->getAndResetStats();
+      LOG_INFO(
+        "message pool image hits: " << is.hits << " misses: " << is.misses
+                                    << " max used: " << is.highWater << "/"
+                                    << is.size << ", info hits: " << cs.hits
+                                    << " misses: " << cs.misses
+                                    << " max used: " << cs.highWater << "/"
+                                    << cs.size);
+    }
+    if (demosaicEnabled_) {
+      printStageStatus("color", &colorStage_);
+    }
+    if (pyramidLevels_ > 0) {
+      printStageStatus("pyramid", &pyramidStage_);
+    }
+    if (polarizationEnabled_) {
+      printStageStatus("polarization", &polarizationStage_);
+    }
+    if (yuvEnabled_) {
+      printStageStatus("yuv", &yuvStage_);
+    }
+    if (rectifyEnabled_) {
+      printStageStatus("rectify", &rectifyStage_);
+    }
+    if (jpegEnabled_) {
+      printStageStatus("jpeg", &jpegStage_);
+      const uint64_t bytes = jpegBytes_.exchange(0);
+      if (bytes > 0) {
+        LOG_INFO(
+          "jpeg output: " << bytes * 8e-6 / std::max(dtns * 1e-9, 1e-3)
+                          << " Mbit/s");
+      }
+    }
+    if (zstdEnabled_) {
+      const auto st = zstdStage_.time.getAndReset();
+      const uint64_t bytesIn = zstdBytesIn_.exchange(0);
+      const uint64_t bytesOut = zstdBytesOut_.exchange(0);
+      const uint32_t dropped = zstdStage_.dropped.exchange(0);
+      if (st.count > 0 && bytesOut > 0) {
+        // throughput is per worker thread, the output rate is what
+        // has to be written to disk
+        const double ratio = static_cast<double>(bytesIn) / bytesOut;
+        LOG_INFO(
+          "zstd frames: " << st.count << " dropped: " << dropped
+                          << " ratio: " << ratio << " time avg: " << st.mean
+                          << "us, max: " << st.max << "us, throughput: "
+                          << bytesIn / (st.count * std::max(st.mean, 1.0))
+                          << " MB/s, output: "
+                          << bytesOut * 1e-6 / std::max(dtns * 1e-9, 1e-3)
+                          << " MB/s");
+      } else if (dropped > 0) {
+        LOG_INFO("zstd frames dropped: " << dropped);
+      }
+    }
     lastStatusTime_ = t;
-    droppedCount_ = 0;
-    publishedCount_ = 0;
   } else {
     LOG_WARN("camera " << serial_ << " is not online!");
   }
 }
 
+void CameraDriver::printStageStatus(
+  const std::string & name, OutputStage * stage)
+{
+  const auto st = stage->time.getAndReset();
+  const uint32_t dropped = stage->dropped.exchange(0);
+  if (st.count > 0 || dropped > 0) {
+    LOG_INFO(
+      name << " frames: " << st.count << " dropped: " << dropped
+           << " time avg: " << st.mean << "us, max: " << st.max << "us");
+  }
+}
+
 void CameraDriver::readParameters()
 {
   serial_ = this->declare_parameter<std::string>(
@@ -191,21 +343,318 @@ void CameraDriver::readParameters()
     debug_ = false;
   }
   LOG_INFO("debug: " << debug_);
+  backend_ = this->declare_parameter<std::string>("backend", "spinnaker");
   cameraInfoURL_ = this->declare_parameter<std::string>("camerainfo_url", "");
   frameId_ = this->declare_parameter<std::string>("frame_id", get_name());
   dumpNodeMap_ = this->declare_parameter<bool>("dump_node_map", false);
   qosDepth_ = this->declare_parameter<int>("image_queue_size", 4);
+  useLoanedMessages_ =
+    this->declare_parameter<bool>("use_loaned_messages", false);
+  messagePoolSize_ = this->declare_parameter<int>("message_pool_size", 0);
+  poolLockMemory_ =
+    this->declare_parameter<bool>("message_pool_lock_memory", false);
+  poolHugePages_ =
+    this->declare_parameter<bool>("message_pool_huge_pages", false);
+  inlinePublishing_ =
+    this->declare_parameter<bool>("inline_publishing", false);
+  publishThreadConfig_ = readThreadConfig("publish_thread");
+  acquisitionThreadConfig_ = readThreadConfig("acquisition_thread");
+  lockMemory_ = this->declare_parameter<bool>("lock_memory", false);
+  numWorkerThreads_ =
+    std::max(this->declare_parameter<int>("worker_threads", 2), 1);
+  workerThreadConfig_ = readThreadConfig("worker_thread");
+  const std::string demosaic =
+    this->declare_parameter<std::string>("demosaic", "off");
+  demosaicEnabled_ = (demosaic != "off");
+  if (
+    demosaicEnabled_ &&
+    !demosaic_method_from_string(demosaic, &demosaicMethod_)) {
+    LOG_WARN("invalid demosaic method: " << demosaic << ", using bilinear!");
+    demosaicMethod_ = DEMOSAIC_BILINEAR;
+  }
+  // level n is 2^n times smaller, beyond 8 there is nothing left
+  pyramidLevels_ = std::min(
+    std::max(this->declare_parameter<int>("pyramid_levels", 0), 0), 8);
+  polarizationEnabled_ =
+    this->declare_parameter<bool>("polarization_output", false);
+  jpegEnabled_ = this->declare_parameter<bool>("jpeg_output", false);
+  jpegQuality_ = std::min(
+    std::max(this->declare_parameter<int>("jpeg_quality", 90), 1), 100);
+  const std::string sub =
+    this->declare_parameter<std::string>("jpeg_subsampling", "420");
+  if (!JpegEncoder::subsamplingFromString(sub, &jpegSubsampling_)) {
+    LOG_WARN("invalid jpeg_subsampling: " << sub << ", using 420!");
+    jpegSubsampling_ = JpegEncoder::S420;
+  }
+  unpackPackedFormats_ =
+    this->declare_parameter<bool>("unpack_packed_formats", true);
+  const std::string yuv =
+    this->declare_parameter<std::string>("yuv_output", "off");
+  yuvEnabled_ = (yuv != "off");
+  if (yuvEnabled_ && !yuv_format_from_string(yuv, &yuvFormat_)) {
+    LOG_WARN("invalid yuv_output: " << yuv << ", using nv12!");
+    yuvFormat_ = YUV_NV12;
+  }
+  const std::string matrix =
+    this->declare_parameter<std::string>("yuv_matrix", "bt709");
+  if (!yuv_matrix_from_string(matrix, &yuvMatrix_)) {
+    LOG_WARN("invalid yuv_matrix: " << matrix << ", using bt709!");
+    yuvMatrix_ = YUV_BT709;
+  }
+  darkFrameFile_ =
+    this->declare_parameter<std::string>("dark_frame_file", "");
+  flatFieldFile_ =
+    this->declare_parameter<std::string>("flat_field_file", "");
+  referenceFrames_ =
+    std::max(this->declare_parameter<int>("reference_frames", 16), 1);
+  loadReferences();
+  statisticsEnabled_ = this->declare_parameter<bool>("statistics", false);
+  statisticsConfig_.subsample =
+    std::max(this->declare_parameter<int>("statistics_subsample", 4), 1);
+  const auto grid = this->declare_parameter<std::vector<int64_t>>(
+    "statistics_grid", std::vector<int64_t>({4, 4}));
+  if (grid.size() == 2) {
+    statisticsConfig_.gridRows = std::max(static_cast<int>(grid[0]), 1);
+    statisticsConfig_.gridCols = std::max(static_cast<int>(grid[1]), 1);
+  } else {
+    LOG_WARN("statistics_grid must be [rows, cols], using [4, 4]!");
+    statisticsConfig_.gridRows = 4;
+    statisticsConfig_.gridCols = 4;
+  }
+  statisticsConfig_.saturationBin = std::min(
+    std::max(this->declare_parameter<int>("statistics_saturation_bin", 255), 0),
+    255);
+  statisticsConfig_.blackBin = std::min(
+    std::max(this->declare_parameter<int>("statistics_black_bin", 0), 0), 255);
+  changeDetection_ =
+    this->declare_parameter<bool>("change_detection", false);
+  changeDetector_.configure(
+    this->declare_parameter<int>("change_subsample", 8),
+    this->declare_parameter<int>("change_pixel_threshold", 16));
+  changeThreshold_ =
+    this->declare_parameter<double>("change_threshold", 0.001);
+  changeKeepalive_ = static_cast<int64_t>(
+    std::max(this->declare_parameter<double>("change_keepalive", 1.0), 0.0) *
+    1e9);
+  focusEnabled_ = this->declare_parameter<bool>("focus_metric", false);
+  const auto focusRoi = this->declare_parameter<std::vector<int64_t>>(
+    "focus_roi", std::vector<int64_t>());
+  if (focusRoi.size() == 4) {
+    focusConfig_.x = static_cast<int>(focusRoi[0]);
+    focusConfig_.y = static_cast<int>(focusRoi[1]);
+    focusConfig_.width = static_cast<int>(focusRoi[2]);
+    focusConfig_.height = static_cast<int>(focusRoi[3]);
+  } else if (!focusRoi.empty()) {
+    LOG_WARN("focus_roi must be [x, y, width, height], using full image!");
+  }
+  focusConfig_.stride =
+    std::max(this->declare_parameter<int>("focus_stride", 2), 1);
+  rectifyEnabled_ = this->declare_parameter<bool>("rectify", false);
+  zstdEnabled_ = this->declare_parameter<bool>("zstd_output", false);
+  zstdLevel_ = this->declare_parameter<int>("zstd_level", 1);
+  zstdBayerSplit_ = this->declare_parameter<bool>("zstd_bayer_split", true);
+  colorEncoding_ =
+    this->declare_parameter<std::string>("demosaic_encoding", "rgb8");
+  if (
+    colorEncoding_ != sensor_msgs::image_encodings::RGB8 &&
+    colorEncoding_ != sensor_msgs::image_encodings::BGR8) {
+    LOG_WARN("invalid demosaic encoding: " << colorEncoding_ << ", using rgb8");
+    colorEncoding_ = sensor_msgs::image_encodings::RGB8;
+  }
+  const std::string policy =
+    this->declare_parameter<std::string>("frame_queue_policy", "fifo");
+  if (policy == "latest") {
+    queuePolicy_ = LATEST;
+  } else if (policy == "max_age") {
+    queuePolicy_ = MAX_AGE;
+  } else {
+    if (policy != "fifo") {
+      LOG_WARN("invalid frame_queue_policy: " << policy << ", using fifo!");
+    }
+    queuePolicy_ = FIFO;
+  }
+  queueDepth_ =
+    std::max(this->declare_parameter<int>("frame_queue_depth", 2), 1);
+  const double maxAge =
+    this->declare_parameter<double>("frame_max_age_ms", 100.0);
+  maxFrameAge_ = chrono::nanoseconds(static_cast<int64_t>(maxAge * 1e6));
+  LOG_INFO("frame queue policy: " << policy << " depth: " << queueDepth_);
+  if (queuePolicy_ == MAX_AGE) {
+    LOG_INFO("dropping frames older than " << maxAge << "ms");
+  }
   computeBrightness_ =
     this->declare_parameter<bool>("compute_brightness", false);
+  readRateLimit("image_raw", &rawRate_);
+  readRateLimit("meta", &metaRate_);
+  readRateLimit("color", &colorStage_.rate);
+  readRateLimit("pyramid", &pyramidStage_.rate);
+  readRateLimit("polarization", &polarizationStage_.rate);
+  readRateLimit("yuv", &yuvStage_.rate);
+  readRateLimit("rectify", &rectifyStage_.rate);
+  readRateLimit("jpeg", &jpegStage_.rate);
+  readRateLimit("zstd", &zstdStage_.rate);
+  readRateLimit("roi", &roiRate_);
+  readRateLimit("statistics", &statisticsRate_);
+  readRateLimit("focus", &focusRate_);
+  readExposureControlParameters();
   acquisitionTimeout_ =
     this->declare_parameter<double>("acquisition_timeout", 3.0);
+  subscriberCheckInterval_ =
+    this->declare_parameter<double>("subscriber_check_interval", 0.5);
   parameterFile_ =
     this->declare_parameter<std::string>("parameter_file", "parameters.cfg");
+  const auto roiNames = this->declare_parameter<std::vector<std::string>>(
+    "roi_names", std::vector<std::string>());
+  for (const auto & name : roiNames) {
+    rois_.push_back(std::make_unique<Roi>(name));
+    const auto geom = this->declare_parameter<std::vector<int64_t>>(
+      "roi." + name, std::vector<int64_t>());
+    const std::string msg = setRoi(name, geom);
+    if (msg != "OK") {
+      LOG_WARN("roi " << name << ": " << msg);
+    }
+  }
   LOG_INFO(" serial: " << serial_);
   callbackHandle_ = this->add_on_set_parameters_callback(
     std::bind(&CameraDriver::parameterChanged, this, std::placeholders::_1));
 }
 
+void CameraDriver::readRateLimit(
+  const std::string & output, RateLimiter * limiter)
+{
+  const int everyN =
+    std::max(this->declare_parameter<int>(output + "_decimation", 1), 1);
+  const double maxRate =
+    this->declare_parameter<double>(output + "_max_rate", 0.0);
+  limiter->configure(everyN, maxRate);
+  if (everyN > 1) {
+    LOG_INFO(output << ": publishing every " << everyN << "th frame");
+  }
+  if (maxRate > 0) {
+    LOG_INFO(output << ": publishing at most " << maxRate << " Hz");
+  }
+}
+
+void CameraDriver::readExposureControlParameters()
+{
+  exposureControlEnabled_ =
+    this->declare_parameter<bool>("exposure_control", false);
+  exposureControlGroupName_ =
+    this->declare_parameter<std::string>("exposure_control_group", "");
+  exposureControlMaster_ =
+    this->declare_parameter<bool>("exposure_control_master", true);
+  // same names and defaults as the exposure_control_ros2 node
+  ExposureController::Config c;
+  c.brightnessTarget = this->declare_parameter<double>(
+    "exposure_control_brightness_target", c.brightnessTarget);
+  c.brightnessTolerance = this->declare_parameter<double>(
+    "exposure_control_brightness_tolerance", c.brightnessTolerance);
+  c.minExposureTime = this->declare_parameter<double>(
+    "exposure_control_min_exposure_time", c.minExposureTime);
+  c.maxExposureTime = std::max(
+    this->declare_parameter<double>(
+      "exposure_control_max_exposure_time", c.maxExposureTime),
+    c.minExposureTime);
+  c.maxGain =
+    this->declare_parameter<double>("exposure_control_max_gain", c.maxGain);
+  c.gainPriority = this->declare_parameter<bool>(
+    "exposure_control_gain_priority", c.gainPriority);
+  c.maxFramesSkip = std::max(
+    this->declare_parameter<int>(
+      "exposure_control_max_frames_skip", c.maxFramesSkip),
+    1);
+  if (!exposureControlEnabled_) {
+    return;
+  }
+  if (!exposureControlMaster_ && exposureControlGroupName_.empty()) {
+    LOG_WARN("exposure control follower without group, disabling it!");
+    exposureControlEnabled_ = false;
+    return;
+  }
+  if (exposureControlMaster_) {
+    exposureController_ = std::make_unique<ExposureController>(c);
+    computeBrightness_ = true;  // the controller needs it
+  }
+  LOG_INFO(
+    "exposure control: " << (exposureControlMaster_ ? "master" : "follower")
+                         << (exposureControlGroupName_.empty()
+                               ? std::string("")
+                               : " of group " + exposureControlGroupName_));
+}
+
+ThreadConfig CameraDriver::readThreadConfig(const std::string & prefix)
+{
+  ThreadConfig tc;
+  const auto cpus = this->declare_parameter<std::vector<int64_t>>(
+    prefix + "_cpus", std::vector<int64_t>());
+  for (const auto c : cpus) {
+    tc.cpus.push_back(static_cast<int>(c));
+  }
+  tc.policy = this->declare_parameter<std::string>(prefix + "_policy", "");
+  tc.priority = this->declare_parameter<int>(prefix + "_priority", 0);
+  return (tc);
+}
+
+void CameraDriver::applyThreadConfig(
+  const std::string & name, const ThreadConfig & tc)
+{
+  if (!tc.cpus.empty()) {
+    const std::string msg = set_thread_affinity(tc.cpus);
+    if (msg == "OK") {
+      std::stringstream ss;
+      for (const auto c : tc.cpus) {
+        ss << " " << c;
+      }
+      LOG_INFO(name << " thread pinned to cpu(s):" << ss.str());
+    } else {
+      LOG_WARN("setting " << name << " thread affinity failed: " << msg);
+    }
+  }
+  if (!tc.policy.empty()) {
+    const std::string msg = set_thread_scheduling(tc.policy, tc.priority);
+    if (msg == "OK") {
+      LOG_INFO(
+        name << " thread scheduling: " << tc.policy
+             << " priority: " << tc.priority);
+    } else {
+      LOG_WARN("setting " << name << " thread scheduling failed: " << msg);
+    }
+  }
+}
+
+void CameraDriver::configureAcquisitionThread()
+{
+  // The Spinnaker callback thread is not ours, so configure it from the
+  // inside once it shows up (again, if the SDK restarted acquisition).
+  if (std::this_thread::get_id() != acquisitionThreadId_) {
+    acquisitionThreadId_ = std::this_thread::get_id();
+    applyThreadConfig("acquisition", acquisitionThreadConfig_);
+  }
+}
+
+std::shared_ptr<AcquisitionBackend> CameraDriver::makeBackend()
+{
+  if (backend_ == "synthetic") {
+    SyntheticBackend::Config cfg;
+    cfg.serial = serial_;
+    cfg.width = this->declare_parameter<int>("synthetic_width", 1440);
+    cfg.height = this->declare_parameter<int>("synthetic_height", 1080);
+    cfg.pixelFormat = this->declare_parameter<std::string>(
+      "synthetic_pixel_format", "BayerRG8");
+    cfg.frameRate =
+      this->declare_parameter<double>("synthetic_frame_rate", 30.0);
+    LOG_INFO(
+      "using synthetic camera " << cfg.width << "x" << cfg.height << " "
+                                << cfg.pixelFormat << " at " << cfg.frameRate
+                                << "Hz");
+    return (std::make_shared<SyntheticBackend>(cfg));
+  }
+  if (backend_ != "spinnaker") {
+    LOG_WARN("unknown backend: " << backend_ << ", using spinnaker!");
+  }
+  return (std::make_shared<SpinnakerBackend>());
+}
+
 bool CameraDriver::readParameterFile()
 {
   std::ifstream f(parameterFile_);
@@ -270,6 +719,9 @@ bool CameraDriver::setEnum(const std::string & nodeName, const std::string & v)
     LOG_WARN(nodeName << " set to: " << retV << " instead of: " << v);
     status = false;
   }
+  if (is_pixel_format_node(nodeName)) {
+    updatePixelFormat();
+  }
   return (status);
 }
 
@@ -370,7 +822,22 @@ void CameraDriver::setParameter(
 rcl_interfaces::msg::SetParametersResult CameraDriver::parameterChanged(
   const std::vector<rclcpp::Parameter> & params)
 {
+  rcl_interfaces::msg::SetParametersResult res;
+  res.successful = true;
+  res.reason = "all good!";
   for (const auto & p : params) {
+    if (p.get_name().compare(0, 4, "roi.") == 0) {
+      const std::string msg =
+        (p.get_type() == rclcpp::ParameterType::PARAMETER_INTEGER_ARRAY)
+          ? setRoi(p.get_name().substr(4), p.as_integer_array())
+          : std::string("must be integer array [x, y, width, height]");
+      if (msg != "OK") {
+        LOG_WARN("rejecting " << p.get_name() << ": " << msg);
+        res.successful = false;
+        res.reason = msg;
+      }
+      continue;
+    }
     const auto it = parameterMap_.find(p.get_name());
     if (it == parameterMap_.end()) {
       continue;  // ignore unknown param
@@ -389,12 +856,118 @@ rcl_interfaces::msg::SetParametersResult CameraDriver::parameterChanged(
       LOG_WARN("param " << p.get_name() << " " << e.what());
     }
   }
-  rcl_interfaces::msg::SetParametersResult res;
-  res.successful = true;
-  res.reason = "all good!";
   return (res);
 }
 
+std::string CameraDriver::setRoi(
+  const std::string & name, const std::vector<int64_t> & v)
+{
+  auto it = std::find_if(
+    rois_.begin(), rois_.end(),
+    [&name](const std::unique_ptr<Roi> & r) { return (r->name == name); });
+  if (it == rois_.end()) {
+    return ("unknown roi, must be listed in roi_names");
+  }
+  if (v.size() != 4) {
+    return ("must be integer array [x, y, width, height]");
+  }
+  if (v[0] < 0 || v[1] < 0 || v[2] <= 0 || v[3] <= 0) {
+    return ("invalid geometry");
+  }
+  Roi & roi = **it;
+  {
+    std::unique_lock<std::mutex> lock(roiMutex_);
+    roi.x = static_cast<int>(v[0]);
+    roi.y = static_cast<int>(v[1]);
+    roi.width = static_cast<int>(v[2]);
+    roi.height = static_cast<int>(v[3]);
+  }
+  LOG_INFO(
+    "roi " << name << " at " << v[0] << ", " << v[1] << " size " << v[2]
+           << "x" << v[3]);
+  return ("OK");
+}
+
+void CameraDriver::startExposureControl()
+{
+  if (!exposureControlEnabled_ || exposureControlGroupName_.empty()) {
+    return;
+  }
+  // the group lives as long as one of its cameras uses it
+  exposureControlGroup_ = ExposureControlGroup::get(exposureControlGroupName_);
+  if (!exposureControlMaster_) {
+    exposureFollowerId_ = exposureControlGroup_->addFollower(
+      [this](const ExposureController::Setting & s) {
+        ExposureController::Setting applied;
+        applyExposure(s, &applied);
+      });
+  }
+}
+
+bool CameraDriver::applyExposure(
+  const ExposureController::Setting & s, ExposureController::Setting * applied)
+{
+  // Called for every change of the controller, so unlike setDouble()
+  // it only logs failures. Records what the camera actually accepted.
+  std::unique_lock<std::mutex> lock(exposureMutex_);
+  *applied = s;
+  bool status(true);
+  try {
+    const auto itTime = parameterMap_.find("exposure_time");
+    if (itTime != parameterMap_.end()) {
+      double retV;
+      const std::string msg =
+        driver_->setDouble(itTime->second.name, s.exposureTime, &retV);
+      if (msg != "OK") {
+        LOG_WARN("setting exposure time failed: " << msg);
+        status = false;
+      } else {
+        applied->exposureTime = retV;
+        currentExposureTime_ = static_cast<uint32_t>(retV);
+      }
+    } else {
+      LOG_WARN("no node name defined for exposure_time, check .cfg file!");
+      status = false;
+    }
+    const auto itGain = parameterMap_.find("gain");
+    if (itGain != parameterMap_.end()) {
+      double retV;
+      const std::string msg =
+        driver_->setDouble(itGain->second.name, s.gain, &retV);
+      if (msg != "OK") {
+        LOG_WARN("setting gain failed: " << msg);
+        status = false;
+      } else {
+        applied->gain = retV;
+        currentGain_ = static_cast<float>(retV);
+      }
+    } else {
+      LOG_WARN("no node name defined for gain, check .cfg file!");
+      status = false;
+    }
+  } catch (const flir_spinnaker_common::Driver::DriverException & e) {
+    LOG_WARN("failed to control exposure: " << e.what());
+    status = false;
+  }
+  return (status);
+}
+
+void CameraDriver::updateExposure(const ImageConstPtr & im)
+{
+  ExposureController::Setting next;
+  if (!exposureController_->update(
+        im->brightness_, im->exposureTime_, im->gain_, &next)) {
+    return;
+  }
+  ExposureController::Setting applied;
+  applyExposure(next, &applied);
+  exposureController_->setApplied(applied);
+  if (exposureControlGroup_) {
+    // the followers get what this camera ended up with
+    exposureControlGroup_->apply(applied);
+  }
+}
+
 void CameraDriver::controlCallback(
   const camera_control_msgs_ros2::msg::CameraControl::UniquePtr msg)
 {
@@ -407,6 +980,7 @@ void CameraDriver::controlCallback(
   const float gain = msg->gain;
   bool logTime(false);
   bool logGain(false);
+  std::unique_lock<std::mutex> lock(exposureMutex_);
   try {
     if (et > 0 && et != currentExposureTime_) {
       const auto it = parameterMap_.find("exposure_time");
@@ -444,99 +1018,1344 @@ void CameraDriver::controlCallback(
 
 void CameraDriver::publishImage(const ImageConstPtr & im)
 {
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (imageQueue_.size() < 2) {
-      imageQueue_.push_back(im);
-      cv_.notify_all();
-    } else {
-      droppedCount_++;
-    }
+  // runs on the Spinnaker callback thread: must not block
+  configureAcquisitionThread();
+  QueuedFrame frame{im, chrono::steady_clock::now()};
+  // with LATEST a new frame replaces the waiting one, otherwise the new
+  // frame is dropped if the queue is full
+  const bool queued = latestFrame_ ? latestFrame_->push(std::move(frame))
+                                   : imageRing_->push(std::move(frame));
+  if (!queued) {
+    droppedQueueFullCount_++;
   }
 }
 
+void CameraDriver::publishImageInline(const ImageConstPtr & im)
+{
+  // Runs on the Spinnaker callback thread. Everything spent here delays
+  // the return of the buffer to the SDK, so keep track of it.
+  configureAcquisitionThread();
+  const auto t0 = chrono::steady_clock::now();
+  doPublish(im);
+  callbackTime_.add(chrono::steady_clock::now() - t0);
+}
+
 void CameraDriver::run()
 {
+  applyThreadConfig("publish", publishThreadConfig_);
+  // one second timeout so shutdown is noticed even without a wakeup
+  const chrono::milliseconds timeout(1000);
   while (keepRunning_ && rclcpp::ok()) {
-    {
-      ImageConstPtr img;
-      {  // ------- locked section ---
-        std::unique_lock<std::mutex> lock(mutex_);
-        // one second timeout
-        const std::chrono::microseconds timeout((int64_t)(1000000LL));
-        while (imageQueue_.empty() && keepRunning_ && rclcpp::ok()) {
-          cv_.wait_for(lock, timeout);
-        }
-        if (!imageQueue_.empty()) {
-          img = imageQueue_.back();
-          imageQueue_.pop_back();
+    QueuedFrame frame;
+    const bool popped = latestFrame_ ? latestFrame_->waitPop(&frame, timeout)
+                                     : imageRing_->waitPop(&frame, timeout);
+    if (!popped) {
+      continue;
+    }
+    switch (queuePolicy_) {
+      case MAX_AGE:
+        if (chrono::steady_clock::now() - frame.arrivalTime > maxFrameAge_) {
+          droppedTooOldCount_++;
+          continue;
         }
-      }  // -------- end of locked section
-      if (img && keepRunning_ && rclcpp::ok()) {
-        doPublish(img);
-      }
+        break;
+      case FIFO:
+      default:
+        break;
+    }
+    if (keepRunning_ && rclcpp::ok()) {
+      doPublish(frame.image);
     }
   }
 }
 
-static std::string flir_to_ros_encoding(
+// the few formats the camera library identifies itself
+static const char * library_format_name(
   const flir_spinnaker_common::pixel_format::PixelFormat & pf)
 {
   switch (pf) {
     case flir_spinnaker_common::pixel_format::BayerRG8:
-      return (sensor_msgs::image_encodings::BAYER_RGGB8);
-      break;
+      return ("BayerRG8");
     case flir_spinnaker_common::pixel_format::RGB8:
-      return (sensor_msgs::image_encodings::RGB8);
-      break;
+      return ("RGB8");
     case flir_spinnaker_common::pixel_format::Mono8:
-      return (sensor_msgs::image_encodings::MONO8);
-      break;
+      return ("Mono8");
     case flir_spinnaker_common::pixel_format::INVALID:
     default:
-      return ("INVALID");
+      return (nullptr);
+  }
+}
+
+// bytes per pixel, or 0 for packed and unknown encodings
+static int bytes_per_pixel(const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  try {
+    const int bits = enc::bitDepth(encoding) * enc::numChannels(encoding);
+    return (bits % 8 == 0 ? bits / 8 : 0);
+  } catch (const std::runtime_error &) {
+    return (0);
+  }
+}
+
+const PixelFormatInfo * CameraDriver::findPixelFormat(
+  const ImageConstPtr & im) const
+{
+  const char * name = library_format_name(im->pixelFormat_);
+  const PixelFormatInfo * pf =
+    name ? find_pixel_format(name)
+         : cameraPixelFormat_.load(std::memory_order_acquire);
+  // frames that are still in flight after a format change don't match
+  if (pf && pf->bitsPerPixel != static_cast<int>(im->bitsPerPixel_)) {
+    return (nullptr);
+  }
+  return (pf);
+}
+
+void CameraDriver::updatePixelFormat()
+{
+  const std::string name = driver_->getPixelFormat();
+  const PixelFormatInfo * pf = find_pixel_format(name);
+  if (!pf) {
+    LOG_WARN("unsupported pixel format: " << name);
+  }
+  cameraPixelFormat_.store(pf, std::memory_order_release);
+}
+
+CameraDriver::PooledPtr<sensor_msgs::msg::Image>
+CameraDriver::makeFrameMessage(
+  const ImageConstPtr & im, const std::string & encoding, size_t step)
+{
+  // Pooled messages keep their buffers, so after the first few frames
+  // this neither allocates nor touches the memory.
+  auto msg = makePooled(framePool_, frameAllocator_);
+  msg->header = imageMsg_.header;
+  msg->encoding = encoding;
+  msg->width = im->width_;
+  msg->height = im->height_;
+  msg->step = step;
+  msg->is_bigendian = false;
+  msg->data.resize(step * im->height_);
+  return (msg);
+}
+
+CameraDriver::ImageConstPtr CameraDriver::wrapFrameMessage(
+  const ImageConstPtr & im, const sensor_msgs::msg::Image::SharedPtr & msg,
+  int bitsPerPixel)
+{
+  // the deleter keeps the message alive as long as the image
+  return (ImageConstPtr(
+    new flir_spinnaker_common::Image(
+      im->time_, im->brightness_, im->exposureTime_, im->maxExposureTime_,
+      im->gain_, im->imageTime_, msg->data.size(), im->imageStatus_,
+      &msg->data[0], msg->width, msg->height, msg->step, bitsPerPixel,
+      im->numChan_, im->frameId_, im->pixelFormat_),
+    [msg](const flir_spinnaker_common::Image * p) { delete p; }));
+}
+
+CameraDriver::PooledPtr<sensor_msgs::msg::Image> CameraDriver::convertFrame(
+  const ImageConstPtr & im, const std::string & encoding, Packing packing,
+  const FlatField * flatField, size_t step)
+{
+  auto msg = makeFrameMessage(im, encoding, step);
+  uint8_t * dst = &msg->data[0];
+  const auto t0 = chrono::steady_clock::now();
+  const int width = im->width_;
+  const int height = im->height_;
+  const uint8_t * src = static_cast<const uint8_t *>(im->data_);
+  const size_t srcStep = im->stride_;
+  auto convert = [&](int rowBegin, int rowEnd) {
+    uint8_t * rows = dst + rowBegin * step;
+    if (packing == PACKING_NONE) {
+      flatField->correctRows(
+        src + rowBegin * srcStep, srcStep, rows, step, rowBegin, rowEnd);
+      return;
+    }
+    unpack12_rows(src, srcStep, width, packing, rows, step, rowBegin, rowEnd);
+    if (flatField) {
+      // while the rows are still in the cache
+      flatField->correctRows(rows, step, rows, step, rowBegin, rowEnd);
+    }
+  };
+  if (workerPool_) {
+    workerPool_->parallelFor(height, 64, convert);
+  } else {
+    convert(0, height);
+  }
+  if (flatField) {
+    flatFieldTime_.add(chrono::steady_clock::now() - t0);
+  }
+  return (msg);
+}
+
+std::shared_ptr<const FlatField> CameraDriver::findFlatField(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  std::shared_ptr<const FlatField> ff = std::atomic_load(&flatField_);
+  if (!ff) {
+    return (nullptr);
+  }
+  const int bytesPerPixel = bytes_per_pixel(encoding);
+  if (
+    bytesPerPixel != ff->getBytesPerPixel() ||
+    static_cast<int>(im->width_) != ff->getWidth() ||
+    static_cast<int>(im->height_) != ff->getHeight() ||
+    !(enc::isMono(encoding) || enc::isBayer(encoding))) {
+    if (!flatFieldMismatch_) {
+      LOG_WARN(
+        "dark frame/flat field do not match " << encoding << " images of size "
+                                              << im->width_ << "x"
+                                              << im->height_);
+      flatFieldMismatch_ = true;
+    }
+    return (nullptr);
+  }
+  return (ff);
+}
+
+void CameraDriver::loadReferences()
+{
+  std::unique_lock<std::mutex> lock(referenceMutex_);
+  if (!darkFrameFile_.empty()) {
+    const std::string msg = read_pgm(darkFrameFile_, &darkFrame_);
+    if (msg == "OK") {
+      LOG_INFO("loaded dark frame from " << darkFrameFile_);
+    } else {
+      darkFrame_ = ReferenceImage();
+      LOG_WARN("no dark frame: " << msg);
+    }
+  }
+  if (!flatFieldFile_.empty()) {
+    const std::string msg = read_pgm(flatFieldFile_, &flatFrame_);
+    if (msg == "OK") {
+      LOG_INFO("loaded flat field from " << flatFieldFile_);
+    } else {
+      flatFrame_ = ReferenceImage();
+      LOG_WARN("no flat field: " << msg);
+    }
+  }
+  updateFlatField();
+}
+
+// must hold the reference mutex
+void CameraDriver::updateFlatField()
+{
+  std::shared_ptr<FlatField> ff;
+  if (!darkFrame_.empty() || !flatFrame_.empty()) {
+    ff = std::make_shared<FlatField>();
+    const std::string msg = ff->init(darkFrame_, flatFrame_);
+    if (msg == "OK") {
+      LOG_INFO(
+        "correcting images with" << (darkFrame_.empty() ? "" : " dark frame")
+                                 << (flatFrame_.empty() ? "" : " flat field"));
+    } else {
+      LOG_WARN("not correcting images: " << msg);
+      ff.reset();
+    }
+  }
+  flatFieldMismatch_ = false;
+  std::atomic_store(&flatField_, std::shared_ptr<const FlatField>(ff));
+}
+
+void CameraDriver::captureReference(
+  bool dark, const std::shared_ptr<std_srvs::srv::Trigger::Request>,
+  std::shared_ptr<std_srvs::srv::Trigger::Response> res)
+{
+  std::unique_lock<std::mutex> lock(referenceMutex_);
+  if (capture_) {
+    res->success = false;
+    res->message = "capture already in progress";
+    return;
+  }
+  capture_ = std::make_unique<ReferenceCapture>();
+  capture_->dark = dark;
+  capture_->numFrames = referenceFrames_;
+  capturing_.store(true);
+  res->success = true;
+  res->message = "capturing " + std::to_string(referenceFrames_) +
+                 (dark ? " frames for the dark frame"
+                       : " frames for the flat field");
+  LOG_INFO(res->message);
+}
+
+void CameraDriver::accumulateReference(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  std::unique_lock<std::mutex> lock(referenceMutex_);
+  ReferenceCapture * c = capture_.get();
+  if (!c) {
+    return;
+  }
+  const int bytesPerPixel = bytes_per_pixel(encoding);
+  if (
+    (bytesPerPixel != 1 && bytesPerPixel != 2) ||
+    !(enc::isMono(encoding) || enc::isBayer(encoding))) {
+    LOG_WARN("cannot capture references from " << encoding << " images!");
+    capture_.reset();
+    capturing_.store(false);
+    return;
+  }
+  ReferenceImage & ref = c->image;
+  const int width = im->width_;
+  const int height = im->height_;
+  if (
+    c->count == 0 || width != ref.width || height != ref.height ||
+    bytesPerPixel != ref.bytesPerPixel) {
+    if (c->count != 0) {
+      LOG_WARN("frame size changed, restarting reference capture");
+    }
+    c->count = 0;
+    ref.width = width;
+    ref.height = height;
+    ref.bytesPerPixel = bytesPerPixel;
+    c->sum.assign(static_cast<size_t>(width) * height, 0);
+  }
+  const uint8_t * src = static_cast<const uint8_t *>(im->data_);
+  for (int y = 0; y < height; y++) {
+    const uint8_t * row = src + y * im->stride_;
+    uint32_t * sum = &c->sum[y * width];
+    if (bytesPerPixel == 1) {
+      for (int x = 0; x < width; x++) {
+        sum[x] += row[x];
+      }
+    } else {
+      const uint16_t * row16 = reinterpret_cast<const uint16_t *>(row);
+      for (int x = 0; x < width; x++) {
+        sum[x] += row16[x];
+      }
+    }
+  }
+  if (++c->count < c->numFrames) {
+    return;
+  }
+  ref.data.resize(c->sum.size());
+  for (size_t i = 0; i < c->sum.size(); i++) {
+    ref.data[i] = (c->sum[i] + c->count / 2) / c->count;
+  }
+  const std::string & file = c->dark ? darkFrameFile_ : flatFieldFile_;
+  const char * name = c->dark ? "dark frame" : "flat field";
+  if (file.empty()) {
+    LOG_INFO("captured " << name << ", not saved since no file is given");
+  } else {
+    // happens once per capture, so the publishing thread can afford it
+    const std::string msg = write_pgm(file, ref);
+    if (msg == "OK") {
+      LOG_INFO("saved " << name << " to " << file);
+    } else {
+      LOG_WARN("cannot save " << name << ": " << msg);
+    }
   }
+  (c->dark ? darkFrame_ : flatFrame_) = std::move(ref);
+  capture_.reset();
+  capturing_.store(false);
+  updateFlatField();
 }
 
-void CameraDriver::doPublish(const ImageConstPtr & im)
+void CameraDriver::doPublish(const ImageConstPtr & frame)
 {
-  // todo: honor the encoding in the image
-  const rclcpp::Time t(im->imageTime_);
+  const rclcpp::Time t(frame->imageTime_);
   // const auto t = now();
   imageMsg_.header.stamp = t;
-  cameraInfoMsg_.header.stamp = t;
-
-  const std::string encoding = flir_to_ros_encoding(im->pixelFormat_);
-
-  if (count_subscribers(pub_.getTopic()) > 0) {
-    sensor_msgs::msg::CameraInfo::UniquePtr cinfo(
-      new sensor_msgs::msg::CameraInfo(cameraInfoMsg_));
-    // will make deep copy. Do we need to? Probably...
-    sensor_msgs::msg::Image::UniquePtr img(
-      new sensor_msgs::msg::Image(imageMsg_));
-    bool ret = sensor_msgs::fillImage(
-      *img, encoding, im->height_, im->width_, im->stride_, im->data_);
-    if (!ret) {
-      LOG_ERROR("fill image failed!");
-    } else {
-      // const auto t0 = this->now();
-      pub_.publish(std::move(img), std::move(cinfo));
-      // const auto t1 = this->now();
-      // std::cout << "dt: " << (t1 - t0).nanoseconds() * 1e-9 << std::endl;
+
+  std::string encoding = "INVALID";
+  const PixelFormatInfo * pf = findPixelFormat(frame);
+  const bool unpack =
+    pf && pf->packing != PACKING_NONE && unpackPackedFormats_;
+  if (pf) {
+    encoding = (pf->packing == PACKING_NONE || unpack) ? pf->encoding
+                                                       : pf->packedEncoding;
+  }
+  // Decide first which outputs take this frame, so frames that are
+  // rate limited (or unchanged) on all of them are neither unpacked nor
+  // copied.
+  auto stageSubscribed = [](bool enabled, const OutputStage & stage) {
+    return (
+      enabled && stage.numSubscribers.load(std::memory_order_relaxed) > 0);
+  };
+  const bool rawSubscribed =
+    numImageSubscribers_.load(std::memory_order_relaxed) > 0;
+  const bool colorSubscribed = stageSubscribed(demosaicEnabled_, colorStage_);
+  const bool pyramidSubscribed =
+    stageSubscribed(pyramidLevels_ > 0, pyramidStage_);
+  const bool polarizationSubscribed = stageSubscribed(
+    polarizationEnabled_ && pf && pf->polarized, polarizationStage_);
+  const bool yuvSubscribed = stageSubscribed(yuvEnabled_, yuvStage_);
+  const bool rectifySubscribed =
+    stageSubscribed(rectifyEnabled_, rectifyStage_);
+  const bool jpegSubscribed = stageSubscribed(jpegEnabled_, jpegStage_);
+  const bool zstdSubscribed = stageSubscribed(zstdEnabled_, zstdStage_);
+  bool roiSubscribed = false;
+  for (const auto & roi : rois_) {
+    roiSubscribed |= roi->numSubscribers.load(std::memory_order_relaxed) > 0;
+  }
+  const int64_t stamp = t.nanoseconds();
+  // only the image outputs are gated, not meta, statistics and focus
+  const bool changed =
+    !changeDetection_ ||
+    !(rawSubscribed || colorSubscribed || pyramidSubscribed ||
+      polarizationSubscribed || yuvSubscribed || rectifySubscribed ||
+      jpegSubscribed || zstdSubscribed || roiSubscribed) ||
+    frameChanged(frame, pf, stamp);
+  auto wanted = [stamp](bool subscribed, RateLimiter * limiter) {
+    return (subscribed && limiter->pass(stamp));
+  };
+  const bool sendRaw = wanted(changed && rawSubscribed, &rawRate_);
+  const bool sendColor =
+    wanted(changed && colorSubscribed, &colorStage_.rate);
+  const bool sendPyramid =
+    wanted(changed && pyramidSubscribed, &pyramidStage_.rate);
+  const bool sendPolarization =
+    wanted(changed && polarizationSubscribed, &polarizationStage_.rate);
+  const bool sendYuv = wanted(changed && yuvSubscribed, &yuvStage_.rate);
+  const bool sendRectified =
+    wanted(changed && rectifySubscribed, &rectifyStage_.rate);
+  const bool sendJpeg = wanted(changed && jpegSubscribed, &jpegStage_.rate);
+  const bool sendZstd = wanted(changed && zstdSubscribed, &zstdStage_.rate);
+  const bool sendRois = wanted(changed && roiSubscribed, &roiRate_);
+  if (
+    changeDetection_ &&
+    (sendRaw || sendColor || sendPyramid || sendPolarization || sendYuv ||
+     sendRectified || sendJpeg || sendZstd || sendRois)) {
+    // later frames are compared against this one
+    changeDetector_.accept();
+    lastChangePublished_ = stamp;
+    changePublished_++;
+  }
+  const bool sendStatistics = wanted(
+    statisticsEnabled_ &&
+      numStatisticsSubscribers_.load(std::memory_order_relaxed) != 0,
+    &statisticsRate_);
+  const bool sendFocus = wanted(
+    focusEnabled_ && numFocusSubscribers_.load(std::memory_order_relaxed) != 0,
+    &focusRate_);
+  const bool sendMeta = wanted(
+    numMetaSubscribers_.load(std::memory_order_relaxed) != 0, &metaRate_);
+  // references are captured from uncorrected frames
+  const bool capturing = capturing_.load(std::memory_order_relaxed);
+  const bool needOtherImage = sendColor || sendPyramid || sendPolarization ||
+                              sendYuv || sendRectified || sendJpeg ||
+                              sendZstd || sendRois || sendStatistics ||
+                              sendFocus || capturing;
+  const bool needImage = sendRaw || needOtherImage;
+
+  ImageConstPtr im = frame;
+  // An unpacked or corrected image goes to the raw publisher without a
+  // copy if no other output reads it. Otherwise it is shared, and im
+  // points into it.
+  PooledPtr<sensor_msgs::msg::Image> convertedMsg;
+  sensor_msgs::msg::Image::SharedPtr converted;
+  const std::shared_ptr<const FlatField> flatField =
+    needImage && !capturing ? findFlatField(frame, encoding) : nullptr;
+  if (needImage && (unpack || flatField)) {
+    // all outputs see the unpacked and corrected image
+    const Packing packing = unpack ? pf->packing : PACKING_NONE;
+    const size_t step = unpack ? 2 * frame->width_
+                               : frame->width_ * flatField->getBytesPerPixel();
+    convertedMsg =
+      convertFrame(frame, encoding, packing, flatField.get(), step);
+    if (needOtherImage || !directPublishing_) {
+      converted = std::move(convertedMsg);
+      im = wrapFrameMessage(
+        frame, converted,
+        unpack ? 16 : static_cast<int>(frame->bitsPerPixel_));
+    }
+  }
+  if (capturing) {
+    accumulateReference(im, encoding);
+  }
+  if (exposureController_) {
+    // as early as possible, the next frames are already exposing
+    updateExposure(frame);
+  }
+
+  if (sendRaw && directPublishing_) {
+    publishDirect(im, encoding, std::move(convertedMsg));
+  } else if (sendRaw) {
+    const sensor_msgs::msg::CameraInfo::SharedPtr cinfo =
+      makeSharedCameraInfo(&cameraInfoRing_);
+    if (converted) {
+      // unpacking or correction already wrote the image into a message
+      pub_.publish(converted, cinfo);
       publishedCount_++;
+    } else {
+      // The camera's buffer goes back to the SDK, so it is copied, but
+      // into a recycled message that keeps its buffer.
+      uint64_t * tag;
+      const sensor_msgs::msg::Image::SharedPtr img =
+        rawImageRing_.acquire(&tag);
+      img->header = imageMsg_.header;
+      bool ret = fillImageMsg(img.get(), encoding, im);
+      if (!ret) {
+        LOG_ERROR("fill image failed!");
+      } else {
+        pub_.publish(img, cinfo);
+        publishedCount_++;
+      }
     }
   }
-  if (metaPub_->get_subscription_count() != 0) {
+  if (sendColor) {
+    publishColor(im, encoding);
+  }
+  if (sendPyramid) {
+    publishPyramid(im, encoding);
+  }
+  if (sendPolarization) {
+    publishPolarization(im, encoding);
+  }
+  if (sendYuv) {
+    publishYuv(im, encoding);
+  }
+  if (sendRectified) {
+    publishRectified(im, encoding);
+  }
+  if (sendJpeg) {
+    publishJpeg(im, encoding);
+  }
+  if (sendZstd) {
+    publishZstd(im, encoding);
+  }
+  if (sendRois) {
+    publishRois(im, encoding);
+  }
+  if (sendStatistics) {
+    // the unpacked formats do not use all 16 bits
+    publishStatistics(im, encoding, unpack ? pf->bitsPerPixel : 0);
+  }
+  if (sendFocus) {
+    publishFocus(im, encoding, unpack ? pf->bitsPerPixel : 0);
+  }
+  if (sendMeta) {
     metaMsg_.header.stamp = t;
-    metaMsg_.brightness = im->brightness_;
-    metaMsg_.exposure_time = im->exposureTime_;
-    metaMsg_.max_exposure_time = im->maxExposureTime_;
-    metaMsg_.gain = im->gain_;
-    metaMsg_.camera_time = im->imageTime_;
+    metaMsg_.brightness = frame->brightness_;
+    metaMsg_.exposure_time = frame->exposureTime_;
+    metaMsg_.max_exposure_time = frame->maxExposureTime_;
+    metaMsg_.gain = frame->gain_;
+    metaMsg_.camera_time = frame->imageTime_;
     metaPub_->publish(metaMsg_);
   }
 }
 
+bool CameraDriver::frameChanged(
+  const ImageConstPtr & frame, const PixelFormatInfo * pf, int64_t stamp)
+{
+  changeFrames_++;
+  namespace enc = sensor_msgs::image_encodings;
+  if (!pf) {
+    return (true);  // cannot tell
+  }
+  const auto t0 = chrono::steady_clock::now();
+  const int bits = pf->packing != PACKING_NONE ? pf->bitsPerPixel
+                                               : enc::bitDepth(pf->encoding);
+  const double f = changeDetector_.compare(
+    static_cast<const uint8_t *>(frame->data_), frame->stride_, frame->width_,
+    frame->height_, enc::numChannels(pf->encoding), bits, pf->packing);
+  changeTime_.add(chrono::steady_clock::now() - t0);
+  // compared even for keepalive frames, they become the reference too
+  const bool keepalive =
+    changeKeepalive_ > 0 && stamp - lastChangePublished_ >= changeKeepalive_;
+  return (f > changeThreshold_ || keepalive);
+}
+
+void CameraDriver::publishStatistics(
+  const ImageConstPtr & im, const std::string & encoding, int bits)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  const int bytesPerPixel = bytes_per_pixel(encoding);
+  if (bytesPerPixel == 0) {
+    return;  // unknown or packed format
+  }
+  const bool bayer = enc::isBayer(encoding);
+  const int channels = enc::numChannels(encoding);
+  if (!bayer && channels != 1 && channels != 3) {
+    return;
+  }
+  if (bits == 0) {
+    bits = enc::bitDepth(encoding);
+  }
+  const auto t0 = chrono::steady_clock::now();
+  ImageStatistics empty;
+  empty.reset(
+    statisticsConfig_, im->width_, im->height_, channels, bayer, bits);
+  ImageStatistics total = empty;
+  std::mutex mutex;
+  const uint8_t * src = static_cast<const uint8_t *>(im->data_);
+  auto accumulate = [&](int rowBegin, int rowEnd) {
+    ImageStatistics part = empty;
+    part.accumulate(src, im->stride_, rowBegin, rowEnd);
+    std::unique_lock<std::mutex> lock(mutex);
+    total.merge(part);
+  };
+  if (workerPool_) {
+    workerPool_->parallelFor(im->height_, 64, accumulate);
+  } else {
+    total.accumulate(src, im->stride_, 0, im->height_);
+  }
+  msg::ImageStatistics::UniquePtr msg(new msg::ImageStatistics());
+  msg->header = imageMsg_.header;
+  msg->subsample = statisticsConfig_.subsample;
+  msg->bits = total.getBits();
+  msg->histogram = total.getHistogram();
+  msg->channel_means = total.getChannelMeans();
+  msg->saturated_fraction = total.getSaturatedFraction();
+  msg->black_fraction = total.getBlackFraction();
+  msg->grid_rows = statisticsConfig_.gridRows;
+  msg->grid_cols = statisticsConfig_.gridCols;
+  msg->grid_means = total.getGridMeans();
+  statisticsTime_.add(chrono::steady_clock::now() - t0);
+  statisticsPub_->publish(std::move(msg));
+}
+
+void CameraDriver::publishFocus(
+  const ImageConstPtr & im, const std::string & encoding, int bits)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  const int bytesPerPixel = bytes_per_pixel(encoding);
+  if (bytesPerPixel == 0) {
+    return;  // unknown or packed format
+  }
+  const bool bayer = enc::isBayer(encoding);
+  const int channels = enc::numChannels(encoding);
+  if (!bayer && channels != 1 && channels != 3) {
+    return;
+  }
+  if (bits == 0) {
+    bits = enc::bitDepth(encoding);
+  }
+  // on the publishing thread, it is cheap enough
+  const auto t0 = chrono::steady_clock::now();
+  FocusResult res;
+  if (!compute_focus(
+        focusConfig_, static_cast<const uint8_t *>(im->data_), im->stride_,
+        im->width_, im->height_, channels, bayer, bits, &res)) {
+    return;
+  }
+  msg::FocusMetric::UniquePtr msg(new msg::FocusMetric());
+  msg->header = imageMsg_.header;
+  msg->x_offset = res.x;
+  msg->y_offset = res.y;
+  msg->width = res.width;
+  msg->height = res.height;
+  msg->stride = focusConfig_.stride;
+  msg->bits = bits;
+  msg->laplacian_variance = res.laplacianVariance;
+  msg->mean = res.mean;
+  focusTime_.add(chrono::steady_clock::now() - t0);
+  focusPub_->publish(std::move(msg));
+}
+
+static bool bayer_pattern(const std::string & encoding, BayerPattern * p)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  if (encoding == enc::BAYER_RGGB8) {
+    *p = RGGB;
+  } else if (encoding == enc::BAYER_GRBG8) {
+    *p = GRBG;
+  } else if (encoding == enc::BAYER_GBRG8) {
+    *p = GBRG;
+  } else if (encoding == enc::BAYER_BGGR8) {
+    *p = BGGR;
+  } else {
+    return (false);
+  }
+  return (true);
+}
+
+bool CameraDriver::submitToStage(OutputStage * stage, WorkerPool::Job job)
+{
+  // Never queue up frames for a stage: if it already has the maximum
+  // number in progress, it cannot keep up and this frame is dropped.
+  if (
+    stage->inFlight.fetch_add(1, std::memory_order_acquire) >=
+    stage->maxInFlight) {
+    stage->inFlight.fetch_sub(1, std::memory_order_release);
+    stage->dropped++;
+    return (false);
+  }
+  const bool submitted = workerPool_->submit([stage, job]() {
+    const auto t0 = chrono::steady_clock::now();
+    job();
+    stage->time.add(chrono::steady_clock::now() - t0);
+    stage->inFlight.fetch_sub(1, std::memory_order_release);
+  });
+  if (!submitted) {
+    stage->inFlight.fetch_sub(1, std::memory_order_release);
+    stage->dropped++;
+  }
+  return (submitted);
+}
+
+void CameraDriver::publishColor(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  BayerPattern pattern;
+  if (!bayer_pattern(encoding, &pattern)) {
+    return;  // not a bayer image, nothing to demosaic
+  }
+  // the job holds on to the frame, so its data stays valid
+  const std_msgs::msg::Header header = imageMsg_.header;
+  submitToStage(&colorStage_, [this, im, header, pattern]() {
+    sensor_msgs::msg::Image::UniquePtr img(new sensor_msgs::msg::Image());
+    img->header = header;
+    img->height = im->height_;
+    img->width = im->width_;
+    img->encoding = colorEncoding_;
+    img->step = 3 * im->width_;
+    img->data.resize(img->step * img->height);
+    const bool bgr = (colorEncoding_ == sensor_msgs::image_encodings::BGR8);
+    const uint8_t * src = static_cast<const uint8_t *>(im->data_);
+    uint8_t * dst = &img->data[0];
+    const int width = im->width_;
+    const int height = im->height_;
+    const size_t srcStep = im->stride_;
+    const size_t dstStep = img->step;
+    workerPool_->parallelFor(
+      height, 64, [&](int rowBegin, int rowEnd) {
+        demosaic_rows(
+          src, srcStep, width, height, pattern, demosaicMethod_, bgr,
+          dst + rowBegin * dstStep, dstStep, rowBegin, rowEnd);
+      });
+    colorPub_.publish(std::move(img));
+  });
+}
+
+void CameraDriver::publishPyramid(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  BayerPattern pattern;
+  const bool bayer = bayer_pattern(encoding, &pattern);
+  int bytesPerPixel = 1;
+  if (encoding == enc::RGB8 || encoding == enc::BGR8) {
+    bytesPerPixel = 3;
+  } else if (encoding != enc::MONO8 && !bayer) {
+    return;  // unsupported encoding
+  }
+  const std_msgs::msg::Header header = imageMsg_.header;
+  submitToStage(
+    &pyramidStage_, [this, im, header, encoding, bayer, bytesPerPixel]() {
+      // every level is computed from the previous one, up to the
+      // highest one that has subscribers
+      const uint32_t wanted = pyramidSubscribed_.load();
+      std::vector<sensor_msgs::msg::Image::UniquePtr> levels;
+      const uint8_t * src = static_cast<const uint8_t *>(im->data_);
+      size_t srcStep = im->stride_;
+      int width = im->width_;
+      int height = im->height_;
+      for (int level = 0; level < pyramidLevels_ && (wanted >> level) != 0;
+           level++) {
+        sensor_msgs::msg::Image::UniquePtr img(new sensor_msgs::msg::Image());
+        int w, h;
+        bin2x2_size(width, height, bayer, &w, &h);
+        if (w == 0 || h == 0) {
+          break;
+        }
+        img->header = header;
+        img->encoding = encoding;
+        img->width = w;
+        img->height = h;
+        img->step = w * bytesPerPixel;
+        img->data.resize(img->step * h);
+        uint8_t * dst = &img->data[0];
+        const size_t dstStep = img->step;
+        workerPool_->parallelFor(h, 64, [&](int rowBegin, int rowEnd) {
+          bin2x2_rows(
+            src, srcStep, width, height, bytesPerPixel, bayer,
+            dst + rowBegin * dstStep, dstStep, rowBegin, rowEnd);
+        });
+        src = dst;
+        srcStep = dstStep;
+        width = w;
+        height = h;
+        levels.push_back(std::move(img));
+      }
+      for (size_t i = 0; i < levels.size(); i++) {
+        if (wanted & (1U << i)) {
+          pyramidPubs_[i].publish(std::move(levels[i]));
+        }
+      }
+    });
+}
+
+void CameraDriver::publishPolarization(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  int bytesPerValue = 1;
+  if (encoding == enc::MONO16) {
+    bytesPerValue = 2;
+  } else if (encoding != enc::MONO8) {
+    return;  // unsupported encoding
+  }
+  const std_msgs::msg::Header header = imageMsg_.header;
+  submitToStage(
+    &polarizationStage_, [this, im, header, encoding, bytesPerValue]() {
+      // only the outputs with subscribers are computed
+      const uint32_t wanted = polarizationSubscribed_.load();
+      const int w = im->width_ / 2;
+      const int h = im->height_ / 2;
+      if (w == 0 || h == 0) {
+        return;
+      }
+      sensor_msgs::msg::Image::UniquePtr imgs[POL_NUM_OUTPUTS];
+      uint8_t * dst[POL_NUM_OUTPUTS];
+      for (int i = 0; i < POL_NUM_OUTPUTS; i++) {
+        dst[i] = nullptr;
+        if (!(wanted & (1U << i))) {
+          continue;
+        }
+        const bool angle = (i != POL_DOLP && i != POL_AOLP);
+        imgs[i].reset(new sensor_msgs::msg::Image());
+        imgs[i]->header = header;
+        imgs[i]->encoding = angle ? encoding : enc::MONO8;
+        imgs[i]->width = w;
+        imgs[i]->height = h;
+        imgs[i]->step = w * (angle ? bytesPerValue : 1);
+        imgs[i]->data.resize(imgs[i]->step * h);
+        dst[i] = &imgs[i]->data[0];
+      }
+      const uint8_t * src = static_cast<const uint8_t *>(im->data_);
+      const size_t srcStep = im->stride_;
+      workerPool_->parallelFor(h, 32, [&](int rowBegin, int rowEnd) {
+        polarization_rows(
+          src, srcStep, 2 * w, bytesPerValue, dst, rowBegin, rowEnd);
+      });
+      for (int i = 0; i < POL_NUM_OUTPUTS; i++) {
+        if (imgs[i]) {
+          polarizationPubs_[i].publish(std::move(imgs[i]));
+        }
+      }
+    });
+}
+
+void CameraDriver::publishYuv(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  BayerPattern pattern;
+  const bool bayer = bayer_pattern(encoding, &pattern);
+  int channels = 3;
+  if (encoding == enc::MONO8) {
+    channels = 1;
+  } else if (encoding != enc::RGB8 && encoding != enc::BGR8 && !bayer) {
+    return;  // unsupported encoding
+  }
+  // chroma is subsampled in 2x2 (nv12) or 2x1 (yuv422) blocks
+  if (im->width_ % 2 != 0 || (yuvFormat_ == YUV_NV12 && im->height_ % 2 != 0)) {
+    return;
+  }
+  const std_msgs::msg::Header header = imageMsg_.header;
+  submitToStage(
+    &yuvStage_, [this, im, header, encoding, bayer, pattern, channels]() {
+      const int width = im->width_;
+      const int height = im->height_;
+      sensor_msgs::msg::Image::UniquePtr img(new sensor_msgs::msg::Image());
+      img->header = header;
+      img->height = height;
+      img->width = width;
+      img->encoding = yuv_encoding(yuvFormat_);
+      img->step = yuv_step(width, yuvFormat_);
+      img->data.resize(yuv_size(width, height, yuvFormat_));
+      const uint8_t * src = static_cast<const uint8_t *>(im->data_);
+      const size_t srcStep = im->stride_;
+      const bool bgr = (encoding == enc::BGR8);
+      uint8_t * dst = &img->data[0];
+      // chunks must start on even rows for nv12
+      workerPool_->parallelFor(height, 32, [&](int rowBegin, int rowEnd) {
+        if (!bayer) {
+          yuv_from_rows(
+            src + rowBegin * srcStep, srcStep, width, height, channels, bgr,
+            yuvMatrix_, yuvFormat_, dst, rowBegin, rowEnd);
+          return;
+        }
+        // demosaic only the rows of this chunk
+        thread_local std::vector<uint8_t> band;
+        const size_t bandStep = 3 * width;
+        band.resize(bandStep * (rowEnd - rowBegin));
+        demosaic_rows(
+          src, srcStep, width, height, pattern, demosaicMethod_, false,
+          &band[0], bandStep, rowBegin, rowEnd);
+        yuv_from_rows(
+          &band[0], bandStep, width, height, 3, false, yuvMatrix_, yuvFormat_,
+          dst, rowBegin, rowEnd);
+      });
+      yuvPub_.publish(std::move(img));
+    });
+}
+
+bool CameraDriver::updateRectifyMap(int width, int height)
+{
+  // The map only changes with the calibration (or the image size), so
+  // it is rebuilt here rather than by the thread that updates the
+  // camera info, and only if someone wants rectified images. Failures
+  // are remembered as well, so they are reported only once.
+  const uint64_t version = cameraInfoVersion_.load(std::memory_order_acquire);
+  if (
+    version == rectifyMapVersion_ && width == rectifyMapWidth_ &&
+    height == rectifyMapHeight_) {
+    return (rectifyMapValid_);
+  }
+  rectifyMapVersion_ = version;
+  rectifyMapWidth_ = width;
+  rectifyMapHeight_ = height;
+  rectifyMapValid_ = false;
+  const auto ci = std::atomic_load(&cameraInfo_);
+  std::string ret;
+  if (
+    ci->width != 0 && (static_cast<int>(ci->width) != width ||
+                       static_cast<int>(ci->height) != height)) {
+    ret = "calibration is for " + std::to_string(ci->width) + "x" +
+          std::to_string(ci->height) + " images";
+  } else {
+    ret = rectifyMap_.init(
+      ci->distortion_model, ci->k.data(), ci->d, ci->r.data(), ci->p.data(),
+      width, height);
+  }
+  if (ret != "OK") {
+    LOG_WARN("cannot rectify: " << ret);
+    return (false);
+  }
+  const auto t0 = chrono::steady_clock::now();
+  workerPool_->parallelFor(height, 32, [this](int rowBegin, int rowEnd) {
+    rectifyMap_.buildRows(rowBegin, rowEnd);
+  });
+  const chrono::duration<double, std::milli> dt =
+    chrono::steady_clock::now() - t0;
+  LOG_INFO("built rectification map in " << dt.count() << "ms");
+  rectifyMapValid_ = true;
+  return (true);
+}
+
+void CameraDriver::publishRectified(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  BayerPattern pattern;
+  const bool bayer = bayer_pattern(encoding, &pattern);
+  int channels = 3;
+  if (encoding == enc::MONO8) {
+    channels = 1;
+  } else if (encoding != enc::RGB8 && encoding != enc::BGR8 && !bayer) {
+    if (encoding != rectifyBadEncoding_) {
+      LOG_WARN(
+        "cannot rectify " << encoding << " images, only 8 bit mono, "
+                          << "rgb/bgr and Bayer");
+      rectifyBadEncoding_ = encoding;
+    }
+    return;
+  }
+  const std_msgs::msg::Header header = imageMsg_.header;
+  submitToStage(
+    &rectifyStage_, [this, im, header, encoding, bayer, pattern, channels]() {
+      const int width = im->width_;
+      const int height = im->height_;
+      if (!updateRectifyMap(width, height)) {
+        return;
+      }
+      const uint8_t * src = static_cast<const uint8_t *>(im->data_);
+      size_t srcStep = im->stride_;
+      if (bayer) {
+        // the remap reads arbitrary source rows, so demosaic all first
+        const size_t colorStep = 3 * width;
+        rectifyColor_.resize(colorStep * height);
+        uint8_t * color = &rectifyColor_[0];
+        const bool bgr = (colorEncoding_ == enc::BGR8);
+        workerPool_->parallelFor(height, 64, [&](int rowBegin, int rowEnd) {
+          demosaic_rows(
+            src, srcStep, width, height, pattern, demosaicMethod_, bgr,
+            color + rowBegin * colorStep, colorStep, rowBegin, rowEnd);
+        });
+        src = color;
+        srcStep = colorStep;
+      }
+      sensor_msgs::msg::Image::UniquePtr img(new sensor_msgs::msg::Image());
+      img->header = header;
+      img->height = height;
+      img->width = width;
+      img->encoding = bayer ? colorEncoding_ : encoding;
+      img->step = channels * width;
+      img->data.resize(img->step * height);
+      uint8_t * dst = &img->data[0];
+      const size_t dstStep = img->step;
+      workerPool_->parallelFor(height, 32, [&](int rowBegin, int rowEnd) {
+        rectifyMap_.remapRows(
+          src, srcStep, channels, dst + rowBegin * dstStep, dstStep,
+          rowBegin, rowEnd);
+      });
+      rectifyPub_.publish(std::move(img));
+    });
+}
+
+void CameraDriver::publishJpeg(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  JpegEncoder::Input in;
+  if (encoding == enc::MONO8) {
+    in.type = JpegEncoder::MONO;
+  } else if (encoding == enc::RGB8) {
+    in.type = JpegEncoder::RGB;
+  } else if (encoding == enc::BGR8) {
+    in.type = JpegEncoder::BGR;
+  } else if (bayer_pattern(encoding, &in.pattern)) {
+    in.type = JpegEncoder::BAYER;
+  } else {
+    return;  // unsupported encoding
+  }
+  // encode straight from the camera buffer, which the job keeps alive
+  in.data = static_cast<const uint8_t *>(im->data_);
+  in.step = im->stride_;
+  in.width = im->width_;
+  in.height = im->height_;
+  const bool gray =
+    (in.type == JpegEncoder::MONO || jpegSubsampling_ == JpegEncoder::GRAY);
+  // format as expected by the compressed image_transport plugin
+  const std::string decoded =
+    gray ? enc::MONO8
+         : (in.type == JpegEncoder::BAYER ? enc::RGB8 : encoding);
+  const std::string format =
+    decoded + "; jpeg compressed " + (gray ? enc::MONO8 : enc::BGR8);
+  const std_msgs::msg::Header header = imageMsg_.header;
+  const uint64_t seq = jpegOrder_->nextSequence();
+  const bool submitted =
+    submitToStage(&jpegStage_, [this, im, in, header, format, seq]() {
+      // libjpeg state is not thread safe, so each worker has its own
+      thread_local JpegEncoder encoder;
+      sensor_msgs::msg::CompressedImage::UniquePtr msg(
+        new sensor_msgs::msg::CompressedImage());
+      msg->header = header;
+      msg->format = format;
+      const std::string ret =
+        encoder.encode(in, jpegQuality_, jpegSubsampling_, &msg->data);
+      if (ret == "OK") {
+        jpegBytes_ += msg->data.size();
+      } else {
+        LOG_WARN(ret);
+        msg.reset();
+      }
+      jpegOrder_->finish(seq, std::move(msg));
+    });
+  if (!submitted) {
+    jpegOrder_->finish(seq, nullptr);
+  }
+}
+
+void CameraDriver::publishZstd(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  const int bytesPerPixel = bytes_per_pixel(encoding);
+  if (bytesPerPixel == 0) {
+    return;  // unknown or packed format
+  }
+  RawCompressor::Input in;
+  in.data = static_cast<const uint8_t *>(im->data_);
+  in.step = im->stride_;
+  in.width = im->width_;
+  in.height = im->height_;
+  in.bytesPerPixel = bytesPerPixel;
+  in.encoding = encoding;
+  in.bayerSplit = zstdBayerSplit_ && enc::isBayer(encoding);
+  const std_msgs::msg::Header header = imageMsg_.header;
+  const uint64_t seq = zstdOrder_->nextSequence();
+  const bool submitted =
+    submitToStage(&zstdStage_, [this, im, in, header, seq]() {
+      thread_local RawCompressor compressor;
+      sensor_msgs::msg::CompressedImage::UniquePtr msg(
+        new sensor_msgs::msg::CompressedImage());
+      msg->header = header;
+      const std::string ret =
+        compressor.compress(in, zstdLevel_, &msg->data, &msg->format);
+      if (ret == "OK") {
+        zstdBytesIn_ += in.width * in.height * in.bytesPerPixel;
+        zstdBytesOut_ += msg->data.size();
+      } else {
+        LOG_WARN(ret);
+        msg.reset();
+      }
+      zstdOrder_->finish(seq, std::move(msg));
+    });
+  if (!submitted) {
+    zstdOrder_->finish(seq, nullptr);
+  }
+}
+
+void CameraDriver::publishRois(
+  const ImageConstPtr & im, const std::string & encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  const int bytesPerPixel = bytes_per_pixel(encoding);
+  if (bytesPerPixel == 0) {
+    return;  // cannot crop packed or unknown formats
+  }
+  // crops of Bayer images must start and end on the 2x2 pattern
+  const int align = enc::isBayer(encoding) ? 2 : 1;
+  const int imgWidth = static_cast<int>(im->width_);
+  const int imgHeight = static_cast<int>(im->height_);
+  for (const auto & roiPtr : rois_) {
+    Roi & roi = *roiPtr;
+    if (roi.numSubscribers.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    int x, y, w, h;
+    {
+      std::unique_lock<std::mutex> lock(roiMutex_);
+      x = roi.x;
+      y = roi.y;
+      w = roi.width;
+      h = roi.height;
+    }
+    x = std::min(x - x % align, imgWidth);
+    y = std::min(y - y % align, imgHeight);
+    w = std::min(w, imgWidth - x);
+    h = std::min(h, imgHeight - y);
+    w -= w % align;
+    h -= h % align;
+    if (w <= 0 || h <= 0) {
+      continue;  // outside the image
+    }
+    uint64_t * tag;
+    const sensor_msgs::msg::Image::SharedPtr img = roi.images.acquire(&tag);
+    img->header = imageMsg_.header;
+    img->encoding = encoding;
+    img->width = w;
+    img->height = h;
+    img->step = w * bytesPerPixel;
+    img->data.resize(img->step * h);
+    const uint8_t * src = static_cast<const uint8_t *>(im->data_) +
+                          y * im->stride_ + x * bytesPerPixel;
+    for (int row = 0; row < h; row++) {
+      std::memcpy(
+        &img->data[row * img->step], src + row * im->stride_, img->step);
+    }
+    const sensor_msgs::msg::CameraInfo::SharedPtr info =
+      makeSharedCameraInfo(&roi.infos);
+    info->roi.x_offset = x;
+    info->roi.y_offset = y;
+    info->roi.width = w;
+    info->roi.height = h;
+    info->roi.do_rectify = (w != imgWidth || h != imgHeight);
+    roi.pub.publish(img, info);
+  }
+}
+
+bool CameraDriver::hasProcessingStages() const
+{
+  return (
+    demosaicEnabled_ || pyramidLevels_ > 0 || polarizationEnabled_ ||
+    yuvEnabled_ || rectifyEnabled_ || jpegEnabled_ || zstdEnabled_);
+}
+
+bool CameraDriver::fillImageMsg(
+  sensor_msgs::msg::Image * msg, const std::string & encoding,
+  const ImageConstPtr & im)
+{
+  const auto t0 = chrono::steady_clock::now();
+  const bool ret = sensor_msgs::fillImage(
+    *msg, encoding, im->height_, im->width_, im->stride_, im->data_);
+  fillTime_.add(chrono::steady_clock::now() - t0);
+  return (ret);
+}
+
+void CameraDriver::prepareImagePool(size_t size)
+{
+  // Get the buffers of all idle pool messages ready for the new frame
+  // size now, rather than taking page faults while publishing.
+  std::vector<sensor_msgs::msg::Image *> msgs;
+  while (sensor_msgs::msg::Image * m = imagePool_->acquireIdle()) {
+    msgs.push_back(m);
+  }
+  std::string msg("OK");
+  for (auto m : msgs) {
+    const std::string ret =
+      prepare_buffer(&m->data, size, poolHugePages_, poolLockMemory_);
+    if (ret != "OK") {
+      msg = ret;
+    }
+    imagePool_->release(m);
+  }
+  if (msg == "OK") {
+    LOG_INFO(
+      "prepared " << msgs.size() << " pool buffers of size " << size
+                  << (poolLockMemory_ ? " locked" : "")
+                  << (poolHugePages_ ? " huge pages" : ""));
+  } else {
+    LOG_WARN("preparing pool buffers: " << msg);
+  }
+  preparedBufferSize_ = size;
+}
+
+template <typename T>
+CameraDriver::PooledPtr<T> CameraDriver::makePooled(
+  const std::shared_ptr<MessagePool<T>> & pool,
+  const std::shared_ptr<PoolAllocator<T>> & alloc)
+{
+  T * msg = pool ? pool->acquire() : nullptr;
+  if (!msg) {
+    // pool exhausted or disabled: fall back to a heap allocated message
+    msg = alloc->allocate(1);
+    new (msg) T();
+  }
+  return (PooledPtr<T>(
+    msg, rclcpp::allocator::Deleter<PoolAllocator<T>, T>(alloc.get())));
+}
+
+void CameraDriver::publishDirect(
+  const ImageConstPtr & im, const std::string & encoding,
+  PooledPtr<sensor_msgs::msg::Image> converted)
+{
+  if (converted) {
+    // unpacked or corrected, and no other output reads it
+    imagePub_->publish(std::move(converted));
+  } else {
+    // The camera's buffer, or a converted image that other outputs
+    // read, is copied into a pooled (or heap allocated) message.
+    // Pooled messages keep their buffers, so this does not reallocate.
+    const size_t size = im->height_ * im->stride_;
+    if (imagePool_ && size != preparedBufferSize_) {
+      prepareImagePool(size);
+    }
+    auto img = makePooled(imagePool_, imageAllocator_);
+    if (
+      imagePool_ && img->data.capacity() < size &&
+      imagePool_->owns(img.get())) {
+      // was in use while the pool was prepared for a new frame size
+      prepare_buffer(&img->data, size, poolHugePages_, poolLockMemory_);
+    }
+    img->header = imageMsg_.header;
+    if (!fillImageMsg(img.get(), encoding, im)) {
+      LOG_ERROR("fill image failed!");
+      return;
+    }
+    imagePub_->publish(std::move(img));
+  }
+  publishDirectCameraInfo();
+}
+
+void CameraDriver::publishDirectCameraInfo()
+{
+  // A recycled camera info message only needs a refill if the
+  // calibration changed since it was last used. Read version first!
+  const uint64_t version = cameraInfoVersion_.load(std::memory_order_acquire);
+  auto cinfo = makePooled(cameraInfoPool_, cameraInfoAllocator_);
+  uint64_t * tag =
+    cameraInfoPool_ ? cameraInfoPool_->tag(cinfo.get()) : nullptr;
+  if (!tag || *tag != version) {
+    *cinfo = *std::atomic_load(&cameraInfo_);
+    if (tag) {
+      *tag = version;
+    }
+  }
+  cinfo->header.stamp = imageMsg_.header.stamp;
+  cameraInfoPub_->publish(std::move(cinfo));
+  publishedCount_++;
+}
+
+sensor_msgs::msg::CameraInfo::SharedPtr CameraDriver::makeSharedCameraInfo(
+  SharedMessageRing<sensor_msgs::msg::CameraInfo> * ring)
+{
+  // As in publishDirectCameraInfo(), a recycled message is only refilled
+  // if the calibration changed, otherwise it just gets the new stamp.
+  const uint64_t version = cameraInfoVersion_.load(std::memory_order_acquire);
+  uint64_t * tag;
+  const sensor_msgs::msg::CameraInfo::SharedPtr cinfo = ring->acquire(&tag);
+  if (*tag != version) {
+    *cinfo = *std::atomic_load(&cameraInfo_);
+    *tag = version;
+  }
+  cinfo->header.stamp = imageMsg_.header.stamp;
+  return (cinfo);
+}
+
+void CameraDriver::updateSubscriberCounts()
+{
+  // Querying the graph is expensive, so it is done here at low rate
+  // rather than for every frame.
+  const size_t numImage =
+    directPublishing_ ? (imagePub_->get_subscription_count() +
+                         cameraInfoPub_->get_subscription_count())
+                      : pub_.getNumSubscribers();
+  numImageSubscribers_.store(numImage, std::memory_order_relaxed);
+  numMetaSubscribers_.store(
+    metaPub_->get_subscription_count(), std::memory_order_relaxed);
+  if (statisticsEnabled_) {
+    numStatisticsSubscribers_.store(
+      statisticsPub_->get_subscription_count(), std::memory_order_relaxed);
+  }
+  if (focusEnabled_) {
+    numFocusSubscribers_.store(
+      focusPub_->get_subscription_count(), std::memory_order_relaxed);
+  }
+  if (demosaicEnabled_) {
+    colorStage_.numSubscribers.store(
+      colorPub_.getNumSubscribers(), std::memory_order_relaxed);
+  }
+  size_t numPyramid = 0;
+  uint32_t wanted = 0;
+  for (size_t i = 0; i < pyramidPubs_.size(); i++) {
+    const size_t n = pyramidPubs_[i].getNumSubscribers();
+    if (n > 0) {
+      wanted |= (1U << i);
+    }
+    numPyramid += n;
+  }
+  pyramidSubscribed_.store(wanted, std::memory_order_relaxed);
+  pyramidStage_.numSubscribers.store(numPyramid, std::memory_order_relaxed);
+  size_t numPolarization = 0;
+  wanted = 0;
+  for (size_t i = 0; i < polarizationPubs_.size(); i++) {
+    const size_t n = polarizationPubs_[i].getNumSubscribers();
+    if (n > 0) {
+      wanted |= (1U << i);
+    }
+    numPolarization += n;
+  }
+  polarizationSubscribed_.store(wanted, std::memory_order_relaxed);
+  polarizationStage_.numSubscribers.store(
+    numPolarization, std::memory_order_relaxed);
+  if (yuvEnabled_) {
+    yuvStage_.numSubscribers.store(
+      yuvPub_.getNumSubscribers(), std::memory_order_relaxed);
+  }
+  if (rectifyEnabled_) {
+    rectifyStage_.numSubscribers.store(
+      rectifyPub_.getNumSubscribers(), std::memory_order_relaxed);
+  }
+  if (jpegEnabled_) {
+    jpegStage_.numSubscribers.store(
+      jpegPub_->get_subscription_count(), std::memory_order_relaxed);
+  }
+  if (zstdEnabled_) {
+    zstdStage_.numSubscribers.store(
+      zstdPub_->get_subscription_count(), std::memory_order_relaxed);
+  }
+  for (auto & roi : rois_) {
+    roi->numSubscribers.store(
+      roi->pub.getNumSubscribers(), std::memory_order_relaxed);
+  }
+}
+
+void CameraDriver::updateCameraInfo()
+{
+  // The calibration can be changed at any time through the
+  // camera_info_manager's set_camera_info service, so check periodically.
+  auto ci = std::make_shared<sensor_msgs::msg::CameraInfo>(
+    infoManager_->getCameraInfo());
+  ci->header.frame_id = frameId_;
+  const auto current = std::atomic_load(&cameraInfo_);
+  if (current && *current == *ci) {
+    return;
+  }
+  std::atomic_store(
+    &cameraInfo_, std::shared_ptr<const sensor_msgs::msg::CameraInfo>(ci));
+  // must come after storing the new camera info
+  cameraInfoVersion_.fetch_add(1, std::memory_order_release);
+  if (current) {
+    LOG_INFO("camera calibration has changed");
+  }
+}
+
 void CameraDriver::printCameraInfo()
 {
   if (cameraRunning_) {
@@ -548,7 +2367,11 @@ void CameraDriver::startCamera()
 {
   if (!cameraRunning_) {
     flir_spinnaker_common::Driver::Callback cb =
-      std::bind(&CameraDriver::publishImage, this, std::placeholders::_1);
+      inlinePublishing_
+        ? std::bind(
+            &CameraDriver::publishImageInline, this, std::placeholders::_1)
+        : std::bind(&CameraDriver::publishImage, this, std::placeholders::_1);
+    updatePixelFormat();
     cameraRunning_ = driver_->startCamera(cb);
     if (!cameraRunning_) {
       LOG_ERROR("failed to start camera!");
@@ -566,16 +2389,32 @@ bool CameraDriver::start()
   }
   infoManager_ = std::make_shared<camera_info_manager::CameraInfoManager>(
     this, get_name(), cameraInfoURL_);
+  captureDarkService_ = this->create_service<std_srvs::srv::Trigger>(
+    "~/capture_dark_frame",
+    std::bind(
+      &CameraDriver::captureReference, this, true, std::placeholders::_1,
+      std::placeholders::_2));
+  captureFlatService_ = this->create_service<std_srvs::srv::Trigger>(
+    "~/capture_flat_field",
+    std::bind(
+      &CameraDriver::captureReference, this, false, std::placeholders::_1,
+      std::placeholders::_2));
   controlSub_ =
     this->create_subscription<camera_control_msgs_ros2::msg::CameraControl>(
       "~/control", 10,
       std::bind(&CameraDriver::controlCallback, this, std::placeholders::_1));
   metaPub_ =
     create_publisher<image_meta_msgs_ros2::msg::ImageMetaData>("~/meta", 1);
+  if (statisticsEnabled_) {
+    statisticsPub_ =
+      create_publisher<msg::ImageStatistics>("~/meta/statistics", 1);
+  }
+  if (focusEnabled_) {
+    focusPub_ = create_publisher<msg::FocusMetric>("~/meta/focus", 1);
+  }
 
-  cameraInfoMsg_ = infoManager_->getCameraInfo();
+  updateCameraInfo();
   imageMsg_.header.frame_id = frameId_;
-  cameraInfoMsg_.header.frame_id = frameId_;
   metaMsg_.header.frame_id = frameId_;
 
   rmw_qos_profile_t qosProf = rmw_qos_profile_default;
@@ -598,8 +2437,142 @@ bool CameraDriver::start()
   qosProf.liveliness_lease_duration.sec = 10;  // time to declare client dead
   qosProf.liveliness_lease_duration.nsec = 0;
 
-  pub_ = image_transport::create_camera_publisher(this, "~/image_raw", qosProf);
-  driver_ = std::make_shared<flir_spinnaker_common::Driver>();
+  // Unpacked and corrected frames are read by the publishing thread and
+  // the workers, so a few are alive at the same time. Misses fall back
+  // to heap allocated messages.
+  framePool_ = std::make_shared<MessagePool<sensor_msgs::msg::Image>>(
+    numWorkerThreads_ + 4);
+  frameAllocator_ =
+    std::make_shared<PoolAllocator<sensor_msgs::msg::Image>>(framePool_);
+
+  directPublishing_ = useLoanedMessages_ || messagePoolSize_ > 0;
+  if (directPublishing_) {
+    // image_transport does not support custom allocators, so publish
+    // the raw image and camera info directly. No transport plugins are
+    // available in this mode.
+    const rclcpp::QoS qos(
+      rclcpp::QoSInitialization::from_rmw(qosProf), qosProf);
+    std::shared_ptr<PoolBase> imagePool, infoPool;
+    if (messagePoolSize_ > 0) {
+      imagePool_ = std::make_shared<MessagePool<sensor_msgs::msg::Image>>(
+        messagePoolSize_);
+      cameraInfoPool_ =
+        std::make_shared<MessagePool<sensor_msgs::msg::CameraInfo>>(
+          messagePoolSize_);
+      imagePool = imagePool_;
+      infoPool = cameraInfoPool_;
+      LOG_INFO("using message pool of size: " << messagePoolSize_);
+    }
+    imageAllocator_ =
+      std::make_shared<PoolAllocator<sensor_msgs::msg::Image>>(imagePool);
+    cameraInfoAllocator_ =
+      std::make_shared<PoolAllocator<sensor_msgs::msg::CameraInfo>>(infoPool);
+    rclcpp::PublisherOptionsWithAllocator<MessageAllocator> imageOptions;
+    imageOptions.allocator = std::make_shared<MessageAllocator>(imagePool);
+    imagePub_ = create_publisher<sensor_msgs::msg::Image, MessageAllocator>(
+      "~/image_raw", qos, imageOptions);
+    rclcpp::PublisherOptionsWithAllocator<MessageAllocator> infoOptions;
+    infoOptions.allocator = std::make_shared<MessageAllocator>(infoPool);
+    cameraInfoPub_ =
+      create_publisher<sensor_msgs::msg::CameraInfo, MessageAllocator>(
+        "~/camera_info", qos, infoOptions);
+    LOG_WARN(
+      "publishing " << imagePub_->get_topic_name()
+                    << " without image_transport, its transport plugins "
+                       "(compressed etc.) are not available");
+    if (useLoanedMessages_) {
+      // Only plain (fixed size) message types can be loaned, and
+      // sensor_msgs/Image holds a string and a vector.
+      LOG_WARN(
+        "no middleware loans sensor_msgs/Image messages, "
+        "use_loaned_messages only selects plain publishers");
+    }
+  } else {
+    pub_ =
+      image_transport::create_camera_publisher(this, "~/image_raw", qosProf);
+  }
+  if (demosaicEnabled_) {
+    colorPub_ =
+      image_transport::create_publisher(this, "~/image_color", qosProf);
+    LOG_INFO("publishing " << colorEncoding_ << " on " << colorPub_.getTopic());
+  }
+  for (int level = 1; level <= pyramidLevels_; level++) {
+    pyramidPubs_.push_back(image_transport::create_publisher(
+      this, "~/image_raw/level_" + std::to_string(level), qosProf));
+  }
+  if (pyramidLevels_ > 0) {
+    LOG_INFO("publishing image pyramid with " << pyramidLevels_ << " levels");
+  }
+  if (polarizationEnabled_) {
+    // same order as PolarizationOutput
+    for (const char * name :
+         {"angle_0", "angle_45", "angle_90", "angle_135", "dolp", "aolp"}) {
+      polarizationPubs_.push_back(image_transport::create_publisher(
+        this, std::string("~/polarization/") + name, qosProf));
+    }
+    LOG_INFO("publishing polarization angles, DoLP and AoLP");
+  }
+  if (yuvEnabled_) {
+    yuvPub_ = image_transport::create_publisher(this, "~/image_yuv", qosProf);
+    LOG_INFO(
+      "publishing " << yuv_encoding(yuvFormat_) << " images on "
+                    << yuvPub_.getTopic());
+  }
+  if (rectifyEnabled_) {
+    rectifyPub_ =
+      image_transport::create_publisher(this, "~/image_rect", qosProf);
+    LOG_INFO("publishing rectified images on " << rectifyPub_.getTopic());
+  }
+  if (jpegEnabled_) {
+    jpegPub_ = create_publisher<sensor_msgs::msg::CompressedImage>(
+      "~/image_jpeg", rclcpp::QoS(
+                        rclcpp::QoSInitialization::from_rmw(qosProf), qosProf));
+    jpegOrder_ = std::make_unique<
+      ReorderBuffer<sensor_msgs::msg::CompressedImage::UniquePtr>>(
+      [this](sensor_msgs::msg::CompressedImage::UniquePtr msg) {
+        jpegPub_->publish(std::move(msg));
+      });
+    // one frame per worker, more would just wait in the queue
+    jpegStage_.maxInFlight = numWorkerThreads_;
+    LOG_INFO(
+      "publishing jpeg quality " << jpegQuality_ << " on "
+                                 << jpegPub_->get_topic_name());
+  }
+  if (zstdEnabled_) {
+    zstdPub_ = create_publisher<sensor_msgs::msg::CompressedImage>(
+      "~/image_zstd", rclcpp::QoS(
+                        rclcpp::QoSInitialization::from_rmw(qosProf), qosProf));
+    zstdOrder_ = std::make_unique<
+      ReorderBuffer<sensor_msgs::msg::CompressedImage::UniquePtr>>(
+      [this](sensor_msgs::msg::CompressedImage::UniquePtr msg) {
+        zstdPub_->publish(std::move(msg));
+      });
+    zstdStage_.maxInFlight = numWorkerThreads_;
+    LOG_INFO(
+      "publishing zstd level " << zstdLevel_ << " on "
+                               << zstdPub_->get_topic_name());
+  }
+  for (auto & roi : rois_) {
+    roi->pub = image_transport::create_camera_publisher(
+      this, "~/" + roi->name + "/image_raw", qosProf);
+    LOG_INFO("publishing roi " << roi->name << " on " << roi->pub.getTopic());
+  }
+  if (hasProcessingStages()) {
+    workerPool_ = std::make_unique<WorkerPool>(
+      numWorkerThreads_, 16,
+      [this]() { applyThreadConfig("worker", workerThreadConfig_); });
+    LOG_INFO("started " << numWorkerThreads_ << " worker threads");
+  }
+  updateSubscriberCounts();
+  subscriberTimer_ = rclcpp::create_timer(
+    this, get_clock(),
+    rclcpp::Duration(chrono::nanoseconds(
+      static_cast<int64_t>(std::max(subscriberCheckInterval_, 0.01) * 1e9))),
+    [this]() {
+      updateSubscriberCounts();
+      updateCameraInfo();
+    });
+  driver_ = makeBackend();
   driver_->setDebug(debug_);
   driver_->setComputeBrightness(computeBrightness_);
   driver_->setAcquisitionTimeout(acquisitionTimeout_);
@@ -627,7 +2600,24 @@ bool CameraDriver::start()
     return (false);
   }
   keepRunning_ = true;
-  thread_ = std::make_shared<std::thread>(&CameraDriver::run, this);
+  if (lockMemory_) {
+    const std::string msg = lock_all_memory();
+    if (msg == "OK") {
+      LOG_INFO("locked all memory");
+    } else {
+      LOG_WARN("locking memory failed: " << msg);
+    }
+  }
+  if (inlinePublishing_) {
+    LOG_INFO("publishing directly from the acquisition thread");
+  } else {
+    if (queuePolicy_ == LATEST) {
+      latestFrame_ = std::make_unique<LatestFrame<QueuedFrame>>();
+    } else {
+      imageRing_ = std::make_unique<FrameRing<QueuedFrame>>(queueDepth_);
+    }
+    thread_ = std::make_shared<std::thread>(&CameraDriver::run, this);
+  }
 
   if (driver_->initCamera(serial_)) {
     if (dumpNodeMap_) {
@@ -639,6 +2629,7 @@ bool CameraDriver::start()
     // Some parameters (like blackfly s chunk control) cannot be set once
     // the camera is running.
     createCameraParameters();
+    startExposureControl();
     // TODO(bernd): once ROS2 supports subscriber status callbacks, this can go!
     startCamera();
   } else {
@@ -0,0 +1,141 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/change_detector.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "simd.h"
+
+namespace flir_spinnaker_ros2
+{
+// number of values in [0, n) where |a - b| > threshold
+static uint64_t count_changed(
+  const uint8_t * a, const uint8_t * b, size_t n, uint8_t threshold)
+{
+  uint64_t count = 0;
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i thr = _mm256_set1_epi8(static_cast<char>(threshold));
+  __m256i sum = zero;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i va =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    const __m256i vb =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    const __m256i d =
+      _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+    // 1 where the difference exceeds the threshold
+    const __m256i c = _mm256_min_epu8(_mm256_subs_epu8(d, thr), one);
+    sum = _mm256_add_epi64(sum, _mm256_sad_epu8(c, zero));
+  }
+  uint64_t s[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(s), sum);
+  count += s[0] + s[1] + s[2] + s[3];
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i thr = _mm_set1_epi8(static_cast<char>(threshold));
+  __m128i sum = zero;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i va =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    const __m128i vb =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    const __m128i d =
+      _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+    // 1 where the difference exceeds the threshold
+    const __m128i c = _mm_min_epu8(_mm_subs_epu8(d, thr), one);
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(c, zero));
+  }
+  uint64_t s[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(s), sum);
+  count += s[0] + s[1];
+#elif defined(__ARM_NEON)
+  const uint8x16_t thr = vdupq_n_u8(threshold);
+  uint64x2_t sum = vdupq_n_u64(0);
+  for (; i + 16 <= n; i += 16) {
+    // 1 where the difference exceeds the threshold
+    const uint8x16_t c = vshrq_n_u8(
+      vcgtq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)), thr), 7);
+    sum = vpadalq_u32(sum, vpaddlq_u16(vpaddlq_u8(c)));
+  }
+  count += vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+#endif
+  for (; i < n; i++) {
+    count += (a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]) > threshold;
+  }
+  return (count);
+}
+
+void ChangeDetector::configure(int subsample, int pixelThreshold)
+{
+  subsample_ = std::max(subsample, 1);
+  pixelThreshold_ = std::min(std::max(pixelThreshold, 0), 255);
+  currentValid_ = false;
+  referenceValid_ = false;
+}
+
+double ChangeDetector::compare(
+  const uint8_t * src, size_t step, int width, int height, int channels,
+  int bits, Packing packing)
+{
+  const size_t rowLength = static_cast<size_t>(width) * channels;
+  const int numRows = (height + subsample_ - 1) / subsample_;
+  const size_t size = rowLength * numRows;
+  current_.resize(size);
+  const int shift = std::max(bits - 8, 0);
+  for (int r = 0; r < numRows; r++) {
+    const uint8_t * s = src + static_cast<size_t>(r) * subsample_ * step;
+    uint8_t * d = current_.data() + r * rowLength;
+    if (packing != PACKING_NONE) {
+      unpacked_.resize(rowLength * 2);
+      unpack12_rows(s, step, width, packing, unpacked_.data(), 0, 0, 1);
+      s = unpacked_.data();
+    } else if (bits <= 8) {
+      memcpy(d, s, rowLength);
+      continue;
+    }
+    const uint16_t * s16 = reinterpret_cast<const uint16_t *>(s);
+    for (size_t x = 0; x < rowLength; x++) {
+      d[x] = static_cast<uint8_t>(std::min(s16[x] >> shift, 255));
+    }
+  }
+  currentRowLength_ = rowLength;
+  currentValid_ = true;
+  if (
+    !referenceValid_ || referenceRowLength_ != rowLength ||
+    reference_.size() != size || size == 0) {
+    return (1.0);
+  }
+  const uint64_t changed = count_changed(
+    current_.data(), reference_.data(), size,
+    static_cast<uint8_t>(pixelThreshold_));
+  return (static_cast<double>(changed) / size);
+}
+
+void ChangeDetector::accept()
+{
+  if (currentValid_) {
+    reference_.swap(current_);
+    referenceRowLength_ = currentRowLength_;
+    referenceValid_ = true;
+    currentValid_ = false;
+  }
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,160 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/demosaic.h>
+
+#include <cstdlib>
+
+#include "simd.h"
+
+//
+// Every output row is computed from three input rows (up, cur, down).
+// A row of the Bayer image has green on every other pixel and one of
+// the chroma colors ("own") on the remaining "sites". The other chroma
+// color sits in the rows above and below. With
+//
+//   C    = center pixel
+//   H    = avg(left, right)
+//   V    = avg(up, down)
+//   D    = avg of the four diagonal neighbors
+//   G    = green estimate at a site, avg(H, V) or edge directed
+//
+// the output is
+//
+//            own   green  other
+//   site:     C      G      D
+//   green:    H      C      V
+//
+// All of these are byte averages, so a full vector of pixels is
+// processed at once and the site/green distinction is a blend with an
+// alternating mask, followed by an interleaved store. Border pixels
+// mirror their neighbors and take the scalar path, which uses the same
+// rounding as the vector code.
+//
+
+namespace flir_spinnaker_ros2
+{
+namespace
+{
+inline int average(int a, int b) { return ((a + b + 1) >> 1); }
+
+// ownFirst: whether the "own" color goes into the first output channel
+inline void demosaic_pixel(
+  const uint8_t * up, const uint8_t * cur, const uint8_t * dn, int x,
+  int width, bool isSite, bool edgeAware, bool ownFirst, uint8_t * out)
+{
+  const int l = x > 0 ? x - 1 : x + 1;
+  const int r = x < width - 1 ? x + 1 : x - 1;
+  const int h = average(cur[l], cur[r]);
+  const int v = average(up[x], dn[x]);
+  int own, green, other;
+  if (isSite) {
+    green = average(v, h);
+    if (edgeAware) {
+      const int dh = std::abs(cur[l] - cur[r]);
+      const int dv = std::abs(up[x] - dn[x]);
+      green = dv > dh ? h : (dh > dv ? v : green);
+    }
+    own = cur[x];
+    other = average(average(up[l], up[r]), average(dn[l], dn[r]));
+  } else {
+    own = h;
+    green = cur[x];
+    other = v;
+  }
+  out[3 * x] = ownFirst ? own : other;
+  out[3 * x + 1] = green;
+  out[3 * x + 2] = ownFirst ? other : own;
+}
+
+void demosaic_row(
+  const uint8_t * up, const uint8_t * cur, const uint8_t * dn, int width,
+  int siteParity, bool edgeAware, bool ownFirst, uint8_t * out)
+{
+  using namespace simd;
+  demosaic_pixel(
+    up, cur, dn, 0, width, siteParity == 0, edgeAware, ownFirst, out);
+  // the vector loop starts at x = 1 and advances by an even number
+  // of pixels, so the site mask is the same for all iterations
+  const u8v site = parity_mask(siteParity ^ 1);
+  int x = 1;
+  for (; x + simd::width < width; x += simd::width) {
+    const u8v c = load(cur + x);
+    const u8v l = load(cur + x - 1);
+    const u8v r = load(cur + x + 1);
+    const u8v u = load(up + x);
+    const u8v d = load(dn + x);
+    const u8v h = avg(l, r);
+    const u8v v = avg(u, d);
+    u8v g = avg(h, v);
+    if (edgeAware) {
+      const u8v dh = absdiff(l, r);
+      const u8v dv = absdiff(u, d);
+      g = select(gt(dv, dh), h, select(gt(dh, dv), v, g));
+    }
+    const u8v diag = avg(
+      avg(load(up + x - 1), load(up + x + 1)),
+      avg(load(dn + x - 1), load(dn + x + 1)));
+    const u8v own = select(site, c, h);
+    const u8v green = select(site, g, c);
+    const u8v other = select(site, diag, v);
+    if (ownFirst) {
+      store3(out + 3 * x, own, green, other);
+    } else {
+      store3(out + 3 * x, other, green, own);
+    }
+  }
+  for (; x < width; x++) {
+    demosaic_pixel(
+      up, cur, dn, x, width, (x & 1) == siteParity, edgeAware, ownFirst,
+      out);
+  }
+}
+}  // namespace
+
+void demosaic_rows(
+  const uint8_t * src, size_t srcStep, int width, int height,
+  BayerPattern pattern, DemosaicMethod method, bool bgr, uint8_t * dst,
+  size_t dstStep, int rowBegin, int rowEnd)
+{
+  // location of the red pixel in the 2x2 block
+  const int redX = (pattern == GRBG || pattern == BGGR) ? 1 : 0;
+  const int redY = (pattern == GBRG || pattern == BGGR) ? 1 : 0;
+  const bool edgeAware = (method == DEMOSAIC_EDGE_AWARE);
+  for (int y = rowBegin; y < rowEnd; y++) {
+    const uint8_t * cur = src + y * srcStep;
+    // mirror at the top and bottom, which preserves the color phase
+    const uint8_t * up = y > 0 ? cur - srcStep : cur + srcStep;
+    const uint8_t * dn = y < height - 1 ? cur + srcStep : cur - srcStep;
+    const bool isRedRow = ((y & 1) == redY);
+    const int siteParity = isRedRow ? redX : (redX ^ 1);
+    demosaic_row(
+      up, cur, dn, width, siteParity, edgeAware, isRedRow != bgr,
+      dst + (y - rowBegin) * dstStep);
+  }
+}
+
+bool demosaic_method_from_string(const std::string & s, DemosaicMethod * m)
+{
+  if (s == "bilinear") {
+    *m = DEMOSAIC_BILINEAR;
+  } else if (s == "edge_aware") {
+    *m = DEMOSAIC_EDGE_AWARE;
+  } else {
+    return (false);
+  }
+  return (true);
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,144 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/exposure_controller.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace flir_spinnaker_ros2
+{
+bool ExposureController::hasLanded(double exposureTime, double gain) const
+{
+  // cameras report the exposure time in whole usec
+  return (
+    std::abs(exposureTime - applied_.exposureTime) <=
+      0.01 * applied_.exposureTime + 1.0 &&
+    std::abs(gain - applied_.gain) <= 0.1);
+}
+
+bool ExposureController::update(
+  double brightness, double exposureTime, double gain, Setting * next)
+{
+  if (pending_) {
+    framesWaited_++;
+    const bool landed = hasLanded(exposureTime, gain);
+    if (!landed && framesWaited_ < config_.maxFramesSkip) {
+      return (false);  // frame was taken with an older setting
+    }
+    if (landed) {
+      numLanded_.fetch_add(1, std::memory_order_relaxed);
+      latencySum_.fetch_add(framesWaited_, std::memory_order_relaxed);
+    }
+    pending_ = false;
+  }
+  if (brightness < 0) {
+    return (false);  // brightness is not computed
+  }
+  if (exposureTime <= 0) {
+    // Without chunk data, assume the last setting has landed (after
+    // maxFramesSkip frames), or start from the shortest exposure.
+    const bool known = applied_.exposureTime > 0;
+    exposureTime = known ? applied_.exposureTime : config_.minExposureTime;
+    gain = known ? applied_.gain : 0;
+  }
+  const double error = brightness - config_.brightnessTarget;
+  if (std::abs(error) <= config_.brightnessTolerance) {
+    return (false);
+  }
+  // Brightness is about proportional to exposure time times linear
+  // gain. Limit the step, saturated or black images say little
+  // about how far off the exposure is.
+  const double ratio = std::min(
+    std::max(config_.brightnessTarget / std::max(brightness, 1.0), 0.25), 4.0);
+  const double total = exposureTime * std::pow(10.0, gain / 20.0) * ratio;
+  const double maxGain = std::max(config_.maxGain, 0.0);
+  Setting s;
+  if (config_.gainPriority) {
+    // short exposure, gain first
+    s.gain = std::min(
+      std::max(20.0 * std::log10(total / config_.minExposureTime), 0.0),
+      maxGain);
+    s.exposureTime = total / std::pow(10.0, s.gain / 20.0);
+  } else {
+    s.exposureTime = total;
+  }
+  s.exposureTime = std::min(
+    std::max(s.exposureTime, config_.minExposureTime),
+    config_.maxExposureTime);
+  if (!config_.gainPriority) {
+    // gain only for what the exposure time cannot do
+    s.gain = std::min(
+      std::max(20.0 * std::log10(total / s.exposureTime), 0.0), maxGain);
+  }
+  if (
+    std::abs(s.exposureTime - exposureTime) < 0.005 * exposureTime + 1.0 &&
+    std::abs(s.gain - gain) < 0.05) {
+    return (false);  // at the limits
+  }
+  *next = s;
+  applied_ = s;
+  pending_ = true;
+  framesWaited_ = 0;
+  numChanges_.fetch_add(1, std::memory_order_relaxed);
+  return (true);
+}
+
+ExposureController::Stats ExposureController::getAndResetStats()
+{
+  Stats s;
+  s.numChanges = numChanges_.exchange(0, std::memory_order_relaxed);
+  s.numLanded = numLanded_.exchange(0, std::memory_order_relaxed);
+  const int sum = latencySum_.exchange(0, std::memory_order_relaxed);
+  s.avgLatency = s.numLanded > 0 ? static_cast<double>(sum) / s.numLanded : 0;
+  return (s);
+}
+
+std::shared_ptr<ExposureControlGroup> ExposureControlGroup::get(
+  const std::string & name)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<ExposureControlGroup>> groups;
+  std::unique_lock<std::mutex> lock(mutex);
+  std::shared_ptr<ExposureControlGroup> g = groups[name].lock();
+  if (!g) {
+    g = std::make_shared<ExposureControlGroup>();
+    groups[name] = g;
+  }
+  return (g);
+}
+
+int ExposureControlGroup::addFollower(const Callback & cb)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  followers_[nextId_] = cb;
+  return (nextId_++);
+}
+
+void ExposureControlGroup::removeFollower(int id)
+{
+  // waits for a running apply() to finish
+  std::unique_lock<std::mutex> lock(mutex_);
+  followers_.erase(id);
+}
+
+void ExposureControlGroup::apply(const ExposureController::Setting & s)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto & f : followers_) {
+    f.second(s);
+  }
+}
+}  // namespace flir_spinnaker_ros2
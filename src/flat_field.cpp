@@ -0,0 +1,333 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/flat_field.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+#include "simd.h"
+
+namespace flir_spinnaker_ros2
+{
+namespace
+{
+const int GAIN_BITS = 12;  // fractional bits of the gain
+
+// skips white space and comments of the pgm header, then reads a number
+bool read_header_value(std::istream & f, int * value)
+{
+  while (f) {
+    const int c = f.peek();
+    if (c == '#') {
+      f.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    } else if (std::isspace(c)) {
+      f.get();
+    } else {
+      break;
+    }
+  }
+  return (static_cast<bool>(f >> *value));
+}
+
+inline int correct_pixel(int v, int dark, int gain, int maxValue)
+{
+  const uint32_t d = v > dark ? v - dark : 0;
+  const uint32_t r = (d * gain + (1 << (GAIN_BITS - 1))) >> GAIN_BITS;
+  return (r > static_cast<uint32_t>(maxValue) ? maxValue : r);
+}
+
+#if defined(__AVX2__)
+// corrects 16 pixels, the result is saturated to 0..65535
+inline __m256i correct_epu16(__m256i x, __m256i dark, __m256i gain)
+{
+  const __m256i d = _mm256_subs_epu16(x, dark);
+  const __m256i lo = _mm256_mullo_epi16(d, gain);
+  const __m256i hi = _mm256_mulhi_epu16(d, gain);
+  const __m256i r = _mm256_set1_epi32(1 << (GAIN_BITS - 1));
+  const __m256i bias = _mm256_set1_epi32(32768);
+  // no unsigned saturating pack from 32 to 16 bit, so pack around 32768
+  const __m256i p0 = _mm256_sub_epi32(
+    _mm256_srli_epi32(
+      _mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), r), GAIN_BITS),
+    bias);
+  const __m256i p1 = _mm256_sub_epi32(
+    _mm256_srli_epi32(
+      _mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), r), GAIN_BITS),
+    bias);
+  return (_mm256_xor_si256(
+    _mm256_packs_epi32(p0, p1), _mm256_set1_epi16(-32768)));
+}
+#elif defined(__SSE2__)
+inline __m128i correct_epu16(__m128i x, __m128i dark, __m128i gain)
+{
+  const __m128i d = _mm_subs_epu16(x, dark);
+  const __m128i lo = _mm_mullo_epi16(d, gain);
+  const __m128i hi = _mm_mulhi_epu16(d, gain);
+  const __m128i r = _mm_set1_epi32(1 << (GAIN_BITS - 1));
+  const __m128i bias = _mm_set1_epi32(32768);
+  // no unsigned saturating pack from 32 to 16 bit, so pack around 32768
+  const __m128i p0 = _mm_sub_epi32(
+    _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), r), GAIN_BITS),
+    bias);
+  const __m128i p1 = _mm_sub_epi32(
+    _mm_srli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), r), GAIN_BITS),
+    bias);
+  return (_mm_xor_si128(_mm_packs_epi32(p0, p1), _mm_set1_epi16(-32768)));
+}
+#elif defined(__ARM_NEON)
+inline uint16x8_t correct_u16(uint16x8_t x, uint16x8_t dark, uint16x8_t gain)
+{
+  const uint16x8_t d = vqsubq_u16(x, dark);
+  const uint32x4_t p0 = vmull_u16(vget_low_u16(d), vget_low_u16(gain));
+  const uint32x4_t p1 = vmull_u16(vget_high_u16(d), vget_high_u16(gain));
+  // rounding shift with saturating narrow
+  return (vcombine_u16(
+    vqrshrn_n_u32(p0, GAIN_BITS), vqrshrn_n_u32(p1, GAIN_BITS)));
+}
+#endif
+
+// Vectorized part of a row, return the number of pixels done.
+int correct8_simd(
+  const uint8_t * src, const uint16_t * dark, const uint16_t * gain,
+  int width, uint8_t * dst)
+{
+  int x = 0;
+#if defined(__AVX2__)
+  for (; x + 32 <= width; x += 32) {
+    const __m256i v =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x));
+    const __m256i lo = correct_epu16(
+      _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dark + x)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain + x)));
+    const __m256i hi = correct_epu16(
+      _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dark + x + 16)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain + x + 16)));
+    // the pack interleaves the 128 bit lanes of lo and hi
+    _mm256_storeu_si256(
+      reinterpret_cast<__m256i *>(dst + x),
+      _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8));
+  }
+#elif defined(__SSE2__)
+  const __m128i z = _mm_setzero_si128();
+  for (; x + 16 <= width; x += 16) {
+    const __m128i v =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+    const __m128i lo = correct_epu16(
+      _mm_unpacklo_epi8(v, z),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(dark + x)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain + x)));
+    const __m128i hi = correct_epu16(
+      _mm_unpackhi_epi8(v, z),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(dark + x + 8)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain + x + 8)));
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i *>(dst + x), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(__ARM_NEON)
+  for (; x + 16 <= width; x += 16) {
+    const uint8x16_t v = vld1q_u8(src + x);
+    const uint16x8_t lo = correct_u16(
+      vmovl_u8(vget_low_u8(v)), vld1q_u16(dark + x), vld1q_u16(gain + x));
+    const uint16x8_t hi = correct_u16(
+      vmovl_u8(vget_high_u8(v)), vld1q_u16(dark + x + 8),
+      vld1q_u16(gain + x + 8));
+    vst1q_u8(dst + x, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+  }
+#else
+  (void)src;
+  (void)dark;
+  (void)gain;
+  (void)width;
+  (void)dst;
+#endif
+  return (x);
+}
+
+int correct16_simd(
+  const uint16_t * src, const uint16_t * dark, const uint16_t * gain,
+  int width, uint16_t * dst)
+{
+  int x = 0;
+#if defined(__AVX2__)
+  for (; x + 16 <= width; x += 16) {
+    _mm256_storeu_si256(
+      reinterpret_cast<__m256i *>(dst + x),
+      correct_epu16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dark + x)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gain + x))));
+  }
+#elif defined(__SSE2__)
+  for (; x + 8 <= width; x += 8) {
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i *>(dst + x),
+      correct_epu16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(dark + x)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain + x))));
+  }
+#elif defined(__ARM_NEON)
+  for (; x + 8 <= width; x += 8) {
+    vst1q_u16(
+      dst + x,
+      correct_u16(
+        vld1q_u16(src + x), vld1q_u16(dark + x), vld1q_u16(gain + x)));
+  }
+#else
+  (void)src;
+  (void)dark;
+  (void)gain;
+  (void)width;
+  (void)dst;
+#endif
+  return (x);
+}
+}  // namespace
+
+std::string read_pgm(const std::string & fileName, ReferenceImage * img)
+{
+  std::ifstream f(fileName, std::ios::binary);
+  if (!f) {
+    return ("cannot open " + fileName);
+  }
+  std::string magic;
+  int maxValue = 0;
+  if (
+    !(f >> magic) || magic != "P5" || !read_header_value(f, &img->width) ||
+    !read_header_value(f, &img->height) || !read_header_value(f, &maxValue) ||
+    img->width <= 0 || img->height <= 0 || maxValue <= 0 ||
+    maxValue > 65535) {
+    return (fileName + " is not a binary pgm file");
+  }
+  f.get();  // single white space before the pixels
+  img->bytesPerPixel = maxValue > 255 ? 2 : 1;
+  const size_t n = static_cast<size_t>(img->width) * img->height;
+  std::vector<uint8_t> buf(n * img->bytesPerPixel);
+  if (!f.read(reinterpret_cast<char *>(&buf[0]), buf.size())) {
+    return (fileName + " is truncated");
+  }
+  img->data.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    // 16 bit pgm is big endian
+    img->data[i] =
+      img->bytesPerPixel == 1 ? buf[i] : (buf[2 * i] << 8) | buf[2 * i + 1];
+  }
+  return ("OK");
+}
+
+std::string write_pgm(const std::string & fileName, const ReferenceImage & img)
+{
+  std::ofstream f(fileName, std::ios::binary);
+  if (!f) {
+    return ("cannot open " + fileName + " for writing");
+  }
+  f << "P5\n"
+    << img.width << " " << img.height << "\n"
+    << (img.bytesPerPixel == 1 ? 255 : 65535) << "\n";
+  std::vector<uint8_t> buf(img.data.size() * img.bytesPerPixel);
+  for (size_t i = 0; i < img.data.size(); i++) {
+    if (img.bytesPerPixel == 1) {
+      buf[i] = static_cast<uint8_t>(img.data[i]);
+    } else {
+      buf[2 * i] = img.data[i] >> 8;
+      buf[2 * i + 1] = img.data[i] & 0xFF;
+    }
+  }
+  f.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+  return (f ? "OK" : "error writing " + fileName);
+}
+
+std::string FlatField::init(
+  const ReferenceImage & dark, const ReferenceImage & flat)
+{
+  if (dark.empty() && flat.empty()) {
+    return ("neither dark frame nor flat field given");
+  }
+  const ReferenceImage & ref = dark.empty() ? flat : dark;
+  if (
+    !dark.empty() && !flat.empty() &&
+    (dark.width != flat.width || dark.height != flat.height ||
+     dark.bytesPerPixel != flat.bytesPerPixel)) {
+    return ("dark frame and flat field differ in size or depth");
+  }
+  const size_t n = static_cast<size_t>(ref.width) * ref.height;
+  if (ref.data.size() != n) {
+    return ("reference image has wrong size");
+  }
+  width_ = ref.width;
+  height_ = ref.height;
+  bytesPerPixel_ = ref.bytesPerPixel;
+  dark_ = dark.empty() ? std::vector<uint16_t>(n, 0) : dark.data;
+  gain_.assign(n, 1 << GAIN_BITS);
+  if (flat.empty()) {
+    return ("OK");
+  }
+  // mean of flat - dark for each pixel of the 2x2 block
+  double sum[4] = {0, 0, 0, 0};
+  size_t count[4] = {0, 0, 0, 0};
+  for (int y = 0; y < height_; y++) {
+    for (int x = 0; x < width_; x++) {
+      const size_t i = y * width_ + x;
+      const int c = (y & 1) * 2 + (x & 1);
+      sum[c] += std::max(static_cast<int>(flat.data[i]) - dark_[i], 0);
+      count[c]++;
+    }
+  }
+  for (int y = 0; y < height_; y++) {
+    for (int x = 0; x < width_; x++) {
+      const size_t i = y * width_ + x;
+      const int c = (y & 1) * 2 + (x & 1);
+      const int s = static_cast<int>(flat.data[i]) - dark_[i];
+      if (s > 0) {  // else leave the (dead) pixel alone
+        const double g = sum[c] / count[c] / s * (1 << GAIN_BITS);
+        gain_[i] = static_cast<uint16_t>(std::min(std::round(g), 65535.0));
+      }
+    }
+  }
+  return ("OK");
+}
+
+void FlatField::correctRows(
+  const uint8_t * src, size_t srcStep, uint8_t * dst, size_t dstStep,
+  int rowBegin, int rowEnd) const
+{
+  for (int y = rowBegin; y < rowEnd; y++) {
+    const uint8_t * s = src + (y - rowBegin) * srcStep;
+    uint8_t * d = dst + (y - rowBegin) * dstStep;
+    const uint16_t * dark = &dark_[y * width_];
+    const uint16_t * gain = &gain_[y * width_];
+    if (bytesPerPixel_ == 1) {
+      for (int x = correct8_simd(s, dark, gain, width_, d); x < width_; x++) {
+        d[x] = correct_pixel(s[x], dark[x], gain[x], 255);
+      }
+    } else {
+      // rows of the camera and message buffers are suitably aligned
+      // for 16 bit access
+      const uint16_t * s16 = reinterpret_cast<const uint16_t *>(s);
+      uint16_t * d16 = reinterpret_cast<uint16_t *>(d);
+      for (int x = correct16_simd(s16, dark, gain, width_, d16); x < width_;
+           x++) {
+        d16[x] = correct_pixel(s16[x], dark[x], gain[x], 65535);
+      }
+    }
+  }
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,327 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/focus.h>
+
+#include <algorithm>
+
+#include "simd.h"
+
+namespace flir_spinnaker_ros2
+{
+namespace
+{
+struct Sums
+{
+  int64_t sum{0};    // of the Laplacian
+  int64_t sumSq{0};  // of its square
+  int64_t sumValue{0};
+};
+
+// Elements [x0, x1) of the row c, with the rows n and s above and below
+// it and the horizontal neighbors h elements away.
+template <typename T>
+void laplacian_scalar(
+  const T * n, const T * c, const T * s, int h, int x0, int x1, Sums * r)
+{
+  for (int x = x0; x < x1; x++) {
+    const int64_t l =
+      4 * static_cast<int64_t>(c[x]) - n[x] - s[x] - c[x - h] - c[x + h];
+    r->sum += l;
+    r->sumSq += l * l;
+    r->sumValue += c[x];
+  }
+}
+
+// Vectorized part of an 8 bit row, returns the first element not done.
+// The Laplacian is within +-1020, so its square sums to at most 4 *
+// 1020^2 per 32 bit lane and iteration: flushed after 256 iterations.
+int laplacian_simd8(
+  const uint8_t * n, const uint8_t * c, const uint8_t * s, int h, int x0,
+  int x1, Sums * r)
+{
+  int x = x0;
+#if defined(__AVX2__)
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi16(1);
+  auto ld = [](const uint8_t * p) {
+    return (_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+  };
+  // Lambdas, not pointers to the intrinsics: those have no out of line
+  // definition to link against in unoptimized builds. Lane order does
+  // not matter for the sums.
+  auto lo8 = [&](__m256i v) { return (_mm256_unpacklo_epi8(v, zero)); };
+  auto hi8 = [&](__m256i v) { return (_mm256_unpackhi_epi8(v, zero)); };
+  auto lap = [](
+               auto unpack, __m256i vn, __m256i vc, __m256i vs, __m256i vw,
+               __m256i ve) {
+    return (_mm256_sub_epi16(
+      _mm256_slli_epi16(unpack(vc), 2),
+      _mm256_add_epi16(
+        _mm256_add_epi16(unpack(vn), unpack(vs)),
+        _mm256_add_epi16(unpack(vw), unpack(ve)))));
+  };
+  while (x + 32 <= x1) {
+    __m256i sum = zero, sumSq = zero, sumValue = zero;
+    for (int i = 0; i < 256 && x + 32 <= x1; i++, x += 32) {
+      const __m256i vn = ld(n + x), vc = ld(c + x), vs = ld(s + x);
+      const __m256i vw = ld(c + x - h), ve = ld(c + x + h);
+      const __m256i lo = lap(lo8, vn, vc, vs, vw, ve);
+      const __m256i hi = lap(hi8, vn, vc, vs, vw, ve);
+      sumSq = _mm256_add_epi32(
+        sumSq,
+        _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+      sum = _mm256_add_epi32(
+        sum, _mm256_madd_epi16(_mm256_add_epi16(lo, hi), one));
+      sumValue = _mm256_add_epi64(sumValue, _mm256_sad_epu8(vc, zero));
+    }
+    int32_t a[8], b[8];
+    int64_t v[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(a), sum);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(b), sumSq);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(v), sumValue);
+    for (int i = 0; i < 8; i++) {
+      r->sum += a[i];
+      r->sumSq += static_cast<uint32_t>(b[i]);
+    }
+    r->sumValue += v[0] + v[1] + v[2] + v[3];
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  auto ld = [](const uint8_t * p) {
+    return (_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  };
+  auto lo8 = [&](__m128i v) { return (_mm_unpacklo_epi8(v, zero)); };
+  auto hi8 = [&](__m128i v) { return (_mm_unpackhi_epi8(v, zero)); };
+  auto lap = [](
+               auto unpack, __m128i vn, __m128i vc, __m128i vs, __m128i vw,
+               __m128i ve) {
+    return (_mm_sub_epi16(
+      _mm_slli_epi16(unpack(vc), 2),
+      _mm_add_epi16(
+        _mm_add_epi16(unpack(vn), unpack(vs)),
+        _mm_add_epi16(unpack(vw), unpack(ve)))));
+  };
+  while (x + 16 <= x1) {
+    __m128i sum = zero, sumSq = zero, sumValue = zero;
+    for (int i = 0; i < 256 && x + 16 <= x1; i++, x += 16) {
+      const __m128i vn = ld(n + x), vc = ld(c + x), vs = ld(s + x);
+      const __m128i vw = ld(c + x - h), ve = ld(c + x + h);
+      const __m128i lo = lap(lo8, vn, vc, vs, vw, ve);
+      const __m128i hi = lap(hi8, vn, vc, vs, vw, ve);
+      sumSq = _mm_add_epi32(
+        sumSq, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_add_epi16(lo, hi), one));
+      sumValue = _mm_add_epi64(sumValue, _mm_sad_epu8(vc, zero));
+    }
+    int32_t a[4], b[4];
+    int64_t v[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(a), sum);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(b), sumSq);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(v), sumValue);
+    for (int i = 0; i < 4; i++) {
+      r->sum += a[i];
+      r->sumSq += static_cast<uint32_t>(b[i]);
+    }
+    r->sumValue += v[0] + v[1];
+  }
+#elif defined(__ARM_NEON)
+  auto wide = [](uint8x8_t v) { return (vreinterpretq_s16_u16(vmovl_u8(v))); };
+  auto lap = [](
+               int16x8_t vn, int16x8_t vc, int16x8_t vs, int16x8_t vw,
+               int16x8_t ve) {
+    return (vsubq_s16(
+      vshlq_n_s16(vc, 2), vaddq_s16(vaddq_s16(vn, vs), vaddq_s16(vw, ve))));
+  };
+  while (x + 16 <= x1) {
+    int32x4_t sum = vdupq_n_s32(0), sumSq = vdupq_n_s32(0);
+    uint32x4_t sumValue = vdupq_n_u32(0);
+    for (int i = 0; i < 256 && x + 16 <= x1; i++, x += 16) {
+      const uint8x16_t vn = vld1q_u8(n + x), vc = vld1q_u8(c + x);
+      const uint8x16_t vs = vld1q_u8(s + x), vw = vld1q_u8(c + x - h);
+      const uint8x16_t ve = vld1q_u8(c + x + h);
+      const int16x8_t lo = lap(
+        wide(vget_low_u8(vn)), wide(vget_low_u8(vc)), wide(vget_low_u8(vs)),
+        wide(vget_low_u8(vw)), wide(vget_low_u8(ve)));
+      const int16x8_t hi = lap(
+        wide(vget_high_u8(vn)), wide(vget_high_u8(vc)), wide(vget_high_u8(vs)),
+        wide(vget_high_u8(vw)), wide(vget_high_u8(ve)));
+      sumSq = vmlal_s16(sumSq, vget_low_s16(lo), vget_low_s16(lo));
+      sumSq = vmlal_s16(sumSq, vget_high_s16(lo), vget_high_s16(lo));
+      sumSq = vmlal_s16(sumSq, vget_low_s16(hi), vget_low_s16(hi));
+      sumSq = vmlal_s16(sumSq, vget_high_s16(hi), vget_high_s16(hi));
+      sum = vpadalq_s16(sum, vaddq_s16(lo, hi));
+      sumValue = vpadalq_u16(sumValue, vpaddlq_u8(vc));
+    }
+    int32_t a[4], b[4];
+    uint32_t v[4];
+    vst1q_s32(a, sum);
+    vst1q_s32(b, sumSq);
+    vst1q_u32(v, sumValue);
+    for (int i = 0; i < 4; i++) {
+      r->sum += a[i];
+      r->sumSq += static_cast<uint32_t>(b[i]);
+      r->sumValue += v[i];
+    }
+  }
+#else
+  (void)n;
+  (void)c;
+  (void)s;
+  (void)h;
+  (void)x1;
+  (void)r;
+#endif
+  return (x);
+}
+
+// Vectorized part of a 16 bit row with at most 12 significant bits, so
+// the Laplacian (+-16380) still fits into 16 bits. Its squares go into
+// 64 bit lanes right away.
+int laplacian_simd16(
+  const uint16_t * n, const uint16_t * c, const uint16_t * s, int h, int x0,
+  int x1, Sums * r)
+{
+  int x = x0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  auto ld = [](const uint16_t * p) {
+    return (_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  };
+  __m128i sum = zero, sumSq = zero, sumValue = zero;
+  for (; x + 8 <= x1; x += 8) {
+    const __m128i vc = ld(c + x);
+    const __m128i l = _mm_sub_epi16(
+      _mm_slli_epi16(vc, 2),
+      _mm_add_epi16(
+        _mm_add_epi16(ld(n + x), ld(s + x)),
+        _mm_add_epi16(ld(c + x - h), ld(c + x + h))));
+    const __m128i sq = _mm_madd_epi16(l, l);  // positive
+    sumSq = _mm_add_epi64(
+      sumSq,
+      _mm_add_epi64(
+        _mm_unpacklo_epi32(sq, zero), _mm_unpackhi_epi32(sq, zero)));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(l, one));
+    sumValue = _mm_add_epi32(sumValue, _mm_madd_epi16(vc, one));
+  }
+  int32_t a[4], v[4];
+  int64_t b[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(a), sum);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(b), sumSq);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(v), sumValue);
+  for (int i = 0; i < 4; i++) {
+    r->sum += a[i];
+    r->sumValue += v[i];
+  }
+  r->sumSq += b[0] + b[1];
+#elif defined(__ARM_NEON)
+  auto ld = [](const uint16_t * p) {
+    return (vreinterpretq_s16_u16(vld1q_u16(p)));
+  };
+  int32x4_t sum = vdupq_n_s32(0);
+  int64x2_t sumSq = vdupq_n_s64(0);
+  uint32x4_t sumValue = vdupq_n_u32(0);
+  for (; x + 8 <= x1; x += 8) {
+    const int16x8_t vc = ld(c + x);
+    const int16x8_t l = vsubq_s16(
+      vshlq_n_s16(vc, 2),
+      vaddq_s16(
+        vaddq_s16(ld(n + x), ld(s + x)),
+        vaddq_s16(ld(c + x - h), ld(c + x + h))));
+    sumSq = vpadalq_s32(sumSq, vmull_s16(vget_low_s16(l), vget_low_s16(l)));
+    sumSq = vpadalq_s32(sumSq, vmull_s16(vget_high_s16(l), vget_high_s16(l)));
+    sum = vpadalq_s16(sum, l);
+    sumValue = vpadalq_u16(sumValue, vld1q_u16(c + x));
+  }
+  int32_t a[4];
+  uint32_t v[4];
+  int64_t b[2];
+  vst1q_s32(a, sum);
+  vst1q_u32(v, sumValue);
+  vst1q_s64(b, sumSq);
+  for (int i = 0; i < 4; i++) {
+    r->sum += a[i];
+    r->sumValue += v[i];
+  }
+  r->sumSq += b[0] + b[1];
+#else
+  (void)n;
+  (void)c;
+  (void)s;
+  (void)h;
+  (void)x1;
+  (void)r;
+#endif
+  return (x);
+}
+}  // namespace
+
+bool compute_focus(
+  const FocusConfig & config, const uint8_t * src, size_t step, int width,
+  int height, int channels, bool bayer, int bits, FocusResult * result)
+{
+  // neighbors of the same color
+  const int unit = bayer ? 2 : 1;
+  const int x0 = std::min(std::max(config.x, 0), width);
+  const int y0 = std::min(std::max(config.y, 0), height);
+  const int x1 = config.width > 0 ? std::min(x0 + config.width, width) : width;
+  const int y1 =
+    config.height > 0 ? std::min(y0 + config.height, height) : height;
+  result->x = x0;
+  result->y = y0;
+  result->width = x1 - x0;
+  result->height = y1 - y0;
+  // the Laplacian needs the neighbors
+  const int xs = std::max(x0, unit);
+  const int xe = std::min(x1, width - unit);
+  const int ys = std::max(y0, unit);
+  const int ye = std::min(y1, height - unit);
+  if (xe <= xs || ye <= ys) {
+    return (false);
+  }
+  const int h = unit * channels;  // in elements
+  const int e0 = xs * channels;
+  const int e1 = xe * channels;
+  const int stride = std::max(config.stride, 1);
+  Sums sums;
+  uint64_t count = 0;
+  for (int y = ys; y < ye; y += stride) {
+    const uint8_t * c = src + y * step;
+    if (bits <= 8) {
+      const int x = laplacian_simd8(
+        c - unit * step, c, c + unit * step, h, e0, e1, &sums);
+      laplacian_scalar(c - unit * step, c, c + unit * step, h, x, e1, &sums);
+    } else {
+      const uint16_t * c16 = reinterpret_cast<const uint16_t *>(c);
+      const uint16_t * n16 =
+        reinterpret_cast<const uint16_t *>(c - unit * step);
+      const uint16_t * s16 =
+        reinterpret_cast<const uint16_t *>(c + unit * step);
+      const int x =
+        bits <= 12 ? laplacian_simd16(n16, c16, s16, h, e0, e1, &sums) : e0;
+      laplacian_scalar(n16, c16, s16, h, x, e1, &sums);
+    }
+    count += e1 - e0;
+  }
+  const double mean = static_cast<double>(sums.sum) / count;
+  result->laplacianVariance =
+    std::max(static_cast<double>(sums.sumSq) / count - mean * mean, 0.0);
+  result->mean = static_cast<double>(sums.sumValue) / count;
+  result->count = count;
+  return (true);
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,69 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/frame_ring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace flir_spinnaker_ros2
+{
+EventWakeup::EventWakeup()
+{
+  fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd_ < 0) {
+    throw std::runtime_error(
+      std::string("cannot create eventfd: ") + strerror(errno));
+  }
+}
+
+EventWakeup::~EventWakeup()
+{
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void EventWakeup::signal()
+{
+  const uint64_t one(1);
+  // can only fail if the counter overflows, in which case a wakeup
+  // is pending anyway
+  ssize_t ret = write(fd_, &one, sizeof(one));
+  (void)ret;
+}
+
+bool EventWakeup::wait(std::chrono::milliseconds timeout)
+{
+  struct pollfd pfd;
+  pfd.fd = fd_;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  const int ret = poll(&pfd, 1, static_cast<int>(timeout.count()));
+  if (ret <= 0) {
+    return (false);  // timeout or interrupted
+  }
+  uint64_t cnt;
+  ssize_t n = read(fd_, &cnt, sizeof(cnt));  // reset counter
+  (void)n;
+  return (true);
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,206 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/jpeg_encoder.h>
+
+// clang-format off
+#include <csetjmp>
+#include <cstdio>  // must come before jpeglib.h
+#include <jpeglib.h>
+// clang-format on
+
+#include <algorithm>
+
+namespace flir_spinnaker_ros2
+{
+// rows converted at a time for input that libjpeg cannot take directly
+static const int BAND_ROWS = 16;
+
+struct JpegEncoder::Impl
+{
+  struct ErrorManager
+  {
+    jpeg_error_mgr pub;
+    jmp_buf jumpBuffer;
+    char message[JMSG_LENGTH_MAX];
+  };
+  struct Destination
+  {
+    jpeg_destination_mgr pub;
+    std::vector<uint8_t> * buffer;
+  };
+
+  Impl()
+  {
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = &Impl::errorExit;
+    err.pub.output_message = &Impl::outputMessage;
+    err.message[0] = 0;
+    jpeg_create_compress(&cinfo);
+    dest.pub.init_destination = &Impl::initDestination;
+    dest.pub.empty_output_buffer = &Impl::emptyOutputBuffer;
+    dest.pub.term_destination = &Impl::termDestination;
+    dest.buffer = &buffer;
+    cinfo.dest = &dest.pub;
+  }
+  ~Impl() { jpeg_destroy_compress(&cinfo); }
+
+  // libjpeg calls this on fatal errors and must not return
+  static void errorExit(j_common_ptr cinfo)
+  {
+    ErrorManager * e = reinterpret_cast<ErrorManager *>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, e->message);
+    longjmp(e->jumpBuffer, 1);
+  }
+  // swallow warnings instead of printing them to stderr
+  static void outputMessage(j_common_ptr) {}
+
+  // The destination is a buffer that is kept between images, so it
+  // does not need to grow again for every image.
+  static void initDestination(j_compress_ptr cinfo)
+  {
+    Destination * d = reinterpret_cast<Destination *>(cinfo->dest);
+    if (d->buffer->size() < 65536) {
+      d->buffer->resize(65536);
+    }
+    d->pub.next_output_byte = d->buffer->data();
+    d->pub.free_in_buffer = d->buffer->size();
+  }
+  static boolean emptyOutputBuffer(j_compress_ptr cinfo)
+  {
+    // per libjpeg convention, the whole buffer is considered full here
+    Destination * d = reinterpret_cast<Destination *>(cinfo->dest);
+    const size_t oldSize = d->buffer->size();
+    d->buffer->resize(2 * oldSize);
+    d->pub.next_output_byte = d->buffer->data() + oldSize;
+    d->pub.free_in_buffer = d->buffer->size() - oldSize;
+    return (TRUE);
+  }
+  static void termDestination(j_compress_ptr) {}
+
+  jpeg_compress_struct cinfo;
+  ErrorManager err;
+  Destination dest;
+  std::vector<uint8_t> buffer;  // compressed data
+  std::vector<uint8_t> band;    // converted input rows
+};
+
+// whether libjpeg cannot read the rows directly
+static bool needs_conversion(JpegEncoder::InputType type)
+{
+#ifdef JCS_EXTENSIONS
+  return (type == JpegEncoder::BAYER);
+#else
+  return (type == JpegEncoder::BAYER || type == JpegEncoder::BGR);
+#endif
+}
+
+JpegEncoder::JpegEncoder() : impl_(new Impl()) {}
+
+JpegEncoder::~JpegEncoder() {}
+
+bool JpegEncoder::subsamplingFromString(
+  const std::string & s, Subsampling * sub)
+{
+  if (s == "444") {
+    *sub = S444;
+  } else if (s == "422") {
+    *sub = S422;
+  } else if (s == "420") {
+    *sub = S420;
+  } else if (s == "gray") {
+    *sub = GRAY;
+  } else {
+    return (false);
+  }
+  return (true);
+}
+
+std::string JpegEncoder::encode(
+  const Input & in, int quality, Subsampling sub, std::vector<uint8_t> * out)
+{
+  jpeg_compress_struct & cinfo = impl_->cinfo;
+  if (needs_conversion(in.type)) {
+    impl_->band.resize(BAND_ROWS * in.width * 3);
+  }
+  // no objects with destructors below this point, see errorExit()
+  if (setjmp(impl_->err.jumpBuffer)) {
+    jpeg_abort_compress(&cinfo);
+    return (std::string("jpeg encoding failed: ") + impl_->err.message);
+  }
+  // set after setjmp(), so longjmp() cannot clobber it
+  const bool convert = needs_conversion(in.type);
+  cinfo.image_width = in.width;
+  cinfo.image_height = in.height;
+  if (in.type == MONO) {
+    cinfo.input_components = 1;
+    cinfo.in_color_space = JCS_GRAYSCALE;
+  } else {
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+#ifdef JCS_EXTENSIONS
+    if (in.type == BGR) {
+      cinfo.in_color_space = JCS_EXT_BGR;
+    }
+#endif
+  }
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, quality, TRUE);
+  if (in.type == MONO || sub == GRAY) {
+    jpeg_set_colorspace(&cinfo, JCS_GRAYSCALE);
+  } else {
+    // luma sampling factors, chroma is always 1x1
+    cinfo.comp_info[0].h_samp_factor = (sub == S444) ? 1 : 2;
+    cinfo.comp_info[0].v_samp_factor = (sub == S420) ? 2 : 1;
+  }
+  jpeg_start_compress(&cinfo, TRUE);
+  JSAMPROW rows[BAND_ROWS];
+  while (cinfo.next_scanline < cinfo.image_height) {
+    const int y0 = cinfo.next_scanline;
+    const int n = std::min(BAND_ROWS, in.height - y0);
+    if (!convert) {
+      for (int i = 0; i < n; i++) {
+        rows[i] = const_cast<JSAMPROW>(in.data + (y0 + i) * in.step);
+      }
+    } else {
+      uint8_t * band = impl_->band.data();
+      const size_t bandStep = in.width * 3;
+      if (in.type == BAYER) {
+        demosaic_rows(
+          in.data, in.step, in.width, in.height, in.pattern,
+          DEMOSAIC_BILINEAR, false, band, bandStep, y0, y0 + n);
+      } else {  // BGR -> RGB
+        for (int i = 0; i < n; i++) {
+          const uint8_t * src = in.data + (y0 + i) * in.step;
+          uint8_t * dst = band + i * bandStep;
+          for (int x = 0; x < in.width; x++) {
+            dst[3 * x] = src[3 * x + 2];
+            dst[3 * x + 1] = src[3 * x + 1];
+            dst[3 * x + 2] = src[3 * x];
+          }
+        }
+      }
+      for (int i = 0; i < n; i++) {
+        rows[i] = band + i * bandStep;
+      }
+    }
+    jpeg_write_scanlines(&cinfo, rows, n);
+  }
+  jpeg_finish_compress(&cinfo);
+  const size_t size = impl_->buffer.size() - impl_->dest.pub.free_in_buffer;
+  out->assign(impl_->buffer.begin(), impl_->buffer.begin() + size);
+  return ("OK");
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,208 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/pixel_formats.h>
+
+#include <cstring>
+
+#include "simd.h"
+
+namespace flir_spinnaker_ros2
+{
+// clang-format off
+static const std::vector<PixelFormatInfo> pixel_formats = {
+  // name, ROS encoding, packed encoding, bits, packing, polarized
+  {"Mono8",           "mono8",        "mono8",              8,  PACKING_NONE},
+  {"Mono12p",         "mono16",       "mono12p",            12, PACKING_12P},
+  {"Mono12Packed",    "mono16",       "mono12packed",       12, PACKING_12PACKED},
+  {"Mono16",          "mono16",       "mono16",             16, PACKING_NONE},
+  {"BayerRG8",        "bayer_rggb8",  "bayer_rggb8",        8,  PACKING_NONE},
+  {"BayerGR8",        "bayer_grbg8",  "bayer_grbg8",        8,  PACKING_NONE},
+  {"BayerGB8",        "bayer_gbrg8",  "bayer_gbrg8",        8,  PACKING_NONE},
+  {"BayerBG8",        "bayer_bggr8",  "bayer_bggr8",        8,  PACKING_NONE},
+  {"BayerRG12p",      "bayer_rggb16", "bayer_rggb12p",      12, PACKING_12P},
+  {"BayerGR12p",      "bayer_grbg16", "bayer_grbg12p",      12, PACKING_12P},
+  {"BayerGB12p",      "bayer_gbrg16", "bayer_gbrg12p",      12, PACKING_12P},
+  {"BayerBG12p",      "bayer_bggr16", "bayer_bggr12p",      12, PACKING_12P},
+  {"BayerRG12Packed", "bayer_rggb16", "bayer_rggb12packed", 12, PACKING_12PACKED},
+  {"BayerGR12Packed", "bayer_grbg16", "bayer_grbg12packed", 12, PACKING_12PACKED},
+  {"BayerGB12Packed", "bayer_gbrg16", "bayer_gbrg12packed", 12, PACKING_12PACKED},
+  {"BayerBG12Packed", "bayer_bggr16", "bayer_bggr12packed", 12, PACKING_12PACKED},
+  {"BayerRG16",       "bayer_rggb16", "bayer_rggb16",       16, PACKING_NONE},
+  {"BayerGR16",       "bayer_grbg16", "bayer_grbg16",       16, PACKING_NONE},
+  {"BayerGB16",       "bayer_gbrg16", "bayer_gbrg16",       16, PACKING_NONE},
+  {"BayerBG16",       "bayer_bggr16", "bayer_bggr16",       16, PACKING_NONE},
+  {"RGB8",            "rgb8",         "rgb8",               24, PACKING_NONE},
+  {"RGB8Packed",      "rgb8",         "rgb8",               24, PACKING_NONE},
+  {"BGR8",            "bgr8",         "bgr8",               24, PACKING_NONE},
+  {"BGR8Packed",      "bgr8",         "bgr8",               24, PACKING_NONE},
+  {"Polarized8",      "mono8",        "mono8",              8,  PACKING_NONE, true},
+  {"Polarized12p",    "mono16",       "polarized12p",       12, PACKING_12P,  true},
+  {"Polarized16",     "mono16",       "mono16",             16, PACKING_NONE, true},
+};
+// clang-format on
+
+const PixelFormatInfo * find_pixel_format(const std::string & name)
+{
+  for (const auto & pf : pixel_formats) {
+    if (name == pf.name) {
+      return (&pf);
+    }
+  }
+  return (nullptr);
+}
+
+const std::vector<PixelFormatInfo> & get_pixel_formats()
+{
+  return (pixel_formats);
+}
+
+// Every pair of pixels occupies three bytes b0 b1 b2.
+// 12p:       p0 = b0 | (b1 & 0x0F) << 8,  p1 = b1 >> 4 | b2 << 4
+// 12Packed:  p0 = b0 << 4 | (b1 & 0x0F),  p1 = b2 << 4 | b1 >> 4
+static void unpack12_scalar(
+  const uint8_t * src, int x0, int width, Packing packing, uint16_t * dst)
+{
+  for (int x = x0; x < width; x++) {
+    const uint8_t * b = src + (x / 2) * 3;
+    if (packing == PACKING_12P) {
+      dst[x] = (x & 1) ? ((b[1] >> 4) | (b[2] << 4))
+                       : (b[0] | ((b[1] & 0x0F) << 8));
+    } else {
+      dst[x] = (x & 1) ? ((b[2] << 4) | (b[1] >> 4))
+                       : ((b[0] << 4) | (b[1] & 0x0F));
+    }
+  }
+}
+
+// Vectorized part of a row, returns the number of pixels done.
+static int unpack12_simd(
+  const uint8_t * src, int width, size_t rowBytes, Packing packing,
+  uint16_t * dst)
+{
+  int x = 0;
+#if defined(__SSSE3__)
+  // 12 bytes -> 8 pixels, but the load is 16 bytes wide
+  const __m128i shuffle =
+    (packing == PACKING_12P)
+      ? _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11)
+      : _mm_setr_epi8(1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11);
+  const __m128i even = _mm_set1_epi32(0x0000FFFF);
+  for (size_t i = 0; i + 16 <= rowBytes && x + 8 <= width; i += 12, x += 8) {
+    const __m128i v = _mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), shuffle);
+    const __m128i o = _mm_srli_epi16(v, 4);
+    const __m128i e =
+      (packing == PACKING_12P)
+        ? _mm_and_si128(v, _mm_set1_epi16(0x0FFF))
+        : _mm_or_si128(
+            _mm_and_si128(o, _mm_set1_epi16(0x0FF0)),
+            _mm_and_si128(v, _mm_set1_epi16(0x000F)));
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i *>(dst + x),
+      _mm_or_si128(_mm_and_si128(even, e), _mm_andnot_si128(even, o)));
+  }
+#elif defined(__SSE2__)
+  // 12 bytes -> 8 pixels without pshufb: each 3 byte pixel pair goes
+  // into a 32 bit lane, where shifts and masks split it
+  const __m128i oddLanes = _mm_set_epi32(-1, 0, -1, 0);
+  const __m128i first12 = _mm_set1_epi32(0x00000FFF);
+  const __m128i second12 = _mm_set1_epi32(0x0FFF0000);
+  for (size_t i = 0; i + 14 <= rowBytes && x + 8 <= width; i += 12, x += 8) {
+    // pairs 0 and 1 in the low half, 2 and 3 in the high half
+    const __m128i v = _mm_unpacklo_epi64(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)),
+      _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 6)));
+    // the odd lanes take bytes 3..6 of their half
+    const __m128i l = _mm_or_si128(
+      _mm_andnot_si128(oddLanes, v),
+      _mm_and_si128(oddLanes, _mm_slli_epi64(v, 8)));
+    // the second pixel is bits 12..23 of the lane in both packings
+    const __m128i p1 = _mm_and_si128(_mm_slli_epi32(l, 4), second12);
+    const __m128i p0 =
+      (packing == PACKING_12P)
+        ? _mm_and_si128(l, first12)
+        : _mm_or_si128(
+            _mm_and_si128(_mm_slli_epi32(l, 4), _mm_set1_epi32(0x0FF0)),
+            _mm_and_si128(_mm_srli_epi32(l, 8), _mm_set1_epi32(0x000F)));
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i *>(dst + x), _mm_or_si128(p0, p1));
+  }
+#elif defined(__ARM_NEON)
+  // 24 bytes -> 16 pixels
+  const uint8x8_t lowNibble = vdup_n_u8(0x0F);
+  for (size_t i = 0; i + 24 <= rowBytes && x + 16 <= width;
+       i += 24, x += 16) {
+    const uint8x8x3_t b = vld3_u8(src + i);
+    const uint8x8_t lo = vand_u8(b.val[1], lowNibble);
+    const uint8x8_t hi = vshr_n_u8(b.val[1], 4);
+    uint16x8x2_t p;
+    if (packing == PACKING_12P) {
+      p.val[0] = vorrq_u16(vmovl_u8(b.val[0]), vshlq_n_u16(vmovl_u8(lo), 8));
+      p.val[1] = vorrq_u16(vmovl_u8(hi), vshlq_n_u16(vmovl_u8(b.val[2]), 4));
+    } else {
+      p.val[0] = vorrq_u16(vshlq_n_u16(vmovl_u8(b.val[0]), 4), vmovl_u8(lo));
+      p.val[1] = vorrq_u16(vshlq_n_u16(vmovl_u8(b.val[2]), 4), vmovl_u8(hi));
+    }
+    vst2q_u16(dst + x, p);
+  }
+#else
+  (void)src;
+  (void)width;
+  (void)rowBytes;
+  (void)packing;
+  (void)dst;
+#endif
+  return (x);
+}
+
+void unpack12_rows(
+  const uint8_t * src, size_t srcStep, int width, Packing packing,
+  uint8_t * dst, size_t dstStep, int rowBegin, int rowEnd)
+{
+  const size_t rowBytes = (3 * static_cast<size_t>(width) + 1) / 2;
+  for (int y = rowBegin; y < rowEnd; y++) {
+    const uint8_t * s = src + y * srcStep;
+    // the output rows of a std::vector<uint8_t> message buffer are
+    // suitably aligned for 16 bit access
+    uint16_t * d = reinterpret_cast<uint16_t *>(dst + (y - rowBegin) * dstStep);
+    const int x = unpack12_simd(s, width, rowBytes, packing, d);
+    unpack12_scalar(s, x, width, packing, d);
+  }
+}
+
+void pack12_row(
+  const uint16_t * src, int width, Packing packing, uint8_t * dst)
+{
+  for (int x = 0; x < width; x += 2) {
+    const int p0 = src[x] & 0x0FFF;
+    const int p1 = (x + 1 < width) ? (src[x + 1] & 0x0FFF) : 0;
+    uint8_t * b = dst + (x / 2) * 3;
+    if (packing == PACKING_12P) {
+      b[0] = p0 & 0xFF;
+      b[1] = (p0 >> 8) | ((p1 & 0x0F) << 4);
+      if (x + 1 < width) {
+        b[2] = p1 >> 4;
+      }
+    } else {
+      b[0] = p0 >> 4;
+      b[1] = (p0 & 0x0F) | ((p1 & 0x0F) << 4);
+      if (x + 1 < width) {
+        b[2] = p1 >> 4;
+      }
+    }
+  }
+}
+}  // namespace flir_spinnaker_ros2
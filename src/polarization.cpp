@@ -0,0 +1,319 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/polarization.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd.h"
+
+namespace flir_spinnaker_ros2
+{
+namespace
+{
+// Splits the first 2 * w values of a row into the even and odd ones,
+// unit is the number of bytes per value (1 or 2). Either output may be
+// nullptr.
+void split_row(
+  const uint8_t * src, int w, int unit, uint8_t * even, uint8_t * odd)
+{
+  using namespace simd;
+  int x = 0;  // output value
+  const int perVector = simd::width / unit;
+  for (; x + perVector <= w; x += perVector) {
+    const uint8_t * s = src + 2 * x * unit;
+    u8v e, o;
+    if (unit == 1) {
+      deinterleave8(load(s), load(s + simd::width), &e, &o);
+    } else {
+      deinterleave16(load(s), load(s + simd::width), &e, &o);
+    }
+    if (even) {
+      store(even + x * unit, e);
+    }
+    if (odd) {
+      store(odd + x * unit, o);
+    }
+  }
+  for (; x < w; x++) {
+    if (even) {
+      std::memcpy(even + x * unit, src + 2 * x * unit, unit);
+    }
+    if (odd) {
+      std::memcpy(odd + x * unit, src + (2 * x + 1) * unit, unit);
+    }
+  }
+}
+
+// Polynomial atan on [0, 1], to within about 1e-5, followed by the
+// octant corrections. The vector versions below do the same.
+const float PI = 3.14159265f;
+const float C1 = -0.0464964749f;
+const float C2 = 0.15931422f;
+const float C3 = -0.327622764f;
+
+inline float fast_atan2(float y, float x)
+{
+  const float ax = std::abs(x);
+  const float ay = std::abs(y);
+  const float a = std::min(ax, ay) / std::max(std::max(ax, ay), 1e-20f);
+  const float s = a * a;
+  float r = ((C1 * s + C2) * s + C3) * s * a + a;
+  r = ay > ax ? 0.5f * PI - r : r;
+  r = x < 0 ? PI - r : r;
+  return (y < 0 ? -r : r);
+}
+
+// DoLP and AoLP (0..255) of one 2x2 block
+inline void stokes(
+  float i0, float i45, float i90, float i135, uint8_t * dolp, uint8_t * aolp)
+{
+  const float s0 = 0.5f * (i0 + i45 + i90 + i135);
+  const float s1 = i0 - i90;
+  const float s2 = i45 - i135;
+  if (dolp) {
+    const float d = std::sqrt(s1 * s1 + s2 * s2) / std::max(s0, 1.0f);
+    *dolp = static_cast<uint8_t>(std::min(d, 1.0f) * 255.0f + 0.5f);
+  }
+  if (aolp) {
+    // AoLP = atan2(s2, s1) / 2, in [0, pi)
+    float a = fast_atan2(s2, s1);
+    a = a < 0 ? a + 2 * PI : a;
+    *aolp = static_cast<uint8_t>(std::min(a * (128.0f / PI), 255.0f));
+  }
+}
+
+#if defined(__SSE2__)
+// even and odd values of 8 values, as floats
+inline void load_split(__m128i v, __m128 * even, __m128 * odd)
+{
+  const __m128i z = _mm_setzero_si128();
+  const __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, z));
+  const __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, z));
+  *even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+  *odd = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+}
+inline void load_split(const uint8_t * p, __m128 * even, __m128 * odd)
+{
+  load_split(
+    _mm_unpacklo_epi8(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)),
+      _mm_setzero_si128()),
+    even, odd);
+}
+inline void load_split(const uint16_t * p, __m128 * even, __m128 * odd)
+{
+  load_split(
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), even, odd);
+}
+// mask ? a : b
+inline __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+  return (_mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)));
+}
+// stores 4 values in 0..255 as bytes
+inline void store4(uint8_t * p, __m128 v)
+{
+  const __m128i i = _mm_cvttps_epi32(v);
+  const __m128i b =
+    _mm_packus_epi16(_mm_packs_epi32(i, i), _mm_setzero_si128());
+  const int32_t w = _mm_cvtsi128_si32(b);
+  std::memcpy(p, &w, 4);
+}
+inline __m128 fast_atan2_ps(__m128 y, __m128 x)
+{
+  const __m128 signBit = _mm_set1_ps(-0.0f);
+  const __m128 ax = _mm_andnot_ps(signBit, x);
+  const __m128 ay = _mm_andnot_ps(signBit, y);
+  const __m128 a = _mm_div_ps(
+    _mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-20f)));
+  const __m128 s = _mm_mul_ps(a, a);
+  __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(C1), s), _mm_set1_ps(C2));
+  r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(C3));
+  r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+  r = select_ps(
+    _mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(0.5f * PI), r), r);
+  r = select_ps(
+    _mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(PI), r), r);
+  return (_mm_xor_ps(r, _mm_and_ps(y, signBit)));  // y < 0: -r
+}
+// blocks [0, w) as far as vectorized, returns the first block not done
+template <typename T>
+int stokes_simd(
+  const T * r0, const T * r1, int w, uint8_t * dolp, uint8_t * aolp)
+{
+  int x = 0;
+  for (; x + 4 <= w; x += 4) {
+    __m128 i90, i45, i135, i0;
+    load_split(r0 + 2 * x, &i90, &i45);
+    load_split(r1 + 2 * x, &i135, &i0);
+    const __m128 s1 = _mm_sub_ps(i0, i90);
+    const __m128 s2 = _mm_sub_ps(i45, i135);
+    if (dolp) {
+      const __m128 s0 = _mm_mul_ps(
+        _mm_set1_ps(0.5f),
+        _mm_add_ps(_mm_add_ps(i0, i45), _mm_add_ps(i90, i135)));
+      const __m128 d = _mm_div_ps(
+        _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(s1, s1), _mm_mul_ps(s2, s2))),
+        _mm_max_ps(s0, _mm_set1_ps(1.0f)));
+      store4(
+        dolp + x,
+        _mm_add_ps(
+          _mm_mul_ps(_mm_min_ps(d, _mm_set1_ps(1.0f)), _mm_set1_ps(255.0f)),
+          _mm_set1_ps(0.5f)));
+    }
+    if (aolp) {
+      __m128 a = fast_atan2_ps(s2, s1);
+      a = _mm_add_ps(
+        a, _mm_and_ps(
+             _mm_cmplt_ps(a, _mm_setzero_ps()), _mm_set1_ps(2 * PI)));
+      store4(
+        aolp + x, _mm_min_ps(
+                    _mm_mul_ps(a, _mm_set1_ps(128.0f / PI)),
+                    _mm_set1_ps(255.0f)));
+    }
+  }
+  return (x);
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// even and odd values of 8 values, as floats
+inline void load_split(uint16x8_t v, float32x4_t * even, float32x4_t * odd)
+{
+  const uint16x4x2_t u = vuzp_u16(vget_low_u16(v), vget_high_u16(v));
+  *even = vcvtq_f32_u32(vmovl_u16(u.val[0]));
+  *odd = vcvtq_f32_u32(vmovl_u16(u.val[1]));
+}
+inline void load_split(
+  const uint8_t * p, float32x4_t * even, float32x4_t * odd)
+{
+  load_split(vmovl_u8(vld1_u8(p)), even, odd);
+}
+inline void load_split(
+  const uint16_t * p, float32x4_t * even, float32x4_t * odd)
+{
+  load_split(vld1q_u16(p), even, odd);
+}
+// stores 4 values in 0..255 as bytes
+inline void store4(uint8_t * p, float32x4_t v)
+{
+  const uint16x4_t h = vmovn_u32(vcvtq_u32_f32(v));
+  const uint8x8_t b = vmovn_u16(vcombine_u16(h, h));
+  const uint32_t w = vget_lane_u32(vreinterpret_u32_u8(b), 0);
+  std::memcpy(p, &w, 4);
+}
+inline float32x4_t fast_atan2_ps(float32x4_t y, float32x4_t x)
+{
+  const float32x4_t ax = vabsq_f32(x);
+  const float32x4_t ay = vabsq_f32(y);
+  const float32x4_t a = vdivq_f32(
+    vminq_f32(ax, ay), vmaxq_f32(vmaxq_f32(ax, ay), vdupq_n_f32(1e-20f)));
+  const float32x4_t s = vmulq_f32(a, a);
+  float32x4_t r = vmlaq_f32(vdupq_n_f32(C2), vdupq_n_f32(C1), s);
+  r = vmlaq_f32(vdupq_n_f32(C3), r, s);
+  r = vmlaq_f32(a, vmulq_f32(r, s), a);
+  r = vbslq_f32(vcgtq_f32(ay, ax), vsubq_f32(vdupq_n_f32(0.5f * PI), r), r);
+  r = vbslq_f32(
+    vcltq_f32(x, vdupq_n_f32(0)), vsubq_f32(vdupq_n_f32(PI), r), r);
+  return (vbslq_f32(vcltq_f32(y, vdupq_n_f32(0)), vnegq_f32(r), r));
+}
+template <typename T>
+int stokes_simd(
+  const T * r0, const T * r1, int w, uint8_t * dolp, uint8_t * aolp)
+{
+  int x = 0;
+  for (; x + 4 <= w; x += 4) {
+    float32x4_t i90, i45, i135, i0;
+    load_split(r0 + 2 * x, &i90, &i45);
+    load_split(r1 + 2 * x, &i135, &i0);
+    const float32x4_t s1 = vsubq_f32(i0, i90);
+    const float32x4_t s2 = vsubq_f32(i45, i135);
+    if (dolp) {
+      const float32x4_t s0 = vmulq_n_f32(
+        vaddq_f32(vaddq_f32(i0, i45), vaddq_f32(i90, i135)), 0.5f);
+      const float32x4_t d = vdivq_f32(
+        vsqrtq_f32(vmlaq_f32(vmulq_f32(s1, s1), s2, s2)),
+        vmaxq_f32(s0, vdupq_n_f32(1.0f)));
+      store4(
+        dolp + x, vmlaq_n_f32(
+                    vdupq_n_f32(0.5f), vminq_f32(d, vdupq_n_f32(1.0f)),
+                    255.0f));
+    }
+    if (aolp) {
+      float32x4_t a = fast_atan2_ps(s2, s1);
+      a = vbslq_f32(
+        vcltq_f32(a, vdupq_n_f32(0)), vaddq_f32(a, vdupq_n_f32(2 * PI)), a);
+      store4(
+        aolp + x,
+        vminq_f32(vmulq_n_f32(a, 128.0f / PI), vdupq_n_f32(255.0f)));
+    }
+  }
+  return (x);
+}
+#else
+template <typename T>
+int stokes_simd(const T *, const T *, int, uint8_t *, uint8_t *)
+{
+  return (0);
+}
+#endif
+
+// DoLP and AoLP of the 2x2 blocks of a pair of rows
+template <typename T>
+void stokes_row(
+  const T * r0, const T * r1, int w, uint8_t * dolp, uint8_t * aolp)
+{
+  for (int x = stokes_simd(r0, r1, w, dolp, aolp); x < w; x++) {
+    stokes(
+      r1[2 * x + 1], r0[2 * x + 1], r0[2 * x], r1[2 * x],
+      dolp ? dolp + x : nullptr, aolp ? aolp + x : nullptr);
+  }
+}
+}  // namespace
+
+void polarization_rows(
+  const uint8_t * src, size_t srcStep, int width, int bytesPerValue,
+  uint8_t * const dst[POL_NUM_OUTPUTS], int rowBegin, int rowEnd)
+{
+  const int w = width / 2;
+  const size_t angleStep = static_cast<size_t>(w) * bytesPerValue;
+  auto row = [&](int i, size_t step, int y) {
+    return (dst[i] ? dst[i] + y * step : nullptr);
+  };
+  for (int y = rowBegin; y < rowEnd; y++) {
+    const uint8_t * r0 = src + 2 * y * srcStep;
+    const uint8_t * r1 = r0 + srcStep;
+    split_row(
+      r0, w, bytesPerValue, row(POL_ANGLE_90, angleStep, y),
+      row(POL_ANGLE_45, angleStep, y));
+    split_row(
+      r1, w, bytesPerValue, row(POL_ANGLE_135, angleStep, y),
+      row(POL_ANGLE_0, angleStep, y));
+    uint8_t * dolp = row(POL_DOLP, w, y);
+    uint8_t * aolp = row(POL_AOLP, w, y);
+    if (!dolp && !aolp) {
+      continue;
+    }
+    if (bytesPerValue == 1) {
+      stokes_row(r0, r1, w, dolp, aolp);
+    } else {
+      stokes_row(
+        reinterpret_cast<const uint16_t *>(r0),
+        reinterpret_cast<const uint16_t *>(r1), w, dolp, aolp);
+    }
+  }
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,210 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/raw_compressor.h>
+#include <zstd.h>
+
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include "simd.h"
+
+namespace flir_spinnaker_ros2
+{
+namespace
+{
+// Splits one row into its even and odd pixels. unit is the number of
+// bytes per pixel (1 or 2 for vectorization, anything for the tail).
+void split_row(
+  const uint8_t * src, int width, int unit, uint8_t * even, uint8_t * odd)
+{
+  using namespace simd;
+  const int rowBytes = width * unit;
+  int i = 0;  // input byte index
+  if (unit == 1 || unit == 2) {
+    for (; i + 2 * simd::width <= rowBytes; i += 2 * simd::width) {
+      u8v e, o;
+      if (unit == 1) {
+        deinterleave8(load(src + i), load(src + i + simd::width), &e, &o);
+      } else {
+        deinterleave16(load(src + i), load(src + i + simd::width), &e, &o);
+      }
+      store(even + i / 2, e);
+      store(odd + i / 2, o);
+    }
+  }
+  for (int x = i / unit; x < width; x++) {
+    uint8_t * dst = ((x & 1) ? odd : even) + (x / 2) * unit;
+    std::memcpy(dst, src + x * unit, unit);
+  }
+}
+
+void merge_row(
+  const uint8_t * even, const uint8_t * odd, int width, int unit,
+  uint8_t * dst)
+{
+  for (int x = 0; x < width; x++) {
+    const uint8_t * src = ((x & 1) ? odd : even) + (x / 2) * unit;
+    std::memcpy(dst + x * unit, src, unit);
+  }
+}
+
+// limits for images restored from a format string
+const int MAX_DIMENSION = 1 << 16;
+const int MAX_BYTES_PER_PIXEL = 32;  // 64FC4
+
+// plane p holds the pixels at row parity p / 2, column parity p % 2
+uint8_t * plane_row(uint8_t * base, int width, int height, int unit, int y)
+{
+  const size_t planeSize = (width / 2) * (height / 2) * unit;
+  const size_t rowBytes = (width / 2) * unit;
+  return (base + (y & 1) * 2 * planeSize + (y / 2) * rowBytes);
+}
+}  // namespace
+
+RawCompressor::RawCompressor() : context_(ZSTD_createCCtx()) {}
+
+RawCompressor::~RawCompressor()
+{
+  ZSTD_freeCCtx(static_cast<ZSTD_CCtx *>(context_));
+}
+
+std::string RawCompressor::compress(
+  const Input & in, int level, std::vector<uint8_t> * out,
+  std::string * format)
+{
+  if (!context_) {
+    return ("cannot create zstd context");
+  }
+  const int unit = in.bytesPerPixel;
+  const size_t rowBytes = in.width * unit;
+  const size_t size = rowBytes * in.height;
+  const bool split =
+    in.bayerSplit && in.width % 2 == 0 && in.height % 2 == 0;
+  const uint8_t * src = in.data;
+  if (split) {
+    packed_.resize(size);
+    const size_t planeSize = (in.width / 2) * (in.height / 2) * unit;
+    for (int y = 0; y < in.height; y++) {
+      uint8_t * even = plane_row(&packed_[0], in.width, in.height, unit, y);
+      split_row(
+        in.data + y * in.step, in.width, unit, even, even + planeSize);
+    }
+    src = &packed_[0];
+  } else if (in.step != rowBytes) {
+    // drop the row padding
+    packed_.resize(size);
+    for (int y = 0; y < in.height; y++) {
+      std::memcpy(&packed_[y * rowBytes], in.data + y * in.step, rowBytes);
+    }
+    src = &packed_[0];
+  }
+  // compress straight into the message, then trim it
+  out->resize(ZSTD_compressBound(size));
+  const size_t ret = ZSTD_compressCCtx(
+    static_cast<ZSTD_CCtx *>(context_), out->data(), out->size(), src, size,
+    level);
+  if (ZSTD_isError(ret)) {
+    out->clear();
+    return (std::string("zstd compression failed: ") + ZSTD_getErrorName(ret));
+  }
+  out->resize(ret);
+  std::stringstream ss;
+  ss << in.encoding << "; zstd; width=" << in.width
+     << " height=" << in.height << " bytes_per_pixel=" << unit
+     << " split=" << (split ? 1 : 0);
+  *format = ss.str();
+  return ("OK");
+}
+
+std::string RawCompressor::decompress(
+  const std::string & format, const std::vector<uint8_t> & compressed,
+  std::string * encoding, int * width, int * height, int * bytesPerPixel,
+  std::vector<uint8_t> * data)
+{
+  const size_t sep = format.find("; zstd; ");
+  if (sep == std::string::npos) {
+    return ("not a zstd compressed raw image: " + format);
+  }
+  *encoding = format.substr(0, sep);
+  *width = 0;
+  *height = 0;
+  *bytesPerPixel = 1;
+  std::istringstream iss(format.substr(sep + 8));
+  int split = 0;
+  std::string token;
+  while (iss >> token) {
+    const size_t eq = token.find('=');
+    if (eq == std::string::npos) {
+      return ("bad format token: " + token);
+    }
+    const std::string key = token.substr(0, eq);
+    int value = 0;
+    if (!(std::istringstream(token.substr(eq + 1)) >> value)) {
+      return ("bad format token: " + token);
+    }
+    if (key == "width") {
+      *width = value;
+    } else if (key == "height") {
+      *height = value;
+    } else if (key == "bytes_per_pixel") {
+      *bytesPerPixel = value;
+    } else if (key == "split") {
+      split = value;
+    }
+  }
+  // the format comes from the message, so do not trust it
+  const int unit = *bytesPerPixel;
+  if (
+    *width <= 0 || *height <= 0 || unit <= 0 || *width > MAX_DIMENSION ||
+    *height > MAX_DIMENSION || unit > MAX_BYTES_PER_PIXEL) {
+    return ("bad image size in format: " + format);
+  }
+  if (
+    static_cast<size_t>(*width) >
+    std::numeric_limits<size_t>::max() / *height / unit) {
+    return ("image size overflows in format: " + format);
+  }
+  if (split != 0 && (split != 1 || *width % 2 != 0 || *height % 2 != 0)) {
+    return ("bad split in format: " + format);
+  }
+  const size_t size = static_cast<size_t>(*width) * *height * unit;
+  // check before allocating, compress() always records the size
+  const auto contentSize =
+    ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+  if (contentSize != size) {
+    return ("compressed size does not match the format: " + format);
+  }
+  std::vector<uint8_t> buf(size);
+  const size_t ret =
+    ZSTD_decompress(&buf[0], size, compressed.data(), compressed.size());
+  if (ZSTD_isError(ret) || ret != size) {
+    return ("zstd decompression failed");
+  }
+  if (!split) {
+    data->swap(buf);
+    return ("OK");
+  }
+  data->resize(size);
+  const size_t planeSize = (*width / 2) * (*height / 2) * unit;
+  for (int y = 0; y < *height; y++) {
+    const uint8_t * even = plane_row(&buf[0], *width, *height, unit, y);
+    merge_row(
+      even, even + planeSize, *width, unit, &(*data)[y * *width * unit]);
+  }
+  return ("OK");
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,221 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/rectify.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd.h"
+
+namespace flir_spinnaker_ros2
+{
+static const int FRAC = 64;  // fixed point scale of the weights
+
+static bool is_zero(const double * m, int n)
+{
+  for (int i = 0; i < n; i++) {
+    if (m[i] != 0) {
+      return (false);
+    }
+  }
+  return (true);
+}
+
+// c = a * b for 3x3 matrices
+static void mul3(const double * a, const double * b, double * c)
+{
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      c[3 * i + j] = a[3 * i] * b[j] + a[3 * i + 1] * b[3 + j] +
+                     a[3 * i + 2] * b[6 + j];
+    }
+  }
+}
+
+static bool invert3(const double * m, double * inv)
+{
+  const double c0 = m[4] * m[8] - m[5] * m[7];
+  const double c1 = m[5] * m[6] - m[3] * m[8];
+  const double c2 = m[3] * m[7] - m[4] * m[6];
+  const double det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+  if (std::abs(det) < 1e-12) {
+    return (false);
+  }
+  const double s = 1.0 / det;
+  inv[0] = c0 * s;
+  inv[1] = (m[2] * m[7] - m[1] * m[8]) * s;
+  inv[2] = (m[1] * m[5] - m[2] * m[4]) * s;
+  inv[3] = c1 * s;
+  inv[4] = (m[0] * m[8] - m[2] * m[6]) * s;
+  inv[5] = (m[2] * m[3] - m[0] * m[5]) * s;
+  inv[6] = c2 * s;
+  inv[7] = (m[1] * m[6] - m[0] * m[7]) * s;
+  inv[8] = (m[0] * m[4] - m[1] * m[3]) * s;
+  return (true);
+}
+
+std::string RectifyMap::init(
+  const std::string & distortionModel, const double * K,
+  const std::vector<double> & D, const double * R, const double * P,
+  int width, int height)
+{
+  if (width < 2 || height < 2 || width > 32767 || height > 32767) {
+    return ("unsupported image size for rectification");
+  }
+  if (is_zero(K, 9)) {
+    return ("camera is not calibrated");
+  }
+  size_t maxCoeffs = 0;
+  if (distortionModel == "plumb_bob") {
+    maxCoeffs = 5;
+  } else if (distortionModel == "rational_polynomial") {
+    maxCoeffs = 8;
+  } else if (!D.empty()) {
+    return ("unsupported distortion model: " + distortionModel);
+  }
+  if (D.size() > maxCoeffs) {
+    return ("too many distortion coefficients for " + distortionModel);
+  }
+  std::fill(D_, D_ + 8, 0.0);
+  std::copy(D.begin(), D.end(), D_);
+  std::copy(K, K + 9, K_);
+  const double identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  const double * r = is_zero(R, 9) ? identity : R;
+  double newK[9];
+  if (is_zero(P, 12)) {
+    std::copy(K, K + 9, newK);
+  } else {
+    for (int i = 0; i < 3; i++) {
+      std::copy(P + 4 * i, P + 4 * i + 3, newK + 3 * i);
+    }
+  }
+  double PR[9];
+  mul3(newK, r, PR);
+  if (!invert3(PR, iPR_)) {
+    return ("projection matrix is singular");
+  }
+  width_ = width;
+  height_ = height;
+  table_.resize(static_cast<size_t>(width) * height);
+  return ("OK");
+}
+
+void RectifyMap::buildRows(int rowBegin, int rowEnd)
+{
+  const double * d = D_;
+  for (int v = rowBegin; v < rowEnd; v++) {
+    Entry * e = &table_[static_cast<size_t>(v) * width_];
+    for (int u = 0; u < width_; u++, e++) {
+      // ray in the unrectified camera frame
+      const double X = iPR_[0] * u + iPR_[1] * v + iPR_[2];
+      const double Y = iPR_[3] * u + iPR_[4] * v + iPR_[5];
+      const double W = iPR_[6] * u + iPR_[7] * v + iPR_[8];
+      const double x = X / W;
+      const double y = Y / W;
+      const double r2 = x * x + y * y;
+      const double kr = (1 + ((d[4] * r2 + d[1]) * r2 + d[0]) * r2) /
+                        (1 + ((d[7] * r2 + d[6]) * r2 + d[5]) * r2);
+      const double xd =
+        x * kr + 2 * d[2] * x * y + d[3] * (r2 + 2 * x * x);
+      const double yd =
+        y * kr + d[2] * (r2 + 2 * y * y) + 2 * d[3] * x * y;
+      const double sx = K_[0] * xd + K_[1] * yd + K_[2];
+      const double sy = K_[4] * yd + K_[5];
+      if (
+        !(sx >= -0.5 && sy >= -0.5 && sx <= width_ - 0.5 &&
+          sy <= height_ - 0.5)) {
+        *e = Entry{-1, 0, 0, 0};
+        continue;
+      }
+      // the last row and column interpolate with full weight on the
+      // far neighbor, so both neighbors always exist
+      const int x0 = std::min(std::max(static_cast<int>(sx), 0), width_ - 2);
+      const int y0 = std::min(std::max(static_cast<int>(sy), 0), height_ - 2);
+      const int wx = static_cast<int>(std::lround((sx - x0) * FRAC));
+      const int wy = static_cast<int>(std::lround((sy - y0) * FRAC));
+      e->x = static_cast<int16_t>(x0);
+      e->y = static_cast<int16_t>(y0);
+      e->wx = static_cast<uint8_t>(std::min(std::max(wx, 0), FRAC));
+      e->wy = static_cast<uint8_t>(std::min(std::max(wy, 0), FRAC));
+    }
+  }
+}
+
+// The four neighbors and the weights are gathered into small contiguous
+// buffers first, then interpolated a vector at a time. The number of
+// channels must be a compile time constant, or else the compiler turns
+// the inner loops into library calls.
+template <int CH, typename Entry>
+static void remap_rows(
+  const Entry * table, int width, const uint8_t * src, size_t srcStep,
+  uint8_t * dst, size_t dstStep, int rowBegin, int rowEnd)
+{
+  using namespace simd;
+  const int chunk = simd::width;  // pixels per chunk
+  uint8_t p00[CH * chunk], p01[CH * chunk], p10[CH * chunk], p11[CH * chunk];
+  uint8_t wx[CH * chunk], wy[CH * chunk], out[CH * chunk];
+  for (int v = rowBegin; v < rowEnd; v++) {
+    const Entry * row = table + static_cast<size_t>(v) * width;
+    uint8_t * d = dst + (v - rowBegin) * dstStep;
+    for (int u0 = 0; u0 < width; u0 += chunk) {
+      const int n = std::min(chunk, width - u0);
+      for (int i = 0; i < n; i++) {
+        const Entry e = row[u0 + i];
+        // pixels outside of the source image read the top left pixel
+        // with zero weight and then get masked
+        const uint8_t * s =
+          src + (e.x < 0 ? 0 : e.y * srcStep + e.x * CH);
+        const uint8_t * s1 = s + srcStep;
+        const uint8_t mask = (e.x < 0) ? 0 : 0xFF;
+        for (int c = 0; c < CH; c++) {
+          const int k = i * CH + c;
+          p00[k] = s[c] & mask;
+          p01[k] = s[c + CH] & mask;
+          p10[k] = s1[c] & mask;
+          p11[k] = s1[c + CH] & mask;
+          wx[k] = e.wx;
+          wy[k] = e.wy;
+        }
+      }
+      const int bytes = n * CH;
+      uint8_t * o = (n == chunk) ? d + u0 * CH : out;
+      for (int k = 0; k < bytes; k += simd::width) {
+        const u8v vx = load(wx + k);
+        const u8v top = lerp(load(p00 + k), load(p01 + k), vx);
+        const u8v bottom = lerp(load(p10 + k), load(p11 + k), vx);
+        store(o + k, lerp(top, bottom, load(wy + k)));
+      }
+      if (o == out) {
+        std::memcpy(d + u0 * CH, out, bytes);
+      }
+    }
+  }
+}
+
+void RectifyMap::remapRows(
+  const uint8_t * src, size_t srcStep, int channels, uint8_t * dst,
+  size_t dstStep, int rowBegin, int rowEnd) const
+{
+  if (channels == 1) {
+    remap_rows<1>(
+      table_.data(), width_, src, srcStep, dst, dstStep, rowBegin, rowEnd);
+  } else {
+    remap_rows<3>(
+      table_.data(), width_, src, srcStep, dst, dstStep, rowBegin, rowEnd);
+  }
+}
+}  // namespace flir_spinnaker_ros2
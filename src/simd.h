@@ -0,0 +1,571 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+//
+// Minimal set of unsigned 8-bit vector operations used by the image
+// kernels. Maps to AVX2 or SSE2 on x86, NEON on ARM, and plain loops
+// everywhere else. AVX2 and SSSE3 are only used when the compiler
+// targets them (see the FLIR_SPINNAKER_ROS2_NATIVE_ARCH cmake option).
+//
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace flir_spinnaker_ros2
+{
+namespace simd
+{
+#if defined(__AVX2__)
+static const int width = 32;
+typedef __m256i u8v;
+inline u8v load(const uint8_t * p)
+{
+  return (_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+}
+inline void store(uint8_t * p, u8v v)
+{
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+}
+inline u8v splat(uint8_t c)
+{
+  return (_mm256_set1_epi8(static_cast<char>(c)));
+}
+// rounds up, i.e. (a + b + 1) / 2
+inline u8v avg(u8v a, u8v b) { return (_mm256_avg_epu8(a, b)); }
+inline u8v absdiff(u8v a, u8v b)
+{
+  return (_mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a)));
+}
+inline u8v min(u8v a, u8v b) { return (_mm256_min_epu8(a, b)); }
+inline u8v max(u8v a, u8v b) { return (_mm256_max_epu8(a, b)); }
+inline u8v adds(u8v a, u8v b) { return (_mm256_adds_epu8(a, b)); }
+inline u8v subs(u8v a, u8v b) { return (_mm256_subs_epu8(a, b)); }
+// all ones where a > b
+inline u8v gt(u8v a, u8v b)
+{
+  return (_mm256_xor_si256(
+    _mm256_cmpeq_epi8(_mm256_subs_epu8(a, b), _mm256_setzero_si256()),
+    _mm256_set1_epi8(-1)));
+}
+// mask ? a : b
+inline u8v select(u8v mask, u8v a, u8v b)
+{
+  return (_mm256_blendv_epi8(b, a, mask));
+}
+// splits the bytes of a, b (in that order) into even and odd ones
+inline void deinterleave8(u8v a, u8v b, u8v * even, u8v * odd)
+{
+  const __m256i m = _mm256_set1_epi16(0x00FF);
+  // pack works within 128 bit lanes, the permute restores the order
+  *even = _mm256_permute4x64_epi64(
+    _mm256_packus_epi16(_mm256_and_si256(a, m), _mm256_and_si256(b, m)),
+    0xD8);
+  *odd = _mm256_permute4x64_epi64(
+    _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)),
+    0xD8);
+}
+// same for pairs of bytes
+inline void deinterleave16(u8v a, u8v b, u8v * even, u8v * odd)
+{
+  const __m256i m = _mm256_set1_epi32(0x0000FFFF);
+  *even = _mm256_permute4x64_epi64(
+    _mm256_packus_epi32(_mm256_and_si256(a, m), _mm256_and_si256(b, m)),
+    0xD8);
+  *odd = _mm256_permute4x64_epi64(
+    _mm256_packus_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16)),
+    0xD8);
+}
+#elif defined(__SSE2__)
+static const int width = 16;
+typedef __m128i u8v;
+inline u8v load(const uint8_t * p)
+{
+  return (_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+inline void store(uint8_t * p, u8v v)
+{
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+inline u8v splat(uint8_t c) { return (_mm_set1_epi8(static_cast<char>(c))); }
+inline u8v avg(u8v a, u8v b) { return (_mm_avg_epu8(a, b)); }
+inline u8v absdiff(u8v a, u8v b)
+{
+  return (_mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)));
+}
+inline u8v min(u8v a, u8v b) { return (_mm_min_epu8(a, b)); }
+inline u8v max(u8v a, u8v b) { return (_mm_max_epu8(a, b)); }
+inline u8v adds(u8v a, u8v b) { return (_mm_adds_epu8(a, b)); }
+inline u8v subs(u8v a, u8v b) { return (_mm_subs_epu8(a, b)); }
+inline u8v gt(u8v a, u8v b)
+{
+  return (_mm_xor_si128(
+    _mm_cmpeq_epi8(_mm_subs_epu8(a, b), _mm_setzero_si128()),
+    _mm_set1_epi8(-1)));
+}
+inline u8v select(u8v mask, u8v a, u8v b)
+{
+  return (_mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)));
+}
+inline void deinterleave8(u8v a, u8v b, u8v * even, u8v * odd)
+{
+  const __m128i m = _mm_set1_epi16(0x00FF);
+  *even = _mm_packus_epi16(_mm_and_si128(a, m), _mm_and_si128(b, m));
+  *odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+inline void deinterleave16(u8v a, u8v b, u8v * even, u8v * odd)
+{
+  // SSE2 only has a signed 32 -> 16 bit pack, so sign extend first
+  *even = _mm_packs_epi32(
+    _mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+    _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+  *odd = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+}
+#elif defined(__ARM_NEON)
+static const int width = 16;
+typedef uint8x16_t u8v;
+inline u8v load(const uint8_t * p) { return (vld1q_u8(p)); }
+inline void store(uint8_t * p, u8v v) { vst1q_u8(p, v); }
+inline u8v splat(uint8_t c) { return (vdupq_n_u8(c)); }
+inline u8v avg(u8v a, u8v b) { return (vrhaddq_u8(a, b)); }
+inline u8v absdiff(u8v a, u8v b) { return (vabdq_u8(a, b)); }
+inline u8v min(u8v a, u8v b) { return (vminq_u8(a, b)); }
+inline u8v max(u8v a, u8v b) { return (vmaxq_u8(a, b)); }
+inline u8v adds(u8v a, u8v b) { return (vqaddq_u8(a, b)); }
+inline u8v subs(u8v a, u8v b) { return (vqsubq_u8(a, b)); }
+inline u8v gt(u8v a, u8v b) { return (vcgtq_u8(a, b)); }
+inline u8v select(u8v mask, u8v a, u8v b) { return (vbslq_u8(mask, a, b)); }
+inline void deinterleave8(u8v a, u8v b, u8v * even, u8v * odd)
+{
+  const uint8x16x2_t r = vuzpq_u8(a, b);
+  *even = r.val[0];
+  *odd = r.val[1];
+}
+inline void deinterleave16(u8v a, u8v b, u8v * even, u8v * odd)
+{
+  const uint16x8x2_t r =
+    vuzpq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b));
+  *even = vreinterpretq_u8_u16(r.val[0]);
+  *odd = vreinterpretq_u8_u16(r.val[1]);
+}
+#else
+static const int width = 16;
+struct u8v
+{
+  uint8_t v[16];
+};
+inline u8v load(const uint8_t * p)
+{
+  u8v r;
+  for (int i = 0; i < width; i++) {
+    r.v[i] = p[i];
+  }
+  return (r);
+}
+inline void store(uint8_t * p, u8v a)
+{
+  for (int i = 0; i < width; i++) {
+    p[i] = a.v[i];
+  }
+}
+inline u8v splat(uint8_t c)
+{
+  u8v r;
+  for (int i = 0; i < width; i++) {
+    r.v[i] = c;
+  }
+  return (r);
+}
+#define SIMD_SCALAR_OP(name, expr)    \
+  inline u8v name(u8v a, u8v b)       \
+  {                                   \
+    u8v r;                            \
+    for (int i = 0; i < width; i++) { \
+      const int x = a.v[i];           \
+      const int y = b.v[i];           \
+      r.v[i] = (expr);                \
+    }                                 \
+    return (r);                       \
+  }
+SIMD_SCALAR_OP(avg, (x + y + 1) >> 1)
+SIMD_SCALAR_OP(absdiff, x > y ? x - y : y - x)
+SIMD_SCALAR_OP(min, x < y ? x : y)
+SIMD_SCALAR_OP(max, x > y ? x : y)
+SIMD_SCALAR_OP(adds, x + y > 255 ? 255 : x + y)
+SIMD_SCALAR_OP(subs, x > y ? x - y : 0)
+SIMD_SCALAR_OP(gt, x > y ? 0xFF : 0)
+#undef SIMD_SCALAR_OP
+inline u8v select(u8v mask, u8v a, u8v b)
+{
+  u8v r;
+  for (int i = 0; i < width; i++) {
+    r.v[i] = mask.v[i] ? a.v[i] : b.v[i];
+  }
+  return (r);
+}
+// unit: number of bytes that stay together
+inline void deinterleave(u8v a, u8v b, int unit, u8v * even, u8v * odd)
+{
+  const u8v * src[2] = {&a, &b};
+  for (int i = 0; i < 2 * width; i++) {
+    const int k = i / unit;  // index of unit in a, b
+    u8v * dst = (k & 1) ? odd : even;
+    dst->v[(k / 2) * unit + i % unit] = src[i / width]->v[i % width];
+  }
+}
+inline void deinterleave8(u8v a, u8v b, u8v * even, u8v * odd)
+{
+  deinterleave(a, b, 1, even, odd);
+}
+inline void deinterleave16(u8v a, u8v b, u8v * even, u8v * odd)
+{
+  deinterleave(a, b, 2, even, odd);
+}
+#endif
+
+#if defined(__SSSE3__)
+// interleaves 16 bytes each of a, b, c into 48 bytes a0 b0 c0 a1 ...
+inline void store3_128(uint8_t * p, __m128i a, __m128i b, __m128i c)
+{
+  const char z = -128;  // shuffle index that produces a zero byte
+  const __m128i a0 = _mm_setr_epi8(
+    0, z, z, 1, z, z, 2, z, z, 3, z, z, 4, z, z, 5);
+  const __m128i b0 = _mm_setr_epi8(
+    z, 0, z, z, 1, z, z, 2, z, z, 3, z, z, 4, z, z);
+  const __m128i c0 = _mm_setr_epi8(
+    z, z, 0, z, z, 1, z, z, 2, z, z, 3, z, z, 4, z);
+  const __m128i a1 = _mm_setr_epi8(
+    z, z, 6, z, z, 7, z, z, 8, z, z, 9, z, z, 10, z);
+  const __m128i b1 = _mm_setr_epi8(
+    5, z, z, 6, z, z, 7, z, z, 8, z, z, 9, z, z, 10);
+  const __m128i c1 = _mm_setr_epi8(
+    z, 5, z, z, 6, z, z, 7, z, z, 8, z, z, 9, z, z);
+  const __m128i a2 = _mm_setr_epi8(
+    z, 11, z, z, 12, z, z, 13, z, z, 14, z, z, 15, z, z);
+  const __m128i b2 = _mm_setr_epi8(
+    z, z, 11, z, z, 12, z, z, 13, z, z, 14, z, z, 15, z);
+  const __m128i c2 = _mm_setr_epi8(
+    10, z, z, 11, z, z, 12, z, z, 13, z, z, 14, z, z, 15);
+  __m128i * q = reinterpret_cast<__m128i *>(p);
+  _mm_storeu_si128(
+    q, _mm_or_si128(
+         _mm_or_si128(_mm_shuffle_epi8(a, a0), _mm_shuffle_epi8(b, b0)),
+         _mm_shuffle_epi8(c, c0)));
+  _mm_storeu_si128(
+    q + 1, _mm_or_si128(
+             _mm_or_si128(_mm_shuffle_epi8(a, a1), _mm_shuffle_epi8(b, b1)),
+             _mm_shuffle_epi8(c, c1)));
+  _mm_storeu_si128(
+    q + 2, _mm_or_si128(
+             _mm_or_si128(_mm_shuffle_epi8(a, a2), _mm_shuffle_epi8(b, b2)),
+             _mm_shuffle_epi8(c, c2)));
+}
+#endif
+
+// interleaved store of three vectors: a0 b0 c0 a1 b1 c1 ...
+inline void store3(uint8_t * p, u8v a, u8v b, u8v c)
+{
+#if defined(__AVX2__)
+  store3_128(
+    p, _mm256_castsi256_si128(a), _mm256_castsi256_si128(b),
+    _mm256_castsi256_si128(c));
+  store3_128(
+    p + 48, _mm256_extracti128_si256(a, 1), _mm256_extracti128_si256(b, 1),
+    _mm256_extracti128_si256(c, 1));
+#elif defined(__SSSE3__)
+  store3_128(p, a, b, c);
+#elif defined(__ARM_NEON)
+  uint8x16x3_t v;
+  v.val[0] = a;
+  v.val[1] = b;
+  v.val[2] = c;
+  vst3q_u8(p, v);
+#else
+  uint8_t ta[width], tb[width], tc[width];
+  store(ta, a);
+  store(tb, b);
+  store(tc, c);
+  for (int i = 0; i < width; i++) {
+    p[3 * i] = ta[i];
+    p[3 * i + 1] = tb[i];
+    p[3 * i + 2] = tc[i];
+  }
+#endif
+}
+
+#if defined(__SSSE3__)
+// splits 48 bytes a0 b0 c0 a1 ... into 16 bytes each of a, b, c
+inline void load3_128(const uint8_t * p, __m128i * a, __m128i * b, __m128i * c)
+{
+  const char z = -128;
+  const __m128i * q = reinterpret_cast<const __m128i *>(p);
+  const __m128i q0 = _mm_loadu_si128(q);
+  const __m128i q1 = _mm_loadu_si128(q + 1);
+  const __m128i q2 = _mm_loadu_si128(q + 2);
+  *a = _mm_or_si128(
+    _mm_or_si128(
+      _mm_shuffle_epi8(
+        q0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, z, z, z, z, z, z, z, z, z, z)),
+      _mm_shuffle_epi8(
+        q1, _mm_setr_epi8(z, z, z, z, z, z, 2, 5, 8, 11, 14, z, z, z, z, z))),
+    _mm_shuffle_epi8(
+      q2, _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, z, 1, 4, 7, 10, 13)));
+  *b = _mm_or_si128(
+    _mm_or_si128(
+      _mm_shuffle_epi8(
+        q0, _mm_setr_epi8(1, 4, 7, 10, 13, z, z, z, z, z, z, z, z, z, z, z)),
+      _mm_shuffle_epi8(
+        q1, _mm_setr_epi8(z, z, z, z, z, 0, 3, 6, 9, 12, 15, z, z, z, z, z))),
+    _mm_shuffle_epi8(
+      q2, _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, z, 2, 5, 8, 11, 14)));
+  *c = _mm_or_si128(
+    _mm_or_si128(
+      _mm_shuffle_epi8(
+        q0, _mm_setr_epi8(2, 5, 8, 11, 14, z, z, z, z, z, z, z, z, z, z, z)),
+      _mm_shuffle_epi8(
+        q1, _mm_setr_epi8(z, z, z, z, z, 1, 4, 7, 10, 13, z, z, z, z, z, z))),
+    _mm_shuffle_epi8(
+      q2, _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, 0, 3, 6, 9, 12, 15)));
+}
+#endif
+
+// inverse of store3()
+inline void load3(const uint8_t * p, u8v * a, u8v * b, u8v * c)
+{
+#if defined(__AVX2__)
+  __m128i a0, b0, c0, a1, b1, c1;
+  load3_128(p, &a0, &b0, &c0);
+  load3_128(p + 48, &a1, &b1, &c1);
+  *a = _mm256_inserti128_si256(_mm256_castsi128_si256(a0), a1, 1);
+  *b = _mm256_inserti128_si256(_mm256_castsi128_si256(b0), b1, 1);
+  *c = _mm256_inserti128_si256(_mm256_castsi128_si256(c0), c1, 1);
+#elif defined(__SSSE3__)
+  load3_128(p, a, b, c);
+#elif defined(__ARM_NEON)
+  const uint8x16x3_t v = vld3q_u8(p);
+  *a = v.val[0];
+  *b = v.val[1];
+  *c = v.val[2];
+#else
+  uint8_t ta[width], tb[width], tc[width];
+  for (int i = 0; i < width; i++) {
+    ta[i] = p[3 * i];
+    tb[i] = p[3 * i + 1];
+    tc[i] = p[3 * i + 2];
+  }
+  *a = load(ta);
+  *b = load(tb);
+  *c = load(tc);
+#endif
+}
+
+// interleaved store of two vectors: a0 b0 a1 b1 ...
+inline void store2(uint8_t * p, u8v a, u8v b)
+{
+#if defined(__AVX2__)
+  // unpack works within 128 bit lanes, the permutes restore the order
+  const __m256i lo = _mm256_unpacklo_epi8(a, b);
+  const __m256i hi = _mm256_unpackhi_epi8(a, b);
+  store(p, _mm256_permute2x128_si256(lo, hi, 0x20));
+  store(p + width, _mm256_permute2x128_si256(lo, hi, 0x31));
+#elif defined(__SSE2__)
+  store(p, _mm_unpacklo_epi8(a, b));
+  store(p + width, _mm_unpackhi_epi8(a, b));
+#elif defined(__ARM_NEON)
+  uint8x16x2_t v;
+  v.val[0] = a;
+  v.val[1] = b;
+  vst2q_u8(p, v);
+#else
+  for (int i = 0; i < width; i++) {
+    p[2 * i] = a.v[i];
+    p[2 * i + 1] = b.v[i];
+  }
+#endif
+}
+
+// Weighted sum (a * wa + b * wb + c * wc + 128) / 256 + offset,
+// saturated to 0..255. The weights may be negative, but the weighted
+// sum must stay within -32768..32767 (signed) or, if all weights are
+// positive, 0..65535.
+inline u8v dot3(u8v a, u8v b, u8v c, int wa, int wb, int wc, int offset)
+{
+  const bool positive = (wa >= 0 && wb >= 0 && wc >= 0);
+#if defined(__AVX2__)
+  const __m256i z = _mm256_setzero_si256();
+  const __m256i va = _mm256_set1_epi16(static_cast<int16_t>(wa));
+  const __m256i vb = _mm256_set1_epi16(static_cast<int16_t>(wb));
+  const __m256i vc = _mm256_set1_epi16(static_cast<int16_t>(wc));
+  const __m256i r = _mm256_set1_epi16(128);
+  const __m256i o = _mm256_set1_epi16(static_cast<int16_t>(offset));
+  __m256i h[2];
+  for (int i = 0; i < 2; i++) {
+    const __m256i x =
+      i ? _mm256_unpackhi_epi8(a, z) : _mm256_unpacklo_epi8(a, z);
+    const __m256i y =
+      i ? _mm256_unpackhi_epi8(b, z) : _mm256_unpacklo_epi8(b, z);
+    const __m256i w =
+      i ? _mm256_unpackhi_epi8(c, z) : _mm256_unpacklo_epi8(c, z);
+    const __m256i sum = _mm256_add_epi16(
+      _mm256_add_epi16(
+        _mm256_mullo_epi16(x, va), _mm256_mullo_epi16(y, vb)),
+      _mm256_add_epi16(_mm256_mullo_epi16(w, vc), r));
+    h[i] = _mm256_add_epi16(
+      positive ? _mm256_srli_epi16(sum, 8) : _mm256_srai_epi16(sum, 8), o);
+  }
+  return (_mm256_packus_epi16(h[0], h[1]));
+#elif defined(__SSE2__)
+  const __m128i z = _mm_setzero_si128();
+  const __m128i va = _mm_set1_epi16(static_cast<int16_t>(wa));
+  const __m128i vb = _mm_set1_epi16(static_cast<int16_t>(wb));
+  const __m128i vc = _mm_set1_epi16(static_cast<int16_t>(wc));
+  const __m128i r = _mm_set1_epi16(128);
+  const __m128i o = _mm_set1_epi16(static_cast<int16_t>(offset));
+  __m128i h[2];
+  for (int i = 0; i < 2; i++) {
+    const __m128i x = i ? _mm_unpackhi_epi8(a, z) : _mm_unpacklo_epi8(a, z);
+    const __m128i y = i ? _mm_unpackhi_epi8(b, z) : _mm_unpacklo_epi8(b, z);
+    const __m128i w = i ? _mm_unpackhi_epi8(c, z) : _mm_unpacklo_epi8(c, z);
+    const __m128i sum = _mm_add_epi16(
+      _mm_add_epi16(_mm_mullo_epi16(x, va), _mm_mullo_epi16(y, vb)),
+      _mm_add_epi16(_mm_mullo_epi16(w, vc), r));
+    h[i] = _mm_add_epi16(
+      positive ? _mm_srli_epi16(sum, 8) : _mm_srai_epi16(sum, 8), o);
+  }
+  return (_mm_packus_epi16(h[0], h[1]));
+#elif defined(__ARM_NEON)
+  const int16x8_t va = vdupq_n_s16(static_cast<int16_t>(wa));
+  const int16x8_t vb = vdupq_n_s16(static_cast<int16_t>(wb));
+  const int16x8_t vc = vdupq_n_s16(static_cast<int16_t>(wc));
+  const int16x8_t o = vdupq_n_s16(static_cast<int16_t>(offset));
+  int16x8_t h[2];
+  for (int i = 0; i < 2; i++) {
+    const uint8x8_t x = i ? vget_high_u8(a) : vget_low_u8(a);
+    const uint8x8_t y = i ? vget_high_u8(b) : vget_low_u8(b);
+    const uint8x8_t w = i ? vget_high_u8(c) : vget_low_u8(c);
+    const int16x8_t sum = vmlaq_s16(
+      vmlaq_s16(
+        vmulq_s16(vreinterpretq_s16_u16(vmovl_u8(x)), va),
+        vreinterpretq_s16_u16(vmovl_u8(y)), vb),
+      vreinterpretq_s16_u16(vmovl_u8(w)), vc);
+    // the shift rounds, i.e. adds 128 first
+    h[i] = vaddq_s16(
+      positive ? vreinterpretq_s16_u16(
+                   vrshrq_n_u16(vreinterpretq_u16_s16(sum), 8))
+               : vrshrq_n_s16(sum, 8),
+      o);
+  }
+  return (vcombine_u8(vqmovun_s16(h[0]), vqmovun_s16(h[1])));
+#else
+  (void)positive;
+  u8v res;
+  for (int i = 0; i < width; i++) {
+    const int s = (a.v[i] * wa + b.v[i] * wb + c.v[i] * wc + 128);
+    // arithmetic shift, like the vector versions
+    const int v = (s >= 0 ? s / 256 : -((-s + 255) / 256)) + offset;
+    res.v[i] = static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+  }
+  return (res);
+#endif
+}
+
+// mask that is all ones for even (parity = 0) or odd (parity = 1) bytes
+inline u8v parity_mask(int parity)
+{
+  uint8_t m[width];
+  for (int i = 0; i < width; i++) {
+    m[i] = ((i & 1) == parity) ? 0xFF : 0;
+  }
+  return (load(m));
+}
+
+// linear interpolation with weights w = 0..64 for b, rounded:
+// (a * (64 - w) + b * w + 32) / 64
+inline u8v lerp(u8v a, u8v b, u8v w)
+{
+#if defined(__AVX2__)
+  const __m256i z = _mm256_setzero_si256();
+  const __m256i wa = _mm256_sub_epi8(_mm256_set1_epi8(64), w);
+  const __m256i r = _mm256_set1_epi16(32);
+  // unpack and pack both work within 128 bit lanes, so the order is kept
+  const __m256i lo = _mm256_srli_epi16(
+    _mm256_add_epi16(
+      _mm256_add_epi16(
+        _mm256_mullo_epi16(
+          _mm256_unpacklo_epi8(a, z), _mm256_unpacklo_epi8(wa, z)),
+        _mm256_mullo_epi16(
+          _mm256_unpacklo_epi8(b, z), _mm256_unpacklo_epi8(w, z))),
+      r),
+    6);
+  const __m256i hi = _mm256_srli_epi16(
+    _mm256_add_epi16(
+      _mm256_add_epi16(
+        _mm256_mullo_epi16(
+          _mm256_unpackhi_epi8(a, z), _mm256_unpackhi_epi8(wa, z)),
+        _mm256_mullo_epi16(
+          _mm256_unpackhi_epi8(b, z), _mm256_unpackhi_epi8(w, z))),
+      r),
+    6);
+  return (_mm256_packus_epi16(lo, hi));
+#elif defined(__SSE2__)
+  const __m128i z = _mm_setzero_si128();
+  const __m128i wa = _mm_sub_epi8(_mm_set1_epi8(64), w);
+  const __m128i r = _mm_set1_epi16(32);
+  const __m128i lo = _mm_srli_epi16(
+    _mm_add_epi16(
+      _mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpacklo_epi8(a, z), _mm_unpacklo_epi8(wa, z)),
+        _mm_mullo_epi16(_mm_unpacklo_epi8(b, z), _mm_unpacklo_epi8(w, z))),
+      r),
+    6);
+  const __m128i hi = _mm_srli_epi16(
+    _mm_add_epi16(
+      _mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpackhi_epi8(a, z), _mm_unpackhi_epi8(wa, z)),
+        _mm_mullo_epi16(_mm_unpackhi_epi8(b, z), _mm_unpackhi_epi8(w, z))),
+      r),
+    6);
+  return (_mm_packus_epi16(lo, hi));
+#elif defined(__ARM_NEON)
+  const uint8x16_t wa = vsubq_u8(vdupq_n_u8(64), w);
+  const uint16x8_t lo = vmlal_u8(
+    vmull_u8(vget_low_u8(a), vget_low_u8(wa)), vget_low_u8(b),
+    vget_low_u8(w));
+  const uint16x8_t hi = vmlal_u8(
+    vmull_u8(vget_high_u8(a), vget_high_u8(wa)), vget_high_u8(b),
+    vget_high_u8(w));
+  return (vcombine_u8(vrshrn_n_u16(lo, 6), vrshrn_n_u16(hi, 6)));
+#else
+  u8v r;
+  for (int i = 0; i < width; i++) {
+    r.v[i] = (a.v[i] * (64 - w.v[i]) + b.v[i] * w.v[i] + 32) >> 6;
+  }
+  return (r);
+#endif
+}
+}  // namespace simd
+}  // namespace flir_spinnaker_ros2
+#endif  // SIMD_H_
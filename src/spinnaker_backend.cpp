@@ -0,0 +1,101 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/spinnaker_backend.h>
+
+namespace flir_spinnaker_ros2
+{
+SpinnakerBackend::SpinnakerBackend()
+: driver_(std::make_shared<flir_spinnaker_common::Driver>())
+{
+}
+
+std::string SpinnakerBackend::getLibraryVersion() const
+{
+  return (driver_->getLibraryVersion());
+}
+
+void SpinnakerBackend::refreshCameraList() { driver_->refreshCameraList(); }
+
+std::vector<std::string> SpinnakerBackend::getSerialNumbers() const
+{
+  return (driver_->getSerialNumbers());
+}
+
+void SpinnakerBackend::setDebug(bool b) { driver_->setDebug(b); }
+
+void SpinnakerBackend::setComputeBrightness(bool b)
+{
+  driver_->setComputeBrightness(b);
+}
+
+void SpinnakerBackend::setAcquisitionTimeout(double sec)
+{
+  driver_->setAcquisitionTimeout(sec);
+}
+
+bool SpinnakerBackend::initCamera(const std::string & serialNumber)
+{
+  return (driver_->initCamera(serialNumber));
+}
+
+bool SpinnakerBackend::deInitCamera() { return (driver_->deInitCamera()); }
+
+bool SpinnakerBackend::startCamera(const Callback & cb)
+{
+  return (driver_->startCamera(cb));
+}
+
+bool SpinnakerBackend::stopCamera() { return (driver_->stopCamera()); }
+
+std::string SpinnakerBackend::getNodeMapAsString()
+{
+  return (driver_->getNodeMapAsString());
+}
+
+std::string SpinnakerBackend::setEnum(
+  const std::string & nodeName, const std::string & val, std::string * retVal)
+{
+  return (driver_->setEnum(nodeName, val, retVal));
+}
+
+std::string SpinnakerBackend::setDouble(
+  const std::string & nodeName, double val, double * retVal)
+{
+  return (driver_->setDouble(nodeName, val, retVal));
+}
+
+std::string SpinnakerBackend::setInt(
+  const std::string & nodeName, int val, int * retVal)
+{
+  return (driver_->setInt(nodeName, val, retVal));
+}
+
+std::string SpinnakerBackend::setBool(
+  const std::string & nodeName, bool val, bool * retVal)
+{
+  return (driver_->setBool(nodeName, val, retVal));
+}
+
+double SpinnakerBackend::getReceiveFrameRate() const
+{
+  return (driver_->getReceiveFrameRate());
+}
+
+std::string SpinnakerBackend::getPixelFormat() const
+{
+  return (driver_->getPixelFormat());
+}
+}  // namespace flir_spinnaker_ros2
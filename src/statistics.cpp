@@ -0,0 +1,182 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/statistics.h>
+
+#include <algorithm>
+
+namespace flir_spinnaker_ros2
+{
+static const int NUM_BINS = 256;
+
+void ImageStatistics::reset(
+  const StatisticsConfig & config, int width, int height, int channels,
+  bool bayer, int bits)
+{
+  config_ = config;
+  config_.subsample = std::max(config.subsample, 1);
+  config_.gridRows = std::max(config.gridRows, 1);
+  config_.gridCols = std::max(config.gridCols, 1);
+  width_ = width;
+  height_ = height;
+  channels_ = bayer ? 1 : channels;
+  unit_ = bayer ? 2 : 1;
+  bits_ = std::min(std::max(bits, 8), 16);
+  // Consecutive samples go into different histograms, so the
+  // increments do not have to wait for each other.
+  histogram_.assign(4 * NUM_BINS, 0);
+  const size_t numChannels = bayer ? 4 : channels_;
+  channelSum_.assign(numChannels, 0);
+  channelCount_.assign(numChannels, 0);
+  const size_t numCells = config_.gridRows * config_.gridCols;
+  gridSum_.assign(numCells, 0);
+  gridCount_.assign(numCells, 0);
+  blockCell_.clear();
+  for (int x = 0; x < width_; x += unit_ * config_.subsample) {
+    blockCell_.push_back(
+      std::min(x * config_.gridCols / width_, config_.gridCols - 1));
+  }
+}
+
+template <typename T, int UNIT, int CH>
+void ImageStatistics::accumulateRows(
+  const uint8_t * src, size_t step, int rowBegin, int rowEnd)
+{
+  const int shift = bits_ - 8;
+  const int maxValue = (1 << bits_) - 1;
+  const int blockStep = UNIT * config_.subsample;
+  const int numBlocks = static_cast<int>(blockCell_.size());
+  // the last block of a Bayer row is incomplete if its second column
+  // is beyond an odd width
+  const int numFull =
+    (UNIT == 2 && numBlocks > 0 && (numBlocks - 1) * blockStep + 1 >= width_)
+      ? numBlocks - 1
+      : numBlocks;
+  for (int y = rowBegin; y < rowEnd; y++) {
+    if ((y / UNIT) % config_.subsample != 0) {
+      continue;
+    }
+    const T * row = reinterpret_cast<const T *>(src + y * step);
+    const int gy =
+      std::min(y * config_.gridRows / height_, config_.gridRows - 1);
+    uint64_t * gridSum = &gridSum_[gy * config_.gridCols];
+    uint64_t * gridCount = &gridCount_[gy * config_.gridCols];
+    uint64_t sum[UNIT * CH] = {0};
+    for (int k = 0; k < numFull; k++) {
+      uint32_t * hist = &histogram_[(k & 3) * NUM_BINS];
+      const T * p = row + k * blockStep * CH;
+      uint32_t cellSum = 0;
+      for (int i = 0; i < UNIT * CH; i++) {
+        // only deeper values can exceed the significant bits
+        const int v = sizeof(T) == 1 ? p[i] : std::min<int>(p[i], maxValue);
+        hist[v >> shift]++;
+        sum[i] += v;
+        cellSum += v;
+      }
+      gridSum[blockCell_[k]] += cellSum;
+      gridCount[blockCell_[k]] += UNIT * CH;
+    }
+    // channel of sample i: pixel of the 2x2 block, or color
+    const int channel0 = (UNIT == 2) ? (y & 1) * 2 : 0;
+    for (int i = 0; i < UNIT * CH; i++) {
+      channelSum_[channel0 + i] += sum[i];
+      channelCount_[channel0 + i] += numFull;
+    }
+  }
+}
+
+void ImageStatistics::accumulate(
+  const uint8_t * src, size_t step, int rowBegin, int rowEnd)
+{
+  const bool deep = bits_ > 8;
+  if (unit_ == 2) {
+    deep ? accumulateRows<uint16_t, 2, 1>(src, step, rowBegin, rowEnd)
+         : accumulateRows<uint8_t, 2, 1>(src, step, rowBegin, rowEnd);
+  } else if (channels_ == 3) {
+    deep ? accumulateRows<uint16_t, 1, 3>(src, step, rowBegin, rowEnd)
+         : accumulateRows<uint8_t, 1, 3>(src, step, rowBegin, rowEnd);
+  } else {
+    deep ? accumulateRows<uint16_t, 1, 1>(src, step, rowBegin, rowEnd)
+         : accumulateRows<uint8_t, 1, 1>(src, step, rowBegin, rowEnd);
+  }
+}
+
+void ImageStatistics::merge(const ImageStatistics & other)
+{
+  auto add = [](auto * a, const auto & b) {
+    for (size_t i = 0; i < a->size() && i < b.size(); i++) {
+      (*a)[i] += b[i];
+    }
+  };
+  add(&histogram_, other.histogram_);
+  add(&channelSum_, other.channelSum_);
+  add(&channelCount_, other.channelCount_);
+  add(&gridSum_, other.gridSum_);
+  add(&gridCount_, other.gridCount_);
+}
+
+std::vector<uint32_t> ImageStatistics::getHistogram() const
+{
+  std::vector<uint32_t> h(NUM_BINS, 0);
+  for (size_t i = 0; i < histogram_.size(); i++) {
+    h[i % NUM_BINS] += histogram_[i];
+  }
+  return (h);
+}
+
+static std::vector<float> means(
+  const std::vector<uint64_t> & sum, const std::vector<uint64_t> & count)
+{
+  std::vector<float> m(sum.size(), 0);
+  for (size_t i = 0; i < sum.size(); i++) {
+    if (count[i] > 0) {
+      m[i] = static_cast<float>(static_cast<double>(sum[i]) / count[i]);
+    }
+  }
+  return (m);
+}
+
+std::vector<float> ImageStatistics::getChannelMeans() const
+{
+  return (means(channelSum_, channelCount_));
+}
+
+std::vector<float> ImageStatistics::getGridMeans() const
+{
+  return (means(gridSum_, gridCount_));
+}
+
+float ImageStatistics::getSaturatedFraction() const
+{
+  const std::vector<uint32_t> h = getHistogram();
+  uint64_t n = 0, total = 0;
+  for (int i = 0; i < NUM_BINS; i++) {
+    n += (i >= config_.saturationBin) ? h[i] : 0;
+    total += h[i];
+  }
+  return (total > 0 ? static_cast<float>(n) / total : 0);
+}
+
+float ImageStatistics::getBlackFraction() const
+{
+  const std::vector<uint32_t> h = getHistogram();
+  uint64_t n = 0, total = 0;
+  for (int i = 0; i < NUM_BINS; i++) {
+    n += (i <= config_.blackBin) ? h[i] : 0;
+    total += h[i];
+  }
+  return (total > 0 ? static_cast<float>(n) / total : 0);
+}
+}  // namespace flir_spinnaker_ros2
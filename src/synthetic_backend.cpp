@@ -0,0 +1,257 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_common/image.h>
+#include <flir_spinnaker_ros2/synthetic_backend.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+namespace flir_spinnaker_ros2
+{
+namespace chrono = std::chrono;
+namespace pixel_format = flir_spinnaker_common::pixel_format;
+
+static const int num_frames = 8;  // number of distinct frames to cycle
+static const double reference_exposure = 5000.0;  // usec
+
+// like the camera library, which only identifies a few formats
+static pixel_format::PixelFormat to_pixel_format(const std::string & s)
+{
+  if (s == "BayerRG8") {
+    return (pixel_format::BayerRG8);
+  } else if (s == "RGB8") {
+    return (pixel_format::RGB8);
+  } else if (s == "Mono8") {
+    return (pixel_format::Mono8);
+  }
+  return (pixel_format::INVALID);
+}
+
+static bool ends_with(const std::string & s, const std::string & end)
+{
+  return (
+    s.size() >= end.size() &&
+    s.compare(s.size() - end.size(), end.size(), end) == 0);
+}
+
+SyntheticBackend::SyntheticBackend(const Config & config)
+: config_(config), frameRate_(config.frameRate)
+{
+  const PixelFormatInfo * pf = find_pixel_format(config_.pixelFormat);
+  if (!pf) {
+    throw std::runtime_error(
+      "synthetic camera: unsupported pixel format " + config_.pixelFormat);
+  }
+  packing_ = pf->packing;
+  bitsPerPixel_ = pf->bitsPerPixel;
+  numChannels_ = (bitsPerPixel_ == 24) ? 3 : 1;
+  stride_ = (config_.width * bitsPerPixel_ + 7) / 8;
+  lastQueryTime_ = chrono::steady_clock::now();
+  renderFrames();
+}
+
+SyntheticBackend::~SyntheticBackend() { stopCamera(); }
+
+std::string SyntheticBackend::getLibraryVersion() const
+{
+  return ("synthetic camera");
+}
+
+std::vector<std::string> SyntheticBackend::getSerialNumbers() const
+{
+  return (std::vector<std::string>({config_.serial}));
+}
+
+bool SyntheticBackend::initCamera(const std::string & serialNumber)
+{
+  return (serialNumber == config_.serial);
+}
+
+void SyntheticBackend::renderFrames()
+{
+  // Diagonal stripes that move a bit from frame to frame, with some
+  // texture so compression and change detection see realistic content.
+  // Deeper formats get the same image with more low order bits.
+  const size_t rowValues = config_.width * numChannels_;
+  const int bits = bitsPerPixel_ / numChannels_;
+  std::vector<uint16_t> values(rowValues);
+  frames_.resize(num_frames);
+  for (int f = 0; f < num_frames; f++) {
+    auto & frame = frames_[f];
+    frame.resize(stride_ * config_.height);
+    for (size_t y = 0; y < config_.height; y++) {
+      uint8_t * row = &frame[y * stride_];
+      for (size_t x = 0; x < rowValues; x++) {
+        const size_t px = x / numChannels_;
+        const uint32_t v = static_cast<uint32_t>(
+          (px + y + 4 * f) / 2 + ((px * 7 + y * 13) & 0x0F) +
+          32 * (x % numChannels_));
+        const uint32_t lowBits = ((px * 5 + y * 3) & 0xFF) >> (16 - bits);
+        values[x] = static_cast<uint16_t>(((v & 0xFF) << (bits - 8)) | lowBits);
+      }
+      if (packing_ != PACKING_NONE) {
+        pack12_row(&values[0], config_.width, packing_, row);
+      } else if (bits == 16) {
+        std::memcpy(row, &values[0], rowValues * 2);
+      } else {
+        std::copy(values.begin(), values.end(), row);
+      }
+    }
+  }
+}
+
+bool SyntheticBackend::startCamera(const Callback & cb)
+{
+  if (thread_) {
+    return (false);
+  }
+  callback_ = cb;
+  keepRunning_ = true;
+  thread_ = std::make_shared<std::thread>(&SyntheticBackend::run, this);
+  return (true);
+}
+
+bool SyntheticBackend::stopCamera()
+{
+  if (!thread_) {
+    return (false);
+  }
+  keepRunning_ = false;
+  thread_->join();
+  thread_.reset();
+  return (true);
+}
+
+void SyntheticBackend::run()
+{
+  const auto pixFmt = to_pixel_format(config_.pixelFormat);
+  auto nextFrameTime = chrono::steady_clock::now();
+  while (keepRunning_) {
+    double exposureTime, gain, frameRate;
+    uint64_t frameId;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      exposureTime = exposureTime_;
+      gain = gain_;
+      frameRate = frameRate_;
+      frameId = frameId_++;
+      framesSinceQuery_++;
+    }
+    nextFrameTime += chrono::nanoseconds(
+      static_cast<int64_t>(1e9 / std::max(frameRate, 0.1)));
+    const auto now = chrono::steady_clock::now();
+    if (nextFrameTime < now) {
+      nextFrameTime = now;  // fell behind, don't try to catch up
+    }
+    std::this_thread::sleep_until(nextFrameTime);
+    // Like the image mean a camera would report for a static scene
+    // that is nicely exposed at the reference exposure time and zero gain.
+    const double b =
+      128.0 * exposureTime / reference_exposure * std::pow(10.0, gain / 20.0);
+    const int16_t brightness =
+      computeBrightness_ ? static_cast<int16_t>(std::min(b, 255.0)) : 0;
+    const int64_t stamp = chrono::duration_cast<chrono::nanoseconds>(
+                            chrono::system_clock::now().time_since_epoch())
+                            .count();
+    const auto & frame = frames_[frameId % frames_.size()];
+    auto img = std::make_shared<const flir_spinnaker_common::Image>(
+      static_cast<uint64_t>(stamp), brightness,
+      static_cast<uint32_t>(exposureTime),
+      static_cast<uint32_t>(1e6 / std::max(frameRate, 0.1)),
+      static_cast<float>(gain), stamp, frame.size(), 0, &frame[0],
+      config_.width, config_.height, stride_, bitsPerPixel_, numChannels_,
+      frameId, pixFmt);
+    if (keepRunning_) {
+      callback_(img);
+    }
+  }
+}
+
+std::string SyntheticBackend::getNodeMapAsString()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::stringstream ss;
+  for (const auto & nv : nodeValues_) {
+    ss << nv.first << " = " << nv.second << std::endl;
+  }
+  return (ss.str());
+}
+
+std::string SyntheticBackend::setEnum(
+  const std::string & nodeName, const std::string & val, std::string * retVal)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (ends_with(nodeName, "PixelFormat") && val != config_.pixelFormat) {
+    *retVal = config_.pixelFormat;
+    return ("synthetic camera cannot change pixel format at run time");
+  }
+  nodeValues_[nodeName] = val;
+  *retVal = val;
+  return ("OK");
+}
+
+std::string SyntheticBackend::setDouble(
+  const std::string & nodeName, double val, double * retVal)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (ends_with(nodeName, "ExposureTime")) {
+    exposureTime_ = std::max(std::min(val, 1e6 / frameRate_), 10.0);
+    val = exposureTime_;
+  } else if (ends_with(nodeName, "Gain")) {
+    gain_ = std::max(std::min(val, 48.0), 0.0);
+    val = gain_;
+  } else if (ends_with(nodeName, "AcquisitionFrameRate")) {
+    frameRate_ = std::max(val, 0.1);
+    val = frameRate_;
+  }
+  nodeValues_[nodeName] = std::to_string(val);
+  *retVal = val;
+  return ("OK");
+}
+
+std::string SyntheticBackend::setInt(
+  const std::string & nodeName, int val, int * retVal)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  nodeValues_[nodeName] = std::to_string(val);
+  *retVal = val;
+  return ("OK");
+}
+
+std::string SyntheticBackend::setBool(
+  const std::string & nodeName, bool val, bool * retVal)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  nodeValues_[nodeName] = val ? "true" : "false";
+  *retVal = val;
+  return ("OK");
+}
+
+double SyntheticBackend::getReceiveFrameRate() const
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto now = chrono::steady_clock::now();
+  const double dt =
+    chrono::duration_cast<chrono::duration<double>>(now - lastQueryTime_)
+      .count();
+  const double rate = dt > 0 ? framesSinceQuery_ / dt : 0;
+  framesSinceQuery_ = 0;
+  lastQueryTime_ = now;
+  return (rate);
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,79 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/thread_config.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace flir_spinnaker_ros2
+{
+std::string set_thread_affinity(const std::vector<int> & cpus)
+{
+  if (cpus.empty()) {
+    return ("OK");
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const int c : cpus) {
+    if (c < 0 || c >= CPU_SETSIZE) {
+      return ("invalid cpu: " + std::to_string(c));
+    }
+    CPU_SET(c, &set);
+  }
+  const int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  return (ret == 0 ? "OK" : std::string(strerror(ret)));
+}
+
+std::string set_thread_scheduling(const std::string & policy, int priority)
+{
+  if (policy.empty()) {
+    return ("OK");
+  }
+  int pol;
+  if (policy == "SCHED_FIFO") {
+    pol = SCHED_FIFO;
+  } else if (policy == "SCHED_RR") {
+    pol = SCHED_RR;
+  } else if (policy == "SCHED_OTHER") {
+    pol = SCHED_OTHER;
+    priority = 0;  // only valid priority for SCHED_OTHER
+  } else {
+    return ("invalid scheduling policy: " + policy);
+  }
+  struct sched_param param;
+  param.sched_priority = priority;
+  const int ret = pthread_setschedparam(pthread_self(), pol, &param);
+  if (ret == EPERM) {
+    return ("permission denied (need CAP_SYS_NICE or rtprio limit)");
+  }
+  return (ret == 0 ? "OK" : std::string(strerror(ret)));
+}
+
+std::string lock_all_memory()
+{
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    if (errno == EPERM || errno == ENOMEM) {
+      return (
+        std::string(strerror(errno)) + " (need CAP_IPC_LOCK or memlock limit)");
+    }
+    return (strerror(errno));
+  }
+  return ("OK");
+}
+}  // namespace flir_spinnaker_ros2
@@ -0,0 +1,154 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/worker_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace flir_spinnaker_ros2
+{
+namespace
+{
+// shared between the caller of parallelFor() and its helpers. Helpers
+// may run after parallelFor() returned, so this lives on the heap.
+struct ParallelForState
+{
+  std::atomic<int> next{0};
+  int numChunks{0};
+  int numDone{0};
+  std::mutex mutex;
+  std::condition_variable cv;
+};
+
+// returns the number of chunks processed
+int work_on_chunks(
+  ParallelForState * s, int n, int chunkSize,
+  const std::function<void(int, int)> & f)
+{
+  int numProcessed = 0;
+  for (int c = s->next.fetch_add(1); c < s->numChunks;
+       c = s->next.fetch_add(1)) {
+    const int begin = c * chunkSize;
+    f(begin, std::min(begin + chunkSize, n));
+    numProcessed++;
+  }
+  return (numProcessed);
+}
+}  // namespace
+
+WorkerPool::WorkerPool(int numThreads, size_t maxQueued, const Job & onStart)
+: maxQueued_(maxQueued)
+{
+  for (int i = 0; i < numThreads; i++) {
+    threads_.emplace_back(&WorkerPool::run, this, onStart);
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    keepRunning_ = false;
+  }
+  cv_.notify_all();
+  for (auto & t : threads_) {
+    t.join();
+  }
+}
+
+bool WorkerPool::submit(Job job)
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.size() >= maxQueued_) {
+      return (false);
+    }
+    queue_.push_back(std::move(job));
+  }
+  cv_.notify_one();
+  return (true);
+}
+
+void WorkerPool::enqueueHelpers(int num, const Job & helper)
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // helpers bypass the queue limit and jump ahead of waiting jobs
+    // since someone is already blocked on them
+    for (int i = 0; i < num; i++) {
+      queue_.push_front(helper);
+    }
+  }
+  cv_.notify_all();
+}
+
+void WorkerPool::parallelFor(
+  int n, int chunkSize, const std::function<void(int, int)> & f)
+{
+  if (n <= 0) {
+    return;
+  }
+  chunkSize = std::max(chunkSize, 1);
+  auto s = std::make_shared<ParallelForState>();
+  s->numChunks = (n + chunkSize - 1) / chunkSize;
+  const int numHelpers = std::min(getNumThreads(), s->numChunks - 1);
+  if (numHelpers > 0) {
+    // f is only touched while chunks are outstanding, and the caller
+    // does not return before they are done, so capturing by pointer
+    // is safe even if a helper starts late.
+    const auto * fp = &f;
+    enqueueHelpers(numHelpers, [s, n, chunkSize, fp]() {
+      const int num = work_on_chunks(s.get(), n, chunkSize, *fp);
+      if (num > 0) {
+        std::unique_lock<std::mutex> lock(s->mutex);
+        s->numDone += num;
+        if (s->numDone == s->numChunks) {
+          s->cv.notify_all();
+        }
+      }
+    });
+  }
+  const int num = work_on_chunks(s.get(), n, chunkSize, f);
+  std::unique_lock<std::mutex> lock(s->mutex);
+  s->numDone += num;
+  while (s->numDone < s->numChunks) {
+    s->cv.wait(lock);
+  }
+}
+
+void WorkerPool::run(Job onStart)
+{
+  if (onStart) {
+    onStart();
+  }
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (keepRunning_ && queue_.empty()) {
+        cv_.wait(lock);
+      }
+      if (!keepRunning_) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    job();
+  }
+}
+}  // namespace flir_spinnaker_ros2
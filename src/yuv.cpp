@@ -0,0 +1,256 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/yuv.h>
+
+#include <utility>
+
+#include "simd.h"
+
+namespace flir_spinnaker_ros2
+{
+namespace
+{
+// weights for r, g, b in units of 1/256, limited range
+struct Coefficients
+{
+  int y[3];
+  int u[3];
+  int v[3];
+};
+const Coefficients bt601 = {{66, 129, 25}, {-38, -74, 112}, {112, -94, -18}};
+const Coefficients bt709 = {{47, 157, 16}, {-26, -86, 112}, {112, -102, -10}};
+
+// same rounding as simd::dot3()
+inline uint8_t dot3(int r, int g, int b, const int * w, int offset)
+{
+  const int s = r * w[0] + g * w[1] + b * w[2] + 128;
+  const int v = (s >= 0 ? s / 256 : -((-s + 255) / 256)) + offset;
+  return (static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v)));
+}
+
+inline int average(int a, int b) { return ((a + b + 1) >> 1); }
+
+struct Pixel
+{
+  int r, g, b;
+};
+
+inline Pixel get_pixel(const uint8_t * row, int x, int channels, bool bgr)
+{
+  if (channels == 1) {
+    return (Pixel{row[x], row[x], row[x]});
+  }
+  const uint8_t * p = row + 3 * x;
+  return (bgr ? Pixel{p[2], p[1], p[0]} : Pixel{p[0], p[1], p[2]});
+}
+
+inline Pixel average(const Pixel & a, const Pixel & b)
+{
+  return (Pixel{average(a.r, b.r), average(a.g, b.g), average(a.b, b.b)});
+}
+
+// loads simd::width pixels
+inline void load_rgb(
+  const uint8_t * p, int channels, bool bgr, simd::u8v * r, simd::u8v * g,
+  simd::u8v * b)
+{
+  if (channels == 1) {
+    *r = *g = *b = simd::load(p);
+    return;
+  }
+  simd::load3(p, r, g, b);
+  if (bgr) {
+    std::swap(*r, *b);
+  }
+}
+
+// averages horizontally neighboring pixels of a, b
+inline simd::u8v half(simd::u8v a, simd::u8v b)
+{
+  simd::u8v even, odd;
+  simd::deinterleave8(a, b, &even, &odd);
+  return (simd::avg(even, odd));
+}
+
+void nv12_rows(
+  const uint8_t * src, size_t srcStep, int width, int height, int channels,
+  bool bgr, const Coefficients & c, uint8_t * dst, int rowBegin, int rowEnd)
+{
+  using namespace simd;
+  const int W = simd::width;
+  for (int y = rowBegin; y + 1 < rowEnd; y += 2) {
+    const uint8_t * s0 = src + (y - rowBegin) * srcStep;
+    const uint8_t * s1 = s0 + srcStep;
+    uint8_t * y0 = dst + static_cast<size_t>(y) * width;
+    uint8_t * y1 = y0 + width;
+    uint8_t * uv =
+      dst + static_cast<size_t>(width) * height + (y / 2) * width;
+    int x = 0;
+    for (; x + 2 * W <= width; x += 2 * W) {
+      u8v r[4], g[4], b[4];  // top left, top right, bottom left, ...
+      load_rgb(s0 + x * channels, channels, bgr, &r[0], &g[0], &b[0]);
+      load_rgb(s0 + (x + W) * channels, channels, bgr, &r[1], &g[1], &b[1]);
+      load_rgb(s1 + x * channels, channels, bgr, &r[2], &g[2], &b[2]);
+      load_rgb(s1 + (x + W) * channels, channels, bgr, &r[3], &g[3], &b[3]);
+      uint8_t * out[4] = {y0 + x, y0 + x + W, y1 + x, y1 + x + W};
+      for (int i = 0; i < 4; i++) {
+        store(out[i], simd::dot3(r[i], g[i], b[i], c.y[0], c.y[1], c.y[2], 16));
+      }
+      const u8v rc = half(avg(r[0], r[2]), avg(r[1], r[3]));
+      const u8v gc = half(avg(g[0], g[2]), avg(g[1], g[3]));
+      const u8v bc = half(avg(b[0], b[2]), avg(b[1], b[3]));
+      store2(
+        uv + x, simd::dot3(rc, gc, bc, c.u[0], c.u[1], c.u[2], 128),
+        simd::dot3(rc, gc, bc, c.v[0], c.v[1], c.v[2], 128));
+    }
+    for (; x + 1 < width; x += 2) {
+      Pixel p[4] = {
+        get_pixel(s0, x, channels, bgr), get_pixel(s0, x + 1, channels, bgr),
+        get_pixel(s1, x, channels, bgr), get_pixel(s1, x + 1, channels, bgr)};
+      uint8_t * out[4] = {y0 + x, y0 + x + 1, y1 + x, y1 + x + 1};
+      for (int i = 0; i < 4; i++) {
+        *out[i] = dot3(p[i].r, p[i].g, p[i].b, c.y, 16);
+      }
+      const Pixel m = average(average(p[0], p[2]), average(p[1], p[3]));
+      uv[x] = dot3(m.r, m.g, m.b, c.u, 128);
+      uv[x + 1] = dot3(m.r, m.g, m.b, c.v, 128);
+    }
+  }
+}
+
+void yuv422_rows(
+  const uint8_t * src, size_t srcStep, int width, int channels, bool bgr,
+  const Coefficients & c, bool yFirst, uint8_t * dst, int rowBegin,
+  int rowEnd)
+{
+  using namespace simd;
+  const int W = simd::width;
+  uint8_t uv[2 * W];
+  for (int y = rowBegin; y < rowEnd; y++) {
+    const uint8_t * s = src + (y - rowBegin) * srcStep;
+    uint8_t * d = dst + static_cast<size_t>(y) * 2 * width;
+    int x = 0;
+    for (; x + 2 * W <= width; x += 2 * W) {
+      u8v r[2], g[2], b[2];
+      load_rgb(s + x * channels, channels, bgr, &r[0], &g[0], &b[0]);
+      load_rgb(s + (x + W) * channels, channels, bgr, &r[1], &g[1], &b[1]);
+      const u8v rc = half(r[0], r[1]);
+      const u8v gc = half(g[0], g[1]);
+      const u8v bc = half(b[0], b[1]);
+      store2(
+        uv, simd::dot3(rc, gc, bc, c.u[0], c.u[1], c.u[2], 128),
+        simd::dot3(rc, gc, bc, c.v[0], c.v[1], c.v[2], 128));
+      for (int i = 0; i < 2; i++) {
+        const u8v luma =
+          simd::dot3(r[i], g[i], b[i], c.y[0], c.y[1], c.y[2], 16);
+        const u8v chroma = load(uv + i * W);
+        if (yFirst) {
+          store2(d + 2 * x + i * 2 * W, luma, chroma);
+        } else {
+          store2(d + 2 * x + i * 2 * W, chroma, luma);
+        }
+      }
+    }
+    for (; x + 1 < width; x += 2) {
+      const Pixel p0 = get_pixel(s, x, channels, bgr);
+      const Pixel p1 = get_pixel(s, x + 1, channels, bgr);
+      const Pixel m = average(p0, p1);
+      const uint8_t q[4] = {
+        dot3(p0.r, p0.g, p0.b, c.y, 16), dot3(m.r, m.g, m.b, c.u, 128),
+        dot3(p1.r, p1.g, p1.b, c.y, 16), dot3(m.r, m.g, m.b, c.v, 128)};
+      uint8_t * o = d + 2 * x;
+      if (yFirst) {  // Y0 U Y1 V
+        o[0] = q[0];
+        o[1] = q[1];
+        o[2] = q[2];
+        o[3] = q[3];
+      } else {  // U Y0 V Y1
+        o[0] = q[1];
+        o[1] = q[0];
+        o[2] = q[3];
+        o[3] = q[2];
+      }
+    }
+  }
+}
+}  // namespace
+
+bool yuv_format_from_string(const std::string & s, YuvFormat * f)
+{
+  if (s == "nv12") {
+    *f = YUV_NV12;
+  } else if (s == "yuv422") {
+    *f = YUV_UYVY;
+  } else if (s == "yuv422_yuy2") {
+    *f = YUV_YUYV;
+  } else {
+    return (false);
+  }
+  return (true);
+}
+
+bool yuv_matrix_from_string(const std::string & s, YuvMatrix * m)
+{
+  if (s == "bt601") {
+    *m = YUV_BT601;
+  } else if (s == "bt709") {
+    *m = YUV_BT709;
+  } else {
+    return (false);
+  }
+  return (true);
+}
+
+const char * yuv_encoding(YuvFormat f)
+{
+  switch (f) {
+    case YUV_NV12:
+      return ("nv12");
+    case YUV_UYVY:
+      return ("yuv422");
+    case YUV_YUYV:
+    default:
+      return ("yuv422_yuy2");
+  }
+}
+
+size_t yuv_step(int width, YuvFormat f)
+{
+  return (f == YUV_NV12 ? width : 2 * width);
+}
+
+size_t yuv_size(int width, int height, YuvFormat f)
+{
+  const size_t n = static_cast<size_t>(width) * height;
+  return (f == YUV_NV12 ? n + n / 2 : 2 * n);
+}
+
+void yuv_from_rows(
+  const uint8_t * src, size_t srcStep, int width, int height, int channels,
+  bool bgr, YuvMatrix matrix, YuvFormat format, uint8_t * dst, int rowBegin,
+  int rowEnd)
+{
+  const Coefficients & c = (matrix == YUV_BT601) ? bt601 : bt709;
+  if (format == YUV_NV12) {
+    nv12_rows(
+      src, srcStep, width, height, channels, bgr, c, dst, rowBegin, rowEnd);
+  } else {
+    yuv422_rows(
+      src, srcStep, width, channels, bgr, c, format == YUV_YUYV, dst,
+      rowBegin, rowEnd);
+  }
+}
+}  // namespace flir_spinnaker_ros2
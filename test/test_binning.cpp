@@ -0,0 +1,206 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/binning.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::bin2x2_rows;
+using flir_spinnaker_ros2::bin2x2_size;
+
+namespace
+{
+// odd, and long enough for the vector loops of the finer levels
+const int widths[] = {7, 9, 37, 71, 141, 203};
+const int numLevels = 3;
+
+struct Image
+{
+  int width, height, bpp;
+  size_t step;
+  std::vector<uint8_t> data;
+  uint8_t & at(int x, int y, int c)
+  {
+    return (data[y * step + x * bpp + c]);
+  }
+  int at(int x, int y, int c) const { return (data[y * step + x * bpp + c]); }
+};
+
+Image make_image(int width, int height, int bpp, std::mt19937 * rng)
+{
+  // with row padding
+  Image img{width, height, bpp, static_cast<size_t>(width * bpp + 3), {}};
+  img.data.resize(img.step * height, 0xEE);
+  std::uniform_int_distribution<int> dist(0, 255);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width * bpp; x++) {
+      img.data[y * img.step + x] = static_cast<uint8_t>(dist(*rng));
+    }
+  }
+  return (img);
+}
+
+int avg(int a, int b) { return ((a + b + 1) >> 1); }
+
+// Plain binning. Pixel (x, y) of the result averages the pixels at
+// columns x0, x0 + dx and rows y0, y0 + dy, first vertically. For Bayer
+// images that is the pixel of the same color in the next 2x2 cell.
+Image reference(const Image & src, bool bayer)
+{
+  const int cells = bayer ? 2 : 1;
+  const int w = (src.width / (2 * cells)) * cells;
+  const int h = (src.height / (2 * cells)) * cells;
+  Image dst{w, h, src.bpp, static_cast<size_t>(w * src.bpp), {}};
+  dst.data.resize(dst.step * h);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      // top left of the 4x4 block plus the color phase
+      const int x0 = bayer ? 4 * (x / 2) + (x % 2) : 2 * x;
+      const int y0 = bayer ? 4 * (y / 2) + (y % 2) : 2 * y;
+      for (int c = 0; c < src.bpp; c++) {
+        dst.at(x, y, c) = static_cast<uint8_t>(avg(
+          avg(src.at(x0, y0, c), src.at(x0, y0 + cells, c)),
+          avg(src.at(x0 + cells, y0, c), src.at(x0 + cells, y0 + cells, c))));
+      }
+    }
+  }
+  return (dst);
+}
+
+// one level with the kernel, in bands of the given number of rows
+Image bin(const Image & src, bool bayer, int band)
+{
+  int w, h;
+  bin2x2_size(src.width, src.height, bayer, &w, &h);
+  // with row padding, which the kernel must leave alone
+  Image dst{w, h, src.bpp, static_cast<size_t>(w * src.bpp + 5), {}};
+  dst.data.resize(dst.step * h, 0xEE);
+  for (int y = 0; y < h; y += band) {
+    bin2x2_rows(
+      src.data.data(), src.step, src.width, src.height, src.bpp, bayer,
+      &dst.data[y * dst.step], dst.step, y, y + band);
+  }
+  return (dst);
+}
+
+void check_pyramid(
+  const Image & img, bool bayer, int band, const std::string & what)
+{
+  Image expected = img;
+  Image actual = img;
+  for (int level = 1; level <= numLevels; level++) {
+    expected = reference(expected, bayer);
+    actual = bin(actual, bayer, band);
+    ASSERT_EQ(actual.width, expected.width) << what << " level " << level;
+    ASSERT_EQ(actual.height, expected.height) << what << " level " << level;
+    for (int y = 0; y < actual.height; y++) {
+      for (int x = 0; x < actual.width * actual.bpp; x++) {
+        ASSERT_EQ(
+          actual.data[y * actual.step + x],
+          expected.data[y * expected.step + x])
+          << what << " level " << level << " at byte " << x << ", row " << y;
+      }
+      for (size_t x = actual.width * actual.bpp; x < actual.step; x++) {
+        ASSERT_EQ(actual.data[y * actual.step + x], 0xEE)
+          << what << " padding of level " << level;
+      }
+    }
+  }
+}
+}  // namespace
+
+TEST(Binning, Size)
+{
+  int w, h;
+  bin2x2_size(101, 51, false, &w, &h);
+  EXPECT_EQ(w, 50);
+  EXPECT_EQ(h, 25);
+  // Bayer images keep whole cells
+  bin2x2_size(101, 51, true, &w, &h);
+  EXPECT_EQ(w, 50);
+  EXPECT_EQ(h, 24);
+  bin2x2_size(102, 54, true, &w, &h);
+  EXPECT_EQ(w, 50);
+  EXPECT_EQ(h, 26);
+  bin2x2_size(3, 3, true, &w, &h);
+  EXPECT_EQ(w, 0);
+  EXPECT_EQ(h, 0);
+}
+
+TEST(Binning, Mono)
+{
+  std::mt19937 rng(3);
+  for (int width : widths) {
+    const Image img = make_image(width, 43, 1, &rng);
+    check_pyramid(img, false, 4, "mono width " + std::to_string(width));
+  }
+}
+
+TEST(Binning, Rgb)
+{
+  std::mt19937 rng(5);
+  for (int width : widths) {
+    const Image img = make_image(width, 27, 3, &rng);
+    check_pyramid(img, false, 3, "rgb width " + std::to_string(width));
+  }
+}
+
+TEST(Binning, Bayer)
+{
+  // The pattern is not a parameter: the reference keeps every pixel at
+  // its color phase, so all four phases are covered by the 2x2 cells.
+  // Shifting the image by a row and a column on top of that tests every
+  // phase in the top left corner.
+  std::mt19937 rng(9);
+  for (int width : widths) {
+    const Image img = make_image(width + 1, 50, 1, &rng);
+    for (int dy = 0; dy < 2; dy++) {
+      for (int dx = 0; dx < 2; dx++) {
+        Image shifted{width, 49, 1, img.step, {}};
+        shifted.data.assign(
+          img.data.begin() + dy * img.step + dx, img.data.end());
+        shifted.data.resize(shifted.step * shifted.height);
+        check_pyramid(
+          shifted, true, 2,
+          "bayer width " + std::to_string(width) + " phase " +
+            std::to_string(dx) + "," + std::to_string(dy));
+      }
+    }
+  }
+}
+
+TEST(Binning, RowRange)
+{
+  // bands can end past the last output row
+  std::mt19937 rng(11);
+  const Image img = make_image(71, 20, 1, &rng);
+  const Image expected = reference(img, false);
+  std::vector<uint8_t> dst(expected.step * 3, 0xEE);
+  bin2x2_rows(
+    img.data.data(), img.step, img.width, img.height, 1, false, dst.data(),
+    expected.step, 8, 100);
+  for (int y = 8; y < 10; y++) {
+    for (int x = 0; x < expected.width; x++) {
+      ASSERT_EQ(dst[(y - 8) * expected.step + x], expected.at(x, y, 0));
+    }
+  }
+  for (size_t i = 2 * expected.step; i < dst.size(); i++) {
+    ASSERT_EQ(dst[i], 0xEE);
+  }
+}
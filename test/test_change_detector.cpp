@@ -0,0 +1,198 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/change_detector.h>
+#include <flir_spinnaker_ros2/pixel_formats.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using flir_spinnaker_ros2::ChangeDetector;
+using flir_spinnaker_ros2::pack12_row;
+using flir_spinnaker_ros2::Packing;
+using flir_spinnaker_ros2::PACKING_12P;
+using flir_spinnaker_ros2::PACKING_12PACKED;
+using flir_spinnaker_ros2::PACKING_NONE;
+
+namespace
+{
+// 16 bit image with values < (1 << bits), step in pixels == width
+std::vector<uint16_t> random_image(
+  size_t n, int bits, std::mt19937 * rng)
+{
+  std::uniform_int_distribution<int> dist(0, (1 << bits) - 1);
+  std::vector<uint16_t> img(n);
+  for (auto & v : img) {
+    v = static_cast<uint16_t>(dist(*rng));
+  }
+  return (img);
+}
+
+// changes some of the values of a by up to +-maxDelta
+std::vector<uint16_t> perturb(
+  const std::vector<uint16_t> & a, int bits, int maxDelta, std::mt19937 * rng)
+{
+  std::uniform_int_distribution<int> dist(-maxDelta, maxDelta);
+  std::vector<uint16_t> b(a);
+  for (size_t i = 0; i < b.size(); i += 3) {
+    const int v = b[i] + dist(*rng);
+    b[i] = static_cast<uint16_t>(std::min(std::max(v, 0), (1 << bits) - 1));
+  }
+  return (b);
+}
+
+// straightforward version of what compare() computes
+double reference_fraction(
+  const std::vector<uint16_t> & a, const std::vector<uint16_t> & b,
+  int rowLength, int height, int bits, int subsample, int threshold)
+{
+  const int shift = std::max(bits - 8, 0);
+  size_t changed = 0;
+  size_t total = 0;
+  for (int r = 0; r < height; r += subsample) {
+    for (int x = 0; x < rowLength; x++) {
+      const size_t i = static_cast<size_t>(r) * rowLength + x;
+      const int va = std::min(a[i] >> shift, 255);
+      const int vb = std::min(b[i] >> shift, 255);
+      changed += std::abs(va - vb) > threshold;
+      total++;
+    }
+  }
+  return (static_cast<double>(changed) / total);
+}
+
+std::vector<uint8_t> to_8bit(const std::vector<uint16_t> & img)
+{
+  return (std::vector<uint8_t>(img.begin(), img.end()));
+}
+
+std::vector<uint8_t> to_bytes(const std::vector<uint16_t> & img)
+{
+  const uint8_t * p = reinterpret_cast<const uint8_t *>(img.data());
+  return (std::vector<uint8_t>(p, p + img.size() * 2));
+}
+
+std::vector<uint8_t> to_packed(
+  const std::vector<uint16_t> & img, int width, int height, Packing packing,
+  size_t step)
+{
+  std::vector<uint8_t> packed(step * height);
+  for (int r = 0; r < height; r++) {
+    pack12_row(img.data() + r * width, width, packing, &packed[r * step]);
+  }
+  return (packed);
+}
+}  // namespace
+
+TEST(ChangeDetector, NeedsReference)
+{
+  ChangeDetector cd;
+  cd.configure(1, 0);
+  std::vector<uint8_t> img(64 * 8, 7);
+  EXPECT_EQ(cd.compare(img.data(), 64, 64, 8, 1, 8, PACKING_NONE), 1.0);
+  // without accept() there is still no reference
+  EXPECT_EQ(cd.compare(img.data(), 64, 64, 8, 1, 8, PACKING_NONE), 1.0);
+  cd.accept();
+  EXPECT_EQ(cd.compare(img.data(), 64, 64, 8, 1, 8, PACKING_NONE), 0.0);
+  // size change
+  EXPECT_EQ(cd.compare(img.data(), 32, 32, 8, 1, 8, PACKING_NONE), 1.0);
+  EXPECT_EQ(cd.compare(img.data(), 64, 64, 4, 1, 8, PACKING_NONE), 1.0);
+  // configure() drops the reference
+  cd.accept();
+  cd.configure(1, 0);
+  EXPECT_EQ(cd.compare(img.data(), 64, 64, 4, 1, 8, PACKING_NONE), 1.0);
+}
+
+TEST(ChangeDetector, Compare8Bit)
+{
+  std::mt19937 rng(1);
+  // odd widths exercise the tails after the vector loops
+  for (int width : {1, 15, 16, 33, 100, 640}) {
+    for (int channels : {1, 3}) {
+      for (int subsample : {1, 3, 8}) {
+        for (int threshold : {0, 5, 16, 255}) {
+          const int height = 17;
+          const int rowLength = width * channels;
+          const auto a = random_image(rowLength * height, 8, &rng);
+          const auto b = perturb(a, 8, 40, &rng);
+          const auto a8 = to_8bit(a);
+          const auto b8 = to_8bit(b);
+          ChangeDetector cd;
+          cd.configure(subsample, threshold);
+          cd.compare(
+            a8.data(), rowLength, width, height, channels, 8, PACKING_NONE);
+          cd.accept();
+          EXPECT_DOUBLE_EQ(
+            cd.compare(
+              b8.data(), rowLength, width, height, channels, 8, PACKING_NONE),
+            reference_fraction(
+              a, b, rowLength, height, 8, subsample, threshold))
+            << "width " << width << " channels " << channels << " subsample "
+            << subsample << " threshold " << threshold;
+        }
+      }
+    }
+  }
+}
+
+TEST(ChangeDetector, Compare16Bit)
+{
+  std::mt19937 rng(2);
+  for (int bits : {10, 12, 16}) {
+    for (int width : {7, 64, 301}) {
+      const int height = 20;
+      const auto a = random_image(width * height, bits, &rng);
+      const auto b = perturb(a, bits, 40 << (bits - 8), &rng);
+      const auto a16 = to_bytes(a);
+      const auto b16 = to_bytes(b);
+      ChangeDetector cd;
+      cd.configure(2, 16);
+      cd.compare(a16.data(), width * 2, width, height, 1, bits, PACKING_NONE);
+      cd.accept();
+      EXPECT_DOUBLE_EQ(
+        cd.compare(
+          b16.data(), width * 2, width, height, 1, bits, PACKING_NONE),
+        reference_fraction(a, b, width, height, bits, 2, 16))
+        << "bits " << bits << " width " << width;
+    }
+  }
+}
+
+TEST(ChangeDetector, Compare12Packed)
+{
+  std::mt19937 rng(3);
+  for (Packing packing : {PACKING_12P, PACKING_12PACKED}) {
+    for (int width : {2, 31, 640}) {
+      const int height = 9;
+      const size_t step = (3 * width + 1) / 2 + 4;  // with padding
+      const auto a = random_image(width * height, 12, &rng);
+      const auto b = perturb(a, 12, 40 << 4, &rng);
+      const auto ap = to_packed(a, width, height, packing, step);
+      const auto bp = to_packed(b, width, height, packing, step);
+      ChangeDetector cd;
+      cd.configure(3, 10);
+      cd.compare(ap.data(), step, width, height, 1, 12, packing);
+      cd.accept();
+      EXPECT_DOUBLE_EQ(
+        cd.compare(bp.data(), step, width, height, 1, 12, packing),
+        reference_fraction(a, b, width, height, 12, 3, 10))
+        << "packing " << packing << " width " << width;
+    }
+  }
+}
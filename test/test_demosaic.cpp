@@ -0,0 +1,210 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/demosaic.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using flir_spinnaker_ros2::BayerPattern;
+using flir_spinnaker_ros2::BGGR;
+using flir_spinnaker_ros2::DEMOSAIC_BILINEAR;
+using flir_spinnaker_ros2::DEMOSAIC_EDGE_AWARE;
+using flir_spinnaker_ros2::demosaic_method_from_string;
+using flir_spinnaker_ros2::demosaic_rows;
+using flir_spinnaker_ros2::DemosaicMethod;
+using flir_spinnaker_ros2::GBRG;
+using flir_spinnaker_ros2::GRBG;
+using flir_spinnaker_ros2::RGGB;
+
+namespace
+{
+enum Color { R = 0, G = 1, B = 2 };
+
+const BayerPattern patterns[] = {RGGB, GRBG, GBRG, BGGR};
+const DemosaicMethod methods[] = {DEMOSAIC_BILINEAR, DEMOSAIC_EDGE_AWARE};
+// none of them a multiple of the vector width
+const int widths[] = {2, 4, 6, 18, 34, 62, 98};
+
+int avg(int a, int b) { return ((a + b + 1) >> 1); }
+
+Color color_at(BayerPattern pattern, int x, int y)
+{
+  static const Color colors[4][4] = {
+    {R, G, G, B}, {G, R, B, G}, {G, B, R, G}, {B, G, G, R}};
+  return (colors[pattern][(y & 1) * 2 + (x & 1)]);
+}
+
+// pixels beyond the border are mirrored about it
+int mirror(int i, int n) { return (i < 0 ? 1 : (i >= n ? n - 2 : i)); }
+
+struct Image
+{
+  int width, height;
+  size_t step;
+  std::vector<uint8_t> data;
+  int at(int x, int y) const
+  {
+    return (data[mirror(y, height) * step + mirror(x, width)]);
+  }
+};
+
+// random image with row padding, with a few hard edges in it, so the
+// edge aware method has gradients to pick from
+Image make_image(int width, int height, std::mt19937 * rng)
+{
+  Image img{width, height, static_cast<size_t>(width) + 3, {}};
+  img.data.resize(img.step * height, 0xEE);
+  std::uniform_int_distribution<int> dist(0, 255);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int v = dist(*rng);
+      if ((x / 5 + y / 3) % 3 == 0) {
+        v = (x % 7 < 3) ? 255 : 0;
+      }
+      img.data[y * img.step + x] = static_cast<uint8_t>(v);
+    }
+  }
+  return (img);
+}
+
+// the interpolation rules, written out per color
+void reference_pixel(
+  const Image & img, BayerPattern pattern, DemosaicMethod method, int x,
+  int y, int * rgb)
+{
+  const int c = img.at(x, y);
+  const int h = avg(img.at(x - 1, y), img.at(x + 1, y));
+  const int v = avg(img.at(x, y - 1), img.at(x, y + 1));
+  const Color own = color_at(pattern, x, y);
+  if (own == G) {
+    rgb[G] = c;
+    rgb[color_at(pattern, x + 1, y)] = h;
+    rgb[color_at(pattern, x, y + 1)] = v;
+    return;
+  }
+  int green = avg(v, h);
+  if (method == DEMOSAIC_EDGE_AWARE) {
+    const int dh = std::abs(img.at(x - 1, y) - img.at(x + 1, y));
+    const int dv = std::abs(img.at(x, y - 1) - img.at(x, y + 1));
+    if (dv > dh) {
+      green = h;
+    } else if (dh > dv) {
+      green = v;
+    }
+  }
+  rgb[own] = c;
+  rgb[G] = green;
+  rgb[own == R ? B : R] = avg(
+    avg(img.at(x - 1, y - 1), img.at(x + 1, y - 1)),
+    avg(img.at(x - 1, y + 1), img.at(x + 1, y + 1)));
+}
+
+void check(
+  const Image & img, BayerPattern pattern, DemosaicMethod method, bool bgr,
+  int rowBegin, int rowEnd)
+{
+  const size_t dstStep = 3 * img.width + 5;
+  std::vector<uint8_t> dst(dstStep * (rowEnd - rowBegin), 0xEE);
+  demosaic_rows(
+    img.data.data(), img.step, img.width, img.height, pattern, method, bgr,
+    dst.data(), dstStep, rowBegin, rowEnd);
+  for (int y = rowBegin; y < rowEnd; y++) {
+    const uint8_t * row = &dst[(y - rowBegin) * dstStep];
+    for (int x = 0; x < img.width; x++) {
+      int rgb[3];
+      reference_pixel(img, pattern, method, x, y, rgb);
+      const uint8_t * p = row + 3 * x;
+      ASSERT_EQ(p[bgr ? 2 : 0], rgb[R])
+        << "pattern " << pattern << " method " << method << " width "
+        << img.width << " at " << x << "," << y;
+      ASSERT_EQ(p[1], rgb[G])
+        << "pattern " << pattern << " method " << method << " width "
+        << img.width << " at " << x << "," << y;
+      ASSERT_EQ(p[bgr ? 0 : 2], rgb[B])
+        << "pattern " << pattern << " method " << method << " width "
+        << img.width << " at " << x << "," << y;
+    }
+    // the row padding is left alone
+    ASSERT_EQ(row[3 * img.width], 0xEE);
+  }
+}
+}  // namespace
+
+TEST(Demosaic, MatchesReference)
+{
+  std::mt19937 rng(42);
+  for (int width : widths) {
+    const Image img = make_image(width, 6, &rng);
+    for (BayerPattern pattern : patterns) {
+      for (DemosaicMethod method : methods) {
+        check(img, pattern, method, false, 0, img.height);
+      }
+    }
+  }
+}
+
+TEST(Demosaic, Bgr)
+{
+  std::mt19937 rng(1);
+  const Image img = make_image(34, 4, &rng);
+  for (BayerPattern pattern : patterns) {
+    for (DemosaicMethod method : methods) {
+      check(img, pattern, method, true, 0, img.height);
+    }
+  }
+}
+
+TEST(Demosaic, RowRanges)
+{
+  // bands are converted independently by the worker threads
+  std::mt19937 rng(7);
+  const Image img = make_image(62, 10, &rng);
+  for (BayerPattern pattern : patterns) {
+    check(img, pattern, DEMOSAIC_EDGE_AWARE, false, 0, 1);
+    check(img, pattern, DEMOSAIC_EDGE_AWARE, false, 3, 7);
+    check(img, pattern, DEMOSAIC_EDGE_AWARE, true, 9, 10);
+  }
+}
+
+TEST(Demosaic, Flat)
+{
+  // a gray image stays gray, up to the rounding of the averages
+  const int width = 66, height = 4;
+  const std::vector<uint8_t> src(width * height, 77);
+  std::vector<uint8_t> dst(3 * width * height);
+  for (BayerPattern pattern : patterns) {
+    demosaic_rows(
+      src.data(), width, width, height, pattern, DEMOSAIC_EDGE_AWARE, false,
+      dst.data(), 3 * width, 0, height);
+    for (uint8_t v : dst) {
+      ASSERT_EQ(v, 77);
+    }
+  }
+}
+
+TEST(Demosaic, MethodFromString)
+{
+  DemosaicMethod m = DEMOSAIC_BILINEAR;
+  EXPECT_TRUE(demosaic_method_from_string("edge_aware", &m));
+  EXPECT_EQ(m, DEMOSAIC_EDGE_AWARE);
+  EXPECT_TRUE(demosaic_method_from_string("bilinear", &m));
+  EXPECT_EQ(m, DEMOSAIC_BILINEAR);
+  EXPECT_FALSE(demosaic_method_from_string("vng", &m));
+  EXPECT_EQ(m, DEMOSAIC_BILINEAR);
+}
@@ -0,0 +1,198 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/exposure_controller.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+using flir_spinnaker_ros2::ExposureController;
+using Setting = ExposureController::Setting;
+
+namespace
+{
+//
+// Camera looking at a scene of fixed radiance: brightness is
+// proportional to exposure time times linear gain, and a new setting
+// shows first in the delay'th frame after the change (delay >= 1).
+//
+class SimulatedCamera
+{
+public:
+  SimulatedCamera(double radiance, int delay, const Setting & initial)
+  : radiance_(radiance), pipeline_(delay, initial), setting_(initial)
+  {
+  }
+  double brightness() const
+  {
+    const Setting & s = frameSetting();
+    return (std::min(
+      radiance_ * s.exposureTime * std::pow(10.0, s.gain / 20.0), 255.0));
+  }
+  const Setting & frameSetting() const { return (pipeline_.front()); }
+  void set(const Setting & s) { setting_ = s; }
+  void nextFrame()
+  {
+    pipeline_.push_back(setting_);
+    pipeline_.pop_front();
+  }
+  void setDropSettings(bool d) { dropSettings_ = d; }
+  bool dropsSettings() const { return (dropSettings_); }
+
+private:
+  double radiance_;
+  std::deque<Setting> pipeline_;  // front: setting of the current frame
+  Setting setting_;               // for frames yet to be taken
+  bool dropSettings_{false};
+};
+
+Setting setting(double exposureTime, double gain)
+{
+  Setting s;
+  s.exposureTime = exposureTime;
+  s.gain = gain;
+  return (s);
+}
+
+// runs the loop for n frames, returns the number of changes
+int run(
+  ExposureController * ec, SimulatedCamera * cam, int n,
+  bool reportSetting = true)
+{
+  int changes = 0;
+  for (int i = 0; i < n; i++) {
+    const Setting & f = cam->frameSetting();
+    Setting next;
+    if (ec->update(
+          cam->brightness(), reportSetting ? f.exposureTime : 0,
+          reportSetting ? f.gain : 0, &next)) {
+      changes++;
+      ec->setApplied(next);
+      if (!cam->dropsSettings()) {
+        cam->set(next);
+      }
+    }
+    cam->nextFrame();
+  }
+  return (changes);
+}
+}  // namespace
+
+TEST(ExposureController, Converges)
+{
+  ExposureController::Config cfg;
+  for (double start : {100.0, 9000.0}) {
+    ExposureController ec(cfg);
+    // target reached at 2000 usec, no gain needed
+    SimulatedCamera cam(cfg.brightnessTarget / 2000.0, 1, setting(start, 0));
+    run(&ec, &cam, 30);
+    EXPECT_NEAR(cam.brightness(), cfg.brightnessTarget, cfg.brightnessTolerance)
+      << "start " << start;
+    EXPECT_NEAR(cam.frameSetting().exposureTime, 2000, 100);
+    EXPECT_EQ(cam.frameSetting().gain, 0);
+    // and stays there
+    EXPECT_EQ(run(&ec, &cam, 30), 0);
+  }
+}
+
+TEST(ExposureController, WaitsForSettingToLand)
+{
+  ExposureController::Config cfg;
+  cfg.maxFramesSkip = 10;
+  for (int delay : {1, 2, 4, 6}) {
+    ExposureController ec(cfg);
+    SimulatedCamera cam(cfg.brightnessTarget / 5000.0, delay, setting(100, 0));
+    const int changes = run(&ec, &cam, 100);
+    EXPECT_NEAR(cam.brightness(), cfg.brightnessTarget, cfg.brightnessTolerance)
+      << "delay " << delay;
+    // from 100 to 5000 usec in steps of at most 4x, no overshoot from
+    // reacting to stale frames
+    EXPECT_EQ(changes, 3) << "delay " << delay;
+    const auto stats = ec.getAndResetStats();
+    EXPECT_EQ(stats.numChanges, changes);
+    EXPECT_EQ(stats.numLanded, changes);
+    EXPECT_DOUBLE_EQ(stats.avgLatency, delay);
+    // reset
+    const auto none = ec.getAndResetStats();
+    EXPECT_EQ(none.numChanges, 0);
+    EXPECT_EQ(none.numLanded, 0);
+    EXPECT_EQ(none.avgLatency, 0);
+  }
+}
+
+TEST(ExposureController, SettingNeverLands)
+{
+  ExposureController::Config cfg;
+  cfg.maxFramesSkip = 4;
+  ExposureController ec(cfg);
+  SimulatedCamera cam(cfg.brightnessTarget / 5000.0, 1, setting(100, 0));
+  cam.setDropSettings(true);
+  // one change per maxFramesSkip frames
+  EXPECT_EQ(run(&ec, &cam, 40), 10);
+  const auto stats = ec.getAndResetStats();
+  EXPECT_EQ(stats.numChanges, 10);
+  EXPECT_EQ(stats.numLanded, 0);
+  EXPECT_EQ(stats.avgLatency, 0);
+}
+
+TEST(ExposureController, WithoutReportedSetting)
+{
+  ExposureController::Config cfg;
+  cfg.maxFramesSkip = 3;
+  ExposureController ec(cfg);
+  SimulatedCamera cam(
+    cfg.brightnessTarget / 3000.0, 1, setting(cfg.minExposureTime, 0));
+  run(&ec, &cam, 60, false);
+  EXPECT_NEAR(cam.brightness(), cfg.brightnessTarget, cfg.brightnessTolerance);
+}
+
+TEST(ExposureController, GainPriority)
+{
+  ExposureController::Config cfg;
+  // needs 4x (12 dB) over the longest exposure time
+  const double radiance = cfg.brightnessTarget / (4 * cfg.maxExposureTime);
+  {
+    ExposureController ec(cfg);
+    SimulatedCamera cam(radiance, 1, setting(1000, 0));
+    run(&ec, &cam, 50);
+    // exposure time first, then the maximum gain, and that is it
+    EXPECT_EQ(cam.frameSetting().exposureTime, cfg.maxExposureTime);
+    EXPECT_EQ(cam.frameSetting().gain, cfg.maxGain);
+    EXPECT_LT(cam.brightness(), cfg.brightnessTarget);
+    EXPECT_EQ(run(&ec, &cam, 10), 0);
+  }
+  {
+    cfg.gainPriority = true;
+    cfg.maxGain = 20;
+    ExposureController ec(cfg);
+    SimulatedCamera cam(radiance * 100, 1, setting(1000, 0));
+    run(&ec, &cam, 50);
+    EXPECT_NEAR(
+      cam.brightness(), cfg.brightnessTarget, cfg.brightnessTolerance);
+    // 4x over the shortest exposure time by gain, 12 dB
+    EXPECT_NEAR(cam.frameSetting().exposureTime, cfg.minExposureTime, 1);
+    EXPECT_NEAR(cam.frameSetting().gain, 12, 0.5);
+  }
+}
+
+TEST(ExposureController, NoBrightness)
+{
+  ExposureController ec{ExposureController::Config()};
+  Setting next;
+  EXPECT_FALSE(ec.update(-1, 1000, 0, &next));
+  EXPECT_EQ(ec.getAndResetStats().numChanges, 0);
+}
@@ -0,0 +1,262 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/flat_field.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::FlatField;
+using flir_spinnaker_ros2::read_pgm;
+using flir_spinnaker_ros2::ReferenceImage;
+using flir_spinnaker_ros2::write_pgm;
+
+namespace
+{
+const int GAIN_BITS = 12;
+
+ReferenceImage make_image(
+  int width, int height, int bytesPerPixel, int lo, int hi,
+  std::mt19937 * rng)
+{
+  ReferenceImage img;
+  img.width = width;
+  img.height = height;
+  img.bytesPerPixel = bytesPerPixel;
+  std::uniform_int_distribution<int> dist(lo, hi);
+  img.data.resize(static_cast<size_t>(width) * height);
+  for (auto & v : img.data) {
+    v = static_cast<uint16_t>(dist(*rng));
+  }
+  return (img);
+}
+
+// the per pixel gain as documented in flat_field.h
+std::vector<int> reference_gain(
+  const ReferenceImage & dark, const ReferenceImage & flat)
+{
+  const int w = flat.width;
+  double sum[4] = {0, 0, 0, 0};
+  double count[4] = {0, 0, 0, 0};
+  for (int y = 0; y < flat.height; y++) {
+    for (int x = 0; x < w; x++) {
+      const int c = (y & 1) * 2 + (x & 1);
+      sum[c] += std::max(flat.data[y * w + x] - dark.data[y * w + x], 0);
+      count[c]++;
+    }
+  }
+  std::vector<int> gain(flat.data.size());
+  for (int y = 0; y < flat.height; y++) {
+    for (int x = 0; x < w; x++) {
+      const int c = (y & 1) * 2 + (x & 1);
+      const int s = flat.data[y * w + x] - dark.data[y * w + x];
+      gain[y * w + x] =
+        s > 0 ? std::min(
+                  static_cast<int>(
+                    std::round(sum[c] / count[c] / s * (1 << GAIN_BITS))),
+                  65535)
+              : 1 << GAIN_BITS;
+    }
+  }
+  return (gain);
+}
+
+int correct_pixel(int v, int dark, int gain, int maxValue)
+{
+  const int64_t d = std::max(v - dark, 0);
+  const int64_t r = (d * gain + (1 << (GAIN_BITS - 1))) >> GAIN_BITS;
+  return (static_cast<int>(std::min(r, static_cast<int64_t>(maxValue))));
+}
+
+// corrects a random image with FlatField and the reference, in place
+// and in two row ranges
+void check_correction(
+  const ReferenceImage & dark, const ReferenceImage & flat,
+  std::mt19937 * rng)
+{
+  FlatField ff;
+  ASSERT_EQ(ff.init(dark, flat), "OK");
+  const int w = flat.width;
+  const int h = flat.height;
+  const int bpp = flat.bytesPerPixel;
+  const int maxValue = bpp == 1 ? 255 : 65535;
+  const auto gain = reference_gain(dark, flat);
+  const auto in = make_image(w, h, bpp, 0, maxValue, rng);
+  // padded rows
+  const size_t srcStep = w * bpp + 6;
+  const size_t dstStep = w * bpp + 2;
+  std::vector<uint16_t> srcBuf(srcStep * h / 2 + 1);
+  uint8_t * src = reinterpret_cast<uint8_t *>(srcBuf.data());
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      const uint16_t v = in.data[y * w + x];
+      if (bpp == 1) {
+        src[y * srcStep + x] = static_cast<uint8_t>(v);
+      } else {
+        reinterpret_cast<uint16_t *>(src + y * srcStep)[x] = v;
+      }
+    }
+  }
+  std::vector<uint16_t> dstBuf(dstStep * h / 2 + 1);
+  uint8_t * dst = reinterpret_cast<uint8_t *>(dstBuf.data());
+  const int split = h / 3;
+  ff.correctRows(src, srcStep, dst, dstStep, 0, split);
+  ff.correctRows(
+    src + split * srcStep, srcStep, dst + split * dstStep, dstStep, split, h);
+  std::vector<uint16_t> inPlace(srcBuf);
+  uint8_t * ip = reinterpret_cast<uint8_t *>(inPlace.data());
+  ff.correctRows(ip, srcStep, ip, srcStep, 0, h);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      const size_t i = y * w + x;
+      const int expected =
+        correct_pixel(in.data[i], dark.data[i], gain[i], maxValue);
+      const int got = bpp == 1
+                        ? dst[y * dstStep + x]
+                        : reinterpret_cast<uint16_t *>(dst + y * dstStep)[x];
+      const int gotInPlace =
+        bpp == 1 ? ip[y * srcStep + x]
+                 : reinterpret_cast<uint16_t *>(ip + y * srcStep)[x];
+      ASSERT_EQ(got, expected) << "x " << x << " y " << y << " w " << w;
+      ASSERT_EQ(gotInPlace, expected) << "x " << x << " y " << y;
+    }
+  }
+}
+
+std::string temp_file(const std::string & name)
+{
+  return (::testing::TempDir() + name);
+}
+}  // namespace
+
+TEST(FlatField, Init)
+{
+  std::mt19937 rng(1);
+  FlatField ff;
+  EXPECT_NE(ff.init(ReferenceImage(), ReferenceImage()), "OK");
+  const auto a = make_image(8, 4, 1, 0, 10, &rng);
+  const auto b = make_image(8, 6, 1, 100, 200, &rng);
+  EXPECT_NE(ff.init(a, b), "OK");
+  auto c = a;
+  c.data.pop_back();
+  EXPECT_NE(ff.init(c, ReferenceImage()), "OK");
+  EXPECT_EQ(ff.init(a, ReferenceImage()), "OK");
+  EXPECT_EQ(ff.getWidth(), 8);
+  EXPECT_EQ(ff.getHeight(), 4);
+  EXPECT_EQ(ff.getBytesPerPixel(), 1);
+}
+
+TEST(FlatField, DarkOnly)
+{
+  std::mt19937 rng(2);
+  const auto dark = make_image(37, 5, 1, 0, 30, &rng);
+  FlatField ff;
+  ASSERT_EQ(ff.init(dark, ReferenceImage()), "OK");
+  const auto in = make_image(37, 5, 1, 0, 255, &rng);
+  std::vector<uint8_t> src(in.data.begin(), in.data.end());
+  std::vector<uint8_t> dst(src.size());
+  ff.correctRows(src.data(), 37, dst.data(), 37, 0, 5);
+  for (size_t i = 0; i < src.size(); i++) {
+    EXPECT_EQ(dst[i], std::max(src[i] - dark.data[i], 0));
+  }
+}
+
+TEST(FlatField, Correct8Bit)
+{
+  std::mt19937 rng(3);
+  // widths around the vector sizes to exercise the scalar tails
+  for (int w : {1, 2, 15, 16, 17, 31, 32, 33, 64, 101}) {
+    const auto dark = make_image(w, 7, 1, 0, 20, &rng);
+    const auto flat = make_image(w, 7, 1, 60, 255, &rng);
+    check_correction(dark, flat, &rng);
+    // flat only, with dead pixels
+    ReferenceImage none = make_image(w, 7, 1, 0, 0, &rng);
+    auto dead = make_image(w, 7, 1, 0, 255, &rng);
+    check_correction(none, dead, &rng);
+  }
+}
+
+TEST(FlatField, Correct16Bit)
+{
+  std::mt19937 rng(4);
+  for (int w : {1, 7, 8, 9, 16, 17, 33, 100}) {
+    const auto dark = make_image(w, 6, 2, 0, 500, &rng);
+    // up to 16x gain, which saturates bright pixels
+    const auto flat = make_image(w, 6, 2, 4000, 65535, &rng);
+    check_correction(dark, flat, &rng);
+    const auto flat12 = make_image(w, 6, 2, 1000, 4095, &rng);
+    check_correction(make_image(w, 6, 2, 0, 0, &rng), flat12, &rng);
+  }
+}
+
+TEST(Pgm, RoundTrip)
+{
+  std::mt19937 rng(5);
+  for (int bpp : {1, 2}) {
+    const auto img = make_image(13, 7, bpp, 0, bpp == 1 ? 255 : 65535, &rng);
+    const std::string fileName = temp_file("flat_field_test.pgm");
+    ASSERT_EQ(write_pgm(fileName, img), "OK");
+    ReferenceImage back;
+    ASSERT_EQ(read_pgm(fileName, &back), "OK");
+    EXPECT_EQ(back.width, img.width);
+    EXPECT_EQ(back.height, img.height);
+    EXPECT_EQ(back.bytesPerPixel, bpp);
+    EXPECT_EQ(back.data, img.data);
+    std::remove(fileName.c_str());
+  }
+}
+
+TEST(Pgm, HeaderComments)
+{
+  const std::string fileName = temp_file("flat_field_comments.pgm");
+  {
+    std::ofstream f(fileName, std::ios::binary);
+    f << "P5\n# made by hand\n3 # width\n2\n# max\n1000\n";
+    const uint8_t px[12] = {0, 1, 0, 2, 0, 3, 3, 232, 1, 0, 0, 0};
+    f.write(reinterpret_cast<const char *>(px), sizeof(px));
+  }
+  ReferenceImage img;
+  ASSERT_EQ(read_pgm(fileName, &img), "OK");
+  EXPECT_EQ(img.width, 3);
+  EXPECT_EQ(img.height, 2);
+  EXPECT_EQ(img.bytesPerPixel, 2);
+  EXPECT_EQ(img.data, std::vector<uint16_t>({1, 2, 3, 1000, 256, 0}));
+  std::remove(fileName.c_str());
+}
+
+TEST(Pgm, Errors)
+{
+  ReferenceImage img;
+  EXPECT_NE(read_pgm(temp_file("does_not_exist.pgm"), &img), "OK");
+  const std::string fileName = temp_file("flat_field_bad.pgm");
+  {
+    std::ofstream f(fileName, std::ios::binary);
+    f << "P2\n2 2\n255\n0 0 0 0\n";
+  }
+  EXPECT_NE(read_pgm(fileName, &img), "OK");
+  {
+    std::ofstream f(fileName, std::ios::binary);
+    f << "P5\n4 4\n255\n" << std::string(15, 'x');  // one byte short
+  }
+  EXPECT_NE(read_pgm(fileName, &img), "OK");
+  std::remove(fileName.c_str());
+}
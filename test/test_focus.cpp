@@ -0,0 +1,244 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/focus.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using flir_spinnaker_ros2::compute_focus;
+using flir_spinnaker_ros2::FocusConfig;
+using flir_spinnaker_ros2::FocusResult;
+
+namespace
+{
+// image with 8 or 16 bit values and padded rows
+struct Image
+{
+  Image(int w, int h, int ch, int b)
+  : width(w), height(h), channels(ch), bits(b)
+  {
+    step = (w * ch + 5) * bytesPerValue();
+    data.resize(step * h / 2 + 1);
+  }
+  int bytesPerValue() const { return (bits <= 8 ? 1 : 2); }
+  int get(int x, int y, int c) const
+  {
+    const uint8_t * row = bytes() + y * step;
+    const int i = x * channels + c;
+    return (
+      bits <= 8 ? row[i] : reinterpret_cast<const uint16_t *>(row)[i]);
+  }
+  void set(int x, int y, int c, int v)
+  {
+    uint8_t * row = reinterpret_cast<uint8_t *>(data.data()) + y * step;
+    const int i = x * channels + c;
+    if (bits <= 8) {
+      row[i] = static_cast<uint8_t>(v);
+    } else {
+      reinterpret_cast<uint16_t *>(row)[i] = static_cast<uint16_t>(v);
+    }
+  }
+  const uint8_t * bytes() const
+  {
+    return (reinterpret_cast<const uint8_t *>(data.data()));
+  }
+  int width, height, channels, bits;
+  size_t step;
+  std::vector<uint16_t> data;  // for alignment
+};
+
+Image random_image(int w, int h, int ch, int bits, std::mt19937 * rng)
+{
+  Image img(w, h, ch, bits);
+  std::uniform_int_distribution<int> dist(0, (1 << bits) - 1);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      for (int c = 0; c < ch; c++) {
+        img.set(x, y, c, dist(*rng));
+      }
+    }
+  }
+  return (img);
+}
+
+// maximum Laplacian everywhere
+Image checkerboard(int w, int h, int bits)
+{
+  Image img(w, h, 1, bits);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      img.set(x, y, 0, ((x + y) & 1) ? (1 << bits) - 1 : 0);
+    }
+  }
+  return (img);
+}
+
+// straightforward two pass version in double precision
+FocusResult reference(
+  const FocusConfig & cfg, const Image & img, bool bayer)
+{
+  const int u = bayer ? 2 : 1;
+  const int x0 = std::min(std::max(cfg.x, 0), img.width);
+  const int y0 = std::min(std::max(cfg.y, 0), img.height);
+  const int x1 =
+    cfg.width > 0 ? std::min(x0 + cfg.width, img.width) : img.width;
+  const int y1 =
+    cfg.height > 0 ? std::min(y0 + cfg.height, img.height) : img.height;
+  std::vector<double> lap;
+  double sumValue = 0;
+  for (int y = std::max(y0, u); y < std::min(y1, img.height - u);
+       y += std::max(cfg.stride, 1)) {
+    for (int x = std::max(x0, u); x < std::min(x1, img.width - u); x++) {
+      for (int c = 0; c < img.channels; c++) {
+        lap.push_back(
+          4.0 * img.get(x, y, c) - img.get(x, y - u, c) -
+          img.get(x, y + u, c) - img.get(x - u, y, c) - img.get(x + u, y, c));
+        sumValue += img.get(x, y, c);
+      }
+    }
+  }
+  FocusResult r;
+  r.count = lap.size();
+  double mean = 0;
+  for (double l : lap) {
+    mean += l;
+  }
+  mean /= lap.size();
+  for (double l : lap) {
+    r.laplacianVariance += (l - mean) * (l - mean);
+  }
+  r.laplacianVariance /= lap.size();
+  r.mean = sumValue / lap.size();
+  return (r);
+}
+
+void check(const FocusConfig & cfg, const Image & img, bool bayer)
+{
+  FocusResult r;
+  ASSERT_TRUE(compute_focus(
+    cfg, img.bytes(), img.step, img.width, img.height, img.channels, bayer,
+    img.bits, &r));
+  const FocusResult e = reference(cfg, img, bayer);
+  EXPECT_EQ(r.count, e.count);
+  EXPECT_NEAR(
+    r.laplacianVariance, e.laplacianVariance, 1e-9 * e.laplacianVariance);
+  EXPECT_NEAR(r.mean, e.mean, 1e-9 * e.mean);
+}
+}  // namespace
+
+TEST(Focus, MatchesReference)
+{
+  std::mt19937 rng(1);
+  FocusConfig cfg;
+  for (int bits : {8, 12, 16}) {
+    for (int channels : {1, 3}) {
+      for (bool bayer : {false, true}) {
+        if (bayer && channels != 1) {
+          continue;
+        }
+        // widths around the vector sizes to exercise the scalar tails
+        for (int w : {5, 17, 34, 35, 66, 300}) {
+          for (int stride : {1, 3}) {
+            cfg.stride = stride;
+            SCOPED_TRACE(
+              testing::Message()
+              << "bits " << bits << " channels " << channels << " bayer "
+              << bayer << " width " << w << " stride " << stride);
+            check(cfg, random_image(w, 11, channels, bits, &rng), bayer);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Focus, LongRowsAtMaximum)
+{
+  // enough 8 bit values to need the flushes of the 32 bit sums
+  const FocusConfig cfg;
+  check(cfg, checkerboard(40000, 3, 8), false);
+  check(cfg, checkerboard(40000, 5, 8), true);
+  check(cfg, checkerboard(40000, 3, 12), false);
+  check(cfg, checkerboard(4000, 3, 16), false);
+}
+
+TEST(Focus, Region)
+{
+  std::mt19937 rng(2);
+  const Image img = random_image(100, 50, 1, 8, &rng);
+  FocusConfig cfg;
+  cfg.x = 10;
+  cfg.y = 20;
+  cfg.width = 30;
+  cfg.height = 15;
+  check(cfg, img, false);
+  FocusResult r;
+  ASSERT_TRUE(compute_focus(
+    cfg, img.bytes(), img.step, img.width, img.height, 1, false, 8, &r));
+  EXPECT_EQ(r.x, 10);
+  EXPECT_EQ(r.y, 20);
+  EXPECT_EQ(r.width, 30);
+  EXPECT_EQ(r.height, 15);
+  // clipped to the image
+  cfg.x = 90;
+  cfg.y = -5;
+  cfg.height = 0;
+  check(cfg, img, false);
+  ASSERT_TRUE(compute_focus(
+    cfg, img.bytes(), img.step, img.width, img.height, 1, false, 8, &r));
+  EXPECT_EQ(r.x, 90);
+  EXPECT_EQ(r.y, 0);
+  EXPECT_EQ(r.width, 10);
+  EXPECT_EQ(r.height, 50);
+  // too small for the neighbors
+  cfg.x = 99;
+  EXPECT_FALSE(compute_focus(
+    cfg, img.bytes(), img.step, img.width, img.height, 1, false, 8, &r));
+  cfg.x = 0;
+  cfg.width = 2;
+  EXPECT_FALSE(compute_focus(
+    cfg, img.bytes(), img.step, img.width, img.height, 1, true, 8, &r));
+}
+
+TEST(Focus, BlurLowersVariance)
+{
+  std::mt19937 rng(3);
+  const Image sharp = random_image(64, 64, 1, 8, &rng);
+  Image blurred(64, 64, 1, 8);
+  for (int y = 0; y < 64; y++) {
+    for (int x = 0; x < 64; x++) {
+      int s = 0;
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          s += sharp.get(
+            std::min(std::max(x + dx, 0), 63),
+            std::min(std::max(y + dy, 0), 63), 0);
+        }
+      }
+      blurred.set(x, y, 0, (s + 4) / 9);
+    }
+  }
+  FocusResult a, b;
+  const FocusConfig cfg;
+  ASSERT_TRUE(
+    compute_focus(cfg, sharp.bytes(), sharp.step, 64, 64, 1, false, 8, &a));
+  ASSERT_TRUE(compute_focus(
+    cfg, blurred.bytes(), blurred.step, 64, 64, 1, false, 8, &b));
+  EXPECT_LT(b.laplacianVariance, 0.2 * a.laplacianVariance);
+}
@@ -0,0 +1,177 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/frame_ring.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using flir_spinnaker_ros2::FrameRing;
+using flir_spinnaker_ros2::LatestFrame;
+
+namespace
+{
+const std::chrono::milliseconds timeout(1000);
+const int numFrames = 100000;
+
+// waitPop() may also return early after a stale wakeup, so keep trying
+// like the driver's publishing thread does, but not forever
+template <typename Q>
+bool pop_next(Q * q, int * v)
+{
+  const auto deadline = std::chrono::steady_clock::now() + 10 * timeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (q->waitPop(v, timeout)) {
+      return (true);
+    }
+  }
+  return (false);
+}
+}  // namespace
+
+TEST(FrameRing, Capacity)
+{
+  // the capacity is exact, even though the slots are a power of two
+  FrameRing<int> ring(3);
+  EXPECT_EQ(ring.capacity(), 3u);
+  int v = 0;
+  EXPECT_FALSE(ring.pop(&v));
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(ring.push(int(i)));
+  }
+  EXPECT_FALSE(ring.push(3));
+  EXPECT_EQ(ring.size(), 3u);
+  EXPECT_TRUE(ring.pop(&v));
+  EXPECT_EQ(v, 0);
+  EXPECT_TRUE(ring.push(4));
+  EXPECT_FALSE(ring.push(5));
+  for (int expected : {1, 2, 4}) {
+    EXPECT_TRUE(ring.pop(&v));
+    EXPECT_EQ(v, expected);
+  }
+  EXPECT_FALSE(ring.pop(&v));
+  EXPECT_EQ(ring.size(), 0u);
+}
+
+TEST(FrameRing, DropsReference)
+{
+  // the ring must not keep frames alive once they are popped
+  FrameRing<std::shared_ptr<int>> ring(2);
+  auto frame = std::make_shared<int>(1);
+  std::weak_ptr<int> weak(frame);
+  EXPECT_TRUE(ring.push(std::move(frame)));
+  std::shared_ptr<int> out;
+  EXPECT_TRUE(ring.pop(&out));
+  out.reset();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST(FrameRing, Ordering)
+{
+  // everything that was pushed arrives, in order
+  FrameRing<int> ring(4);
+  std::thread producer([&ring]() {
+    for (int i = 0; i < numFrames; i++) {
+      while (!ring.push(int(i))) {
+        std::this_thread::yield();  // full
+      }
+    }
+  });
+  int next = 0;
+  while (next < numFrames) {
+    int v = -1;
+    ASSERT_TRUE(pop_next(&ring, &v));
+    ASSERT_EQ(v, next);
+    next++;
+  }
+  producer.join();
+  EXPECT_FALSE(ring.pop(&next));
+}
+
+TEST(FrameRing, Wakeup)
+{
+  FrameRing<int> ring(2);
+  int v = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  EXPECT_FALSE(ring.waitPop(&v, std::chrono::milliseconds(10)));
+  EXPECT_GE(
+    std::chrono::steady_clock::now() - t0, std::chrono::milliseconds(10));
+  std::thread producer([&ring]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ring.push(7);
+  });
+  EXPECT_TRUE(pop_next(&ring, &v));
+  EXPECT_EQ(v, 7);
+  producer.join();
+}
+
+TEST(LatestFrame, Overwrite)
+{
+  LatestFrame<int> latest;
+  int v = 0;
+  EXPECT_FALSE(latest.pop(&v));
+  EXPECT_TRUE(latest.push(1));
+  EXPECT_FALSE(latest.push(2));  // replaces 1
+  EXPECT_FALSE(latest.push(3));
+  EXPECT_TRUE(latest.pop(&v));
+  EXPECT_EQ(v, 3);
+  EXPECT_FALSE(latest.pop(&v));
+  EXPECT_TRUE(latest.push(4));
+  EXPECT_TRUE(latest.pop(&v));
+  EXPECT_EQ(v, 4);
+}
+
+TEST(LatestFrame, DropsReference)
+{
+  // replaced and popped frames are released right away
+  LatestFrame<std::shared_ptr<int>> latest;
+  auto a = std::make_shared<int>(1);
+  auto b = std::make_shared<int>(2);
+  std::weak_ptr<int> weakA(a), weakB(b);
+  latest.push(std::move(a));
+  latest.push(std::move(b));
+  EXPECT_TRUE(weakA.expired());
+  std::shared_ptr<int> out;
+  EXPECT_TRUE(latest.pop(&out));
+  EXPECT_EQ(*out, 2);
+  out.reset();
+  EXPECT_TRUE(weakB.expired());
+}
+
+TEST(LatestFrame, Ordering)
+{
+  // frames may be skipped, but never go backwards or repeat, and the
+  // last one always arrives
+  LatestFrame<int> latest;
+  int replaced = 0;
+  std::thread producer([&latest, &replaced]() {
+    for (int i = 0; i < numFrames; i++) {
+      replaced += latest.push(int(i)) ? 0 : 1;
+    }
+  });
+  int last = -1;
+  int received = 0;
+  while (last < numFrames - 1) {
+    int v = -1;
+    ASSERT_TRUE(pop_next(&latest, &v));
+    ASSERT_GT(v, last);
+    last = v;
+    received++;
+  }
+  producer.join();
+  EXPECT_EQ(received + replaced, numFrames);
+}
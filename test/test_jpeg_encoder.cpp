@@ -0,0 +1,266 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/demosaic.h>
+#include <flir_spinnaker_ros2/jpeg_encoder.h>
+#include <gtest/gtest.h>
+
+// clang-format off
+#include <cstdio>  // must come before jpeglib.h
+#include <jpeglib.h>
+// clang-format on
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::BayerPattern;
+using flir_spinnaker_ros2::BGGR;
+using flir_spinnaker_ros2::DEMOSAIC_BILINEAR;
+using flir_spinnaker_ros2::demosaic_rows;
+using flir_spinnaker_ros2::GBRG;
+using flir_spinnaker_ros2::GRBG;
+using flir_spinnaker_ros2::JpegEncoder;
+using flir_spinnaker_ros2::RGGB;
+
+namespace
+{
+struct Decoded
+{
+  int width{0};
+  int height{0};
+  int components{0};
+  std::vector<uint8_t> data;  // rgb or gray, without padding
+};
+
+Decoded decode(const std::vector<uint8_t> & jpeg)
+{
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr err;
+  cinfo.err = jpeg_std_error(&err);
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, jpeg.data(), jpeg.size());
+  jpeg_read_header(&cinfo, TRUE);
+  jpeg_start_decompress(&cinfo);
+  Decoded d;
+  d.width = cinfo.output_width;
+  d.height = cinfo.output_height;
+  d.components = cinfo.output_components;
+  const size_t step = d.width * d.components;
+  d.data.resize(step * d.height);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = &d.data[cinfo.output_scanline * step];
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return (d);
+}
+
+// smooth content, JPEG's favorite, with row padding
+std::vector<uint8_t> make_image(
+  int width, int height, int channels, size_t step)
+{
+  std::vector<uint8_t> img(step * height, 0xEE);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      for (int c = 0; c < channels; c++) {
+        const double v = 128 + 100 * std::sin(0.05 * x + 0.9 * c) *
+                                 std::cos(0.07 * y - 0.4 * c);
+        img[y * step + x * channels + c] = static_cast<uint8_t>(std::lround(v));
+      }
+    }
+  }
+  return (img);
+}
+
+// mean and max absolute difference between the decoded image and the
+// expected rgb or gray one
+void compare(
+  const Decoded & d, const std::vector<uint8_t> & expected, double maxMean,
+  int maxError, const std::string & what)
+{
+  ASSERT_EQ(d.data.size(), expected.size()) << what;
+  double sum = 0;
+  int worst = 0;
+  for (size_t i = 0; i < expected.size(); i++) {
+    const int e = std::abs(d.data[i] - expected[i]);
+    sum += e;
+    worst = std::max(worst, e);
+  }
+  EXPECT_LT(sum / expected.size(), maxMean) << what;
+  EXPECT_LE(worst, maxError) << what;
+}
+
+// packed rgb without padding, from rgb or bgr with padding
+std::vector<uint8_t> to_rgb(
+  const std::vector<uint8_t> & img, int width, int height, size_t step,
+  bool bgr)
+{
+  std::vector<uint8_t> rgb(3 * width * height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      for (int c = 0; c < 3; c++) {
+        rgb[(y * width + x) * 3 + c] =
+          img[y * step + 3 * x + (bgr ? 2 - c : c)];
+      }
+    }
+  }
+  return (rgb);
+}
+
+// odd sizes, so the last MCUs and bands are partial
+const int width = 101;
+const int height = 67;
+}  // namespace
+
+TEST(JpegEncoder, Mono)
+{
+  const size_t step = width + 3;
+  const std::vector<uint8_t> img = make_image(width, height, 1, step);
+  JpegEncoder::Input in;
+  in.data = img.data();
+  in.step = step;
+  in.width = width;
+  in.height = height;
+  in.type = JpegEncoder::MONO;
+  JpegEncoder encoder;
+  std::vector<uint8_t> jpeg;
+  // the subsampling does not matter for gray images
+  ASSERT_EQ(encoder.encode(in, 95, JpegEncoder::S420, &jpeg), "OK");
+  const Decoded d = decode(jpeg);
+  EXPECT_EQ(d.width, width);
+  EXPECT_EQ(d.height, height);
+  ASSERT_EQ(d.components, 1);
+  std::vector<uint8_t> expected(width * height);
+  for (int y = 0; y < height; y++) {
+    std::copy(
+      img.begin() + y * step, img.begin() + y * step + width,
+      expected.begin() + y * width);
+  }
+  compare(d, expected, 1.0, 8, "mono");
+}
+
+TEST(JpegEncoder, Color)
+{
+  const size_t step = 3 * width + 5;
+  const std::vector<uint8_t> img = make_image(width, height, 3, step);
+  JpegEncoder encoder;  // reused for all
+  for (bool bgr : {false, true}) {
+    JpegEncoder::Input in;
+    in.data = img.data();
+    in.step = step;
+    in.width = width;
+    in.height = height;
+    in.type = bgr ? JpegEncoder::BGR : JpegEncoder::RGB;
+    const std::vector<uint8_t> rgb = to_rgb(img, width, height, step, bgr);
+    for (auto sub : {JpegEncoder::S444, JpegEncoder::S422, JpegEncoder::S420}) {
+      const std::string what =
+        std::string(bgr ? "bgr" : "rgb") + " subsampling " +
+        std::to_string(sub);
+      std::vector<uint8_t> jpeg;
+      ASSERT_EQ(encoder.encode(in, 95, sub, &jpeg), "OK") << what;
+      const Decoded d = decode(jpeg);
+      EXPECT_EQ(d.width, width) << what;
+      EXPECT_EQ(d.height, height) << what;
+      ASSERT_EQ(d.components, 3) << what;
+      compare(d, rgb, 2.0, 16, what);
+    }
+    // gray output of a color image
+    std::vector<uint8_t> jpeg;
+    ASSERT_EQ(encoder.encode(in, 95, JpegEncoder::GRAY, &jpeg), "OK");
+    EXPECT_EQ(decode(jpeg).components, 1);
+  }
+}
+
+TEST(JpegEncoder, Bayer)
+{
+  // Bayer images are demosaiced first, so compare with the bilinear
+  // demosaicing of the same image. Demosaicing needs even sizes.
+  const int w = width + 1, h = height + 1;
+  const size_t step = w + 1;
+  const std::vector<uint8_t> img = make_image(w, h, 1, step);
+  JpegEncoder encoder;
+  for (BayerPattern pattern : {RGGB, GRBG, GBRG, BGGR}) {
+    JpegEncoder::Input in;
+    in.data = img.data();
+    in.step = step;
+    in.width = w;
+    in.height = h;
+    in.type = JpegEncoder::BAYER;
+    in.pattern = pattern;
+    std::vector<uint8_t> jpeg;
+    ASSERT_EQ(encoder.encode(in, 95, JpegEncoder::S444, &jpeg), "OK");
+    const Decoded d = decode(jpeg);
+    EXPECT_EQ(d.width, w);
+    EXPECT_EQ(d.height, h);
+    ASSERT_EQ(d.components, 3);
+    std::vector<uint8_t> rgb(3 * w * h);
+    demosaic_rows(
+      img.data(), step, w, h, pattern, DEMOSAIC_BILINEAR, false, rgb.data(),
+      3 * w, 0, h);
+    compare(d, rgb, 2.0, 16, "bayer pattern " + std::to_string(pattern));
+  }
+}
+
+TEST(JpegEncoder, Quality)
+{
+  // lower quality, smaller images
+  const size_t step = 3 * width;
+  const std::vector<uint8_t> img = make_image(width, height, 3, step);
+  JpegEncoder::Input in;
+  in.data = img.data();
+  in.step = step;
+  in.width = width;
+  in.height = height;
+  in.type = JpegEncoder::RGB;
+  JpegEncoder encoder;
+  std::vector<uint8_t> high, low;
+  ASSERT_EQ(encoder.encode(in, 95, JpegEncoder::S420, &high), "OK");
+  ASSERT_EQ(encoder.encode(in, 30, JpegEncoder::S420, &low), "OK");
+  EXPECT_LT(low.size(), high.size());
+  compare(decode(low), to_rgb(img, width, height, step, false), 6.0, 64, "q30");
+}
+
+TEST(JpegEncoder, Error)
+{
+  // libjpeg errors are reported, and the encoder stays usable
+  const std::vector<uint8_t> img = make_image(16, 16, 1, 16);
+  JpegEncoder::Input in;
+  in.data = img.data();
+  in.step = 16;
+  in.width = 0;
+  in.height = 16;
+  JpegEncoder encoder;
+  std::vector<uint8_t> jpeg;
+  EXPECT_NE(encoder.encode(in, 90, JpegEncoder::S444, &jpeg), "OK");
+  in.width = 16;
+  ASSERT_EQ(encoder.encode(in, 90, JpegEncoder::S444, &jpeg), "OK");
+  EXPECT_EQ(decode(jpeg).width, 16);
+}
+
+TEST(JpegEncoder, SubsamplingFromString)
+{
+  JpegEncoder::Subsampling sub = JpegEncoder::S444;
+  EXPECT_TRUE(JpegEncoder::subsamplingFromString("420", &sub));
+  EXPECT_EQ(sub, JpegEncoder::S420);
+  EXPECT_TRUE(JpegEncoder::subsamplingFromString("gray", &sub));
+  EXPECT_EQ(sub, JpegEncoder::GRAY);
+  EXPECT_FALSE(JpegEncoder::subsamplingFromString("411", &sub));
+  EXPECT_EQ(sub, JpegEncoder::GRAY);
+}
@@ -0,0 +1,242 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/message_pool.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::MessagePool;
+using flir_spinnaker_ros2::PoolAllocator;
+using flir_spinnaker_ros2::SharedMessageRing;
+
+namespace
+{
+// stands in for a message with a buffer
+struct Message
+{
+  std::vector<uint8_t> data;
+  std::string encoding;
+};
+
+using Pool = MessagePool<Message>;
+using Alloc = PoolAllocator<Message>;
+using Ring = SharedMessageRing<Message>;
+
+// what rclcpp does with a message it is done with
+void dispose(Alloc * alloc, Message * msg)
+{
+  alloc->destroy(msg);
+  alloc->deallocate(msg, 1);
+}
+}  // namespace
+
+TEST(MessagePool, AcquireRelease)
+{
+  Pool pool(3);
+  EXPECT_EQ(pool.size(), 3u);
+  std::vector<Message *> msgs;
+  for (int i = 0; i < 3; i++) {
+    Message * m = pool.acquire();
+    ASSERT_NE(m, nullptr);
+    EXPECT_TRUE(pool.owns(m));
+    for (const Message * other : msgs) {
+      EXPECT_NE(m, other);
+    }
+    msgs.push_back(m);
+  }
+  EXPECT_EQ(pool.acquire(), nullptr);  // exhausted
+  EXPECT_TRUE(pool.release(msgs[1]));
+  EXPECT_EQ(pool.acquire(), msgs[1]);
+  for (Message * m : msgs) {
+    EXPECT_TRUE(pool.release(m));
+  }
+}
+
+TEST(MessagePool, Owns)
+{
+  Pool pool(2);
+  Message outside;
+  EXPECT_FALSE(pool.owns(&outside));
+  EXPECT_FALSE(pool.release(&outside));
+  EXPECT_EQ(pool.tag(&outside), nullptr);
+  Pool empty(0);
+  EXPECT_EQ(empty.acquire(), nullptr);
+  EXPECT_FALSE(empty.owns(&outside));
+}
+
+TEST(MessagePool, KeepsContents)
+{
+  Pool pool(1);
+  Message * m = pool.acquire();
+  m->data.resize(1000, 7);
+  m->encoding = "mono8";
+  const uint8_t * buffer = m->data.data();
+  *pool.tag(m) = 42;
+  pool.release(m);
+  m = pool.acquire();
+  ASSERT_EQ(m->data.size(), 1000u);
+  EXPECT_EQ(m->data.data(), buffer);
+  EXPECT_EQ(m->data[999], 7);
+  EXPECT_EQ(m->encoding, "mono8");
+  EXPECT_EQ(*pool.tag(m), 42u);
+  pool.release(m);
+}
+
+TEST(MessagePool, Stats)
+{
+  Pool pool(4);
+  Message * a = pool.acquire();
+  Message * b = pool.acquire();
+  Message * c = pool.acquire();
+  pool.release(b);
+  pool.release(c);
+  Message * idle = pool.acquireIdle();  // not counted
+  pool.release(idle);
+  Pool::Stats s = pool.getAndResetStats();
+  EXPECT_EQ(s.hits, 3u);
+  EXPECT_EQ(s.misses, 0u);
+  EXPECT_EQ(s.highWater, 3u);
+  EXPECT_EQ(s.size, 4u);
+  // the high water mark starts over at the number still in use
+  s = pool.getAndResetStats();
+  EXPECT_EQ(s.hits, 0u);
+  EXPECT_EQ(s.highWater, 1u);
+  std::vector<Message *> msgs;
+  for (int i = 0; i < 5; i++) {
+    msgs.push_back(pool.acquire());
+  }
+  EXPECT_EQ(msgs.back(), nullptr);
+  s = pool.getAndResetStats();
+  EXPECT_EQ(s.hits, 3u);
+  EXPECT_EQ(s.misses, 2u);
+  EXPECT_EQ(s.highWater, 4u);
+  pool.release(a);
+  for (Message * m : msgs) {
+    if (m) {
+      pool.release(m);
+    }
+  }
+  // all were in use at the last reset
+  EXPECT_EQ(pool.getAndResetStats().highWater, 4u);
+  EXPECT_EQ(pool.getAndResetStats().highWater, 0u);
+}
+
+TEST(PoolAllocator, ReturnsToPool)
+{
+  auto pool = std::make_shared<Pool>(1);
+  Alloc alloc(pool);
+  Message * m = pool->acquire();
+  m->data.resize(100);
+  dispose(&alloc, m);
+  // neither destroyed nor freed, but available again
+  EXPECT_EQ(pool->acquire(), m);
+  EXPECT_EQ(m->data.size(), 100u);
+  pool->release(m);
+}
+
+TEST(PoolAllocator, HeapFallback)
+{
+  auto pool = std::make_shared<Pool>(1);
+  Alloc alloc(pool);
+  Message * m = alloc.allocate(1);
+  EXPECT_FALSE(pool->owns(m));
+  new (m) Message();
+  m->data.resize(100);
+  dispose(&alloc, m);  // destroyed and freed, checked by the sanitizers
+  // without a pool everything goes to the heap
+  Alloc plain;
+  m = plain.allocate(1);
+  new (m) Message();
+  dispose(&plain, m);
+}
+
+TEST(PoolAllocator, Rebind)
+{
+  auto pool = std::make_shared<Pool>(1);
+  const Alloc alloc(pool);
+  // rclcpp rebinds the allocator, e.g. to void
+  Alloc::rebind<int>::other rebound(alloc);
+  EXPECT_EQ(rebound.getPool(), alloc.getPool());
+  EXPECT_TRUE(rebound == alloc);
+  const Alloc::rebind<void>::other toVoid(alloc);
+  const Alloc back(toVoid);
+  Message * m = pool->acquire();
+  Alloc copy(back);
+  dispose(&copy, m);
+  EXPECT_EQ(pool->acquire(), m);
+  EXPECT_TRUE(Alloc() != alloc);
+  pool->release(m);
+}
+
+TEST(SharedMessageRing, Recycles)
+{
+  Ring ring(2);
+  uint64_t * tag = nullptr;
+  std::shared_ptr<Message> m = ring.acquire(&tag);
+  ASSERT_NE(m, nullptr);
+  EXPECT_EQ(*tag, Ring::NO_TAG);
+  m->data.resize(100, 3);
+  *tag = 1;
+  std::weak_ptr<Message> first(m);
+  m.reset();  // the subscribers are done with it
+  // comes back with its contents and tag
+  m = ring.acquire(&tag);
+  EXPECT_EQ(m, first.lock());
+  EXPECT_EQ(*tag, 1u);
+  EXPECT_EQ(m->data.size(), 100u);
+}
+
+TEST(SharedMessageRing, SkipsReferenced)
+{
+  Ring ring(3);
+  uint64_t * tag = nullptr;
+  std::shared_ptr<Message> held = ring.acquire(&tag);
+  *tag = 1;
+  for (int i = 0; i < 10; i++) {
+    // a subscriber still holds on to the first message
+    std::shared_ptr<Message> m = ring.acquire(&tag);
+    EXPECT_NE(m, held);
+    *tag = 2;
+  }
+  EXPECT_EQ(held.use_count(), 2);  // the ring's and ours
+}
+
+TEST(SharedMessageRing, ReplacesWhenAllReferenced)
+{
+  Ring ring(2);
+  uint64_t * tag = nullptr;
+  std::vector<std::shared_ptr<Message>> held;
+  for (int i = 0; i < 2; i++) {
+    held.push_back(ring.acquire(&tag));
+    held.back()->encoding = "old";
+    *tag = 1;
+  }
+  // never hands out a message someone else holds
+  std::shared_ptr<Message> m = ring.acquire(&tag);
+  EXPECT_EQ(*tag, Ring::NO_TAG);
+  EXPECT_TRUE(m->encoding.empty());
+  for (const auto & h : held) {
+    EXPECT_NE(m, h);
+    EXPECT_EQ(h->encoding, "old");
+  }
+  // the replaced one now belongs to its holder alone
+  EXPECT_EQ(held[0].use_count() + held[1].use_count(), 3);
+  Ring empty(0);
+  EXPECT_EQ(empty.size(), 1u);
+  EXPECT_NE(empty.acquire(&tag), nullptr);
+}
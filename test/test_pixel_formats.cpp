@@ -0,0 +1,109 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/pixel_formats.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::find_pixel_format;
+using flir_spinnaker_ros2::Packing;
+using flir_spinnaker_ros2::PACKING_12P;
+using flir_spinnaker_ros2::PACKING_12PACKED;
+using flir_spinnaker_ros2::PACKING_NONE;
+using flir_spinnaker_ros2::pack12_row;
+using flir_spinnaker_ros2::PixelFormatInfo;
+using flir_spinnaker_ros2::unpack12_rows;
+
+namespace
+{
+// Packs random 12 bit pixels with pack12_row(), unpacks them in two row
+// ranges, and compares.
+void round_trip(int width, Packing packing)
+{
+  const int height = 5;
+  const size_t rowBytes = (3 * static_cast<size_t>(width) + 1) / 2;
+  const size_t srcStep = rowBytes + 3;  // row padding
+  std::vector<uint16_t> pixels(width * height);
+  uint32_t r = 1234567 + width;
+  for (auto & p : pixels) {
+    r = r * 1103515245 + 12345;
+    p = (r >> 12) & 0x0FFF;
+  }
+  std::vector<uint8_t> packed(srcStep * height, 0xFF);
+  for (int y = 0; y < height; y++) {
+    pack12_row(&pixels[y * width], width, packing, &packed[y * srcStep]);
+  }
+  const size_t dstStep = 2 * width;
+  std::vector<uint16_t> unpacked(width * height, 0xFFFF);
+  uint8_t * dst = reinterpret_cast<uint8_t *>(unpacked.data());
+  unpack12_rows(packed.data(), srcStep, width, packing, dst, dstStep, 0, 2);
+  unpack12_rows(
+    packed.data(), srcStep, width, packing, dst + 2 * dstStep, dstStep, 2,
+    height);
+  for (int i = 0; i < width * height; i++) {
+    ASSERT_EQ(unpacked[i], pixels[i])
+      << "width " << width << " x " << i % width << " y " << i / width;
+  }
+}
+
+const int widths[] = {1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 1440, 2449};
+}  // namespace
+
+TEST(PixelFormats, RoundTrip12p)
+{
+  for (const int w : widths) {
+    round_trip(w, PACKING_12P);
+  }
+}
+
+TEST(PixelFormats, RoundTrip12Packed)
+{
+  for (const int w : widths) {
+    round_trip(w, PACKING_12PACKED);
+  }
+}
+
+TEST(PixelFormats, KnownBitPatterns)
+{
+  // two pixels 0xABC, 0x123 in three bytes
+  const uint8_t p12[] = {0xBC, 0x3A, 0x12};
+  const uint8_t p12Packed[] = {0xAB, 0x3C, 0x12};
+  uint16_t out[2];
+  uint8_t * dst = reinterpret_cast<uint8_t *>(out);
+  unpack12_rows(p12, 3, 2, PACKING_12P, dst, 4, 0, 1);
+  EXPECT_EQ(out[0], 0xABC);
+  EXPECT_EQ(out[1], 0x123);
+  unpack12_rows(p12Packed, 3, 2, PACKING_12PACKED, dst, 4, 0, 1);
+  EXPECT_EQ(out[0], 0xABC);
+  EXPECT_EQ(out[1], 0x123);
+}
+
+TEST(PixelFormats, Lookup)
+{
+  const PixelFormatInfo * pf = find_pixel_format("BayerRG12p");
+  ASSERT_NE(pf, nullptr);
+  EXPECT_EQ(std::string(pf->encoding), "bayer_rggb16");
+  EXPECT_EQ(pf->packing, PACKING_12P);
+  EXPECT_EQ(pf->bitsPerPixel, 12);
+  EXPECT_FALSE(pf->polarized);
+  pf = find_pixel_format("Polarized8");
+  ASSERT_NE(pf, nullptr);
+  EXPECT_EQ(pf->packing, PACKING_NONE);
+  EXPECT_TRUE(pf->polarized);
+  EXPECT_EQ(find_pixel_format("NoSuchFormat"), nullptr);
+}
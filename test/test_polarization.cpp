@@ -0,0 +1,231 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/polarization.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using flir_spinnaker_ros2::POL_ANGLE_0;
+using flir_spinnaker_ros2::POL_ANGLE_135;
+using flir_spinnaker_ros2::POL_ANGLE_45;
+using flir_spinnaker_ros2::POL_ANGLE_90;
+using flir_spinnaker_ros2::POL_AOLP;
+using flir_spinnaker_ros2::POL_DOLP;
+using flir_spinnaker_ros2::POL_NUM_OUTPUTS;
+using flir_spinnaker_ros2::polarization_rows;
+
+namespace
+{
+const double PI = 3.14159265358979323846;
+
+// input image with padded rows, 8 or 16 bit values
+struct Image
+{
+  Image(int w, int h, int bpv) : width(w), height(h), bytesPerValue(bpv)
+  {
+    step = (w + 3) * bpv;
+    data.resize(step * h / 2 + 1);
+  }
+  int get(int x, int y) const
+  {
+    const uint8_t * row = bytes() + y * step;
+    return (
+      bytesPerValue == 1 ? row[x]
+                         : reinterpret_cast<const uint16_t *>(row)[x]);
+  }
+  void set(int x, int y, int v)
+  {
+    uint8_t * row = reinterpret_cast<uint8_t *>(data.data()) + y * step;
+    if (bytesPerValue == 1) {
+      row[x] = static_cast<uint8_t>(v);
+    } else {
+      reinterpret_cast<uint16_t *>(row)[x] = static_cast<uint16_t>(v);
+    }
+  }
+  const uint8_t * bytes() const
+  {
+    return (reinterpret_cast<const uint8_t *>(data.data()));
+  }
+  int width, height, bytesPerValue;
+  size_t step;
+  std::vector<uint16_t> data;  // for alignment
+};
+
+struct Outputs
+{
+  Outputs(int w, int h, int bpv)
+  {
+    for (int i = 0; i < POL_NUM_OUTPUTS; i++) {
+      const int unit = i < POL_DOLP ? bpv : 1;
+      buf[i].assign(static_cast<size_t>(w) * h * unit, 0);
+      ptr[i] = buf[i].data();
+    }
+  }
+  int angle(int i, int x, int y, int w, int bpv) const
+  {
+    const uint8_t * p = buf[i].data() + (y * w + x) * bpv;
+    uint16_t v = p[0];
+    if (bpv == 2) {
+      std::memcpy(&v, p, 2);
+    }
+    return (v);
+  }
+  std::vector<uint8_t> buf[POL_NUM_OUTPUTS];
+  uint8_t * ptr[POL_NUM_OUTPUTS];
+};
+
+// DoLP and AoLP as documented, in double precision
+void reference(
+  double i0, double i45, double i90, double i135, int * dolp, int * aolp)
+{
+  const double s0 = 0.5 * (i0 + i45 + i90 + i135);
+  const double s1 = i0 - i90;
+  const double s2 = i45 - i135;
+  const double d = std::sqrt(s1 * s1 + s2 * s2) / std::max(s0, 1.0);
+  *dolp = static_cast<int>(std::lround(std::min(d, 1.0) * 255));
+  double a = std::atan2(s2, s1);
+  a = a < 0 ? a + 2 * PI : a;
+  *aolp = static_cast<int>(std::min(a * 128 / PI, 255.0));
+}
+
+// distance of two AoLP values, which wrap around at 180 deg
+int aolp_distance(int a, int b)
+{
+  const int d = std::abs(a - b);
+  return (std::min(d, 256 - d));
+}
+
+Image random_image(int w, int h, int bpv, int maxValue, std::mt19937 * rng)
+{
+  Image img(w, h, bpv);
+  std::uniform_int_distribution<int> dist(0, maxValue);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      img.set(x, y, dist(*rng));
+    }
+  }
+  return (img);
+}
+
+void check(const Image & img)
+{
+  const int w = img.width / 2;
+  const int h = img.height / 2;
+  const int bpv = img.bytesPerValue;
+  Outputs out(w, h, bpv);
+  // in two row ranges
+  polarization_rows(img.bytes(), img.step, img.width, bpv, out.ptr, 0, h / 2);
+  polarization_rows(img.bytes(), img.step, img.width, bpv, out.ptr, h / 2, h);
+  // 90 45
+  // 135 0
+  const int dx[POL_DOLP] = {1, 1, 0, 0};
+  const int dy[POL_DOLP] = {1, 0, 0, 1};
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      int v[POL_DOLP];
+      for (int i = 0; i < POL_DOLP; i++) {
+        v[i] = img.get(2 * x + dx[i], 2 * y + dy[i]);
+        ASSERT_EQ(out.angle(i, x, y, w, bpv), v[i])
+          << "output " << i << " x " << x << " y " << y;
+      }
+      int dolp, aolp;
+      reference(
+        v[POL_ANGLE_0], v[POL_ANGLE_45], v[POL_ANGLE_90], v[POL_ANGLE_135],
+        &dolp, &aolp);
+      // float vs double rounding
+      ASSERT_NEAR(out.buf[POL_DOLP][y * w + x], dolp, 1)
+        << "x " << x << " y " << y << " width " << img.width;
+      ASSERT_LE(aolp_distance(out.buf[POL_AOLP][y * w + x], aolp), 1)
+        << "x " << x << " y " << y << " width " << img.width;
+    }
+  }
+}
+}  // namespace
+
+TEST(Polarization, MatchesReference)
+{
+  std::mt19937 rng(1);
+  // widths around the vector sizes to exercise the scalar tails
+  for (int w : {2, 6, 8, 10, 32, 34, 66, 200}) {
+    check(random_image(w, 6, 1, 255, &rng));
+    check(random_image(w, 6, 2, 4095, &rng));
+    check(random_image(w, 6, 2, 65535, &rng));
+  }
+}
+
+TEST(Polarization, KnownAngles)
+{
+  // fully polarized light at 0, 45, 90 and 135 deg: Malus' law
+  for (int deg : {0, 45, 90, 135}) {
+    const double t = deg * PI / 180;
+    auto intensity = [t](double polarizer) {
+      const double c = std::cos(t - polarizer * PI / 180);
+      return (static_cast<int>(std::lround(200 * c * c)));
+    };
+    Image img(32, 2, 1);
+    for (int x = 0; x < 32; x += 2) {
+      img.set(x, 0, intensity(90));
+      img.set(x + 1, 0, intensity(45));
+      img.set(x, 1, intensity(135));
+      img.set(x + 1, 1, intensity(0));
+    }
+    Outputs out(16, 1, 1);
+    polarization_rows(img.bytes(), img.step, 32, 1, out.ptr, 0, 1);
+    for (int x = 0; x < 16; x++) {
+      EXPECT_NEAR(out.buf[POL_DOLP][x], 255, 1) << deg;
+      EXPECT_LE(aolp_distance(out.buf[POL_AOLP][x], deg * 256 / 180), 1)
+        << deg;
+    }
+  }
+}
+
+TEST(Polarization, Unpolarized)
+{
+  Image img(40, 4, 2);
+  for (int y = 0; y < 4; y++) {
+    for (int x = 0; x < 40; x++) {
+      img.set(x, y, 1000);
+    }
+  }
+  Outputs out(20, 2, 2);
+  polarization_rows(img.bytes(), img.step, 40, 2, out.ptr, 0, 2);
+  for (int i = 0; i < 40; i++) {
+    EXPECT_EQ(out.buf[POL_DOLP][i], 0);
+    EXPECT_EQ(out.buf[POL_AOLP][i], 0);
+  }
+}
+
+TEST(Polarization, SomeOutputs)
+{
+  std::mt19937 rng(2);
+  const Image img = random_image(66, 4, 1, 255, &rng);
+  Outputs all(33, 2, 1);
+  polarization_rows(img.bytes(), img.step, 66, 1, all.ptr, 0, 2);
+  for (int i = 0; i < POL_NUM_OUTPUTS; i++) {
+    // only output i
+    Outputs one(33, 2, 1);
+    uint8_t * dst[POL_NUM_OUTPUTS] = {};
+    dst[i] = one.ptr[i];
+    polarization_rows(img.bytes(), img.step, 66, 1, dst, 0, 2);
+    EXPECT_EQ(one.buf[i], all.buf[i]) << "output " << i;
+  }
+}
@@ -0,0 +1,133 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/rate_limiter.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+using flir_spinnaker_ros2::RateLimiter;
+
+namespace
+{
+const int64_t ms = 1000000;  // in nanoseconds
+
+// number of frames passed out of n at the given period, starting at t0,
+// with the time stamps alternately off by +-jitter
+int count_passed(
+  RateLimiter * rl, int n, int64_t period, int64_t jitter = 0,
+  int64_t t0 = 1000 * ms)
+{
+  int passed = 0;
+  for (int i = 0; i < n; i++) {
+    const int64_t t = t0 + i * period + ((i & 1) ? jitter : -jitter);
+    passed += rl->pass(t) ? 1 : 0;
+  }
+  return (passed);
+}
+}  // namespace
+
+TEST(RateLimiter, Unlimited)
+{
+  RateLimiter rl;
+  EXPECT_FALSE(rl.isLimited());
+  EXPECT_EQ(count_passed(&rl, 100, 10 * ms), 100);
+  rl.configure(1, 0);
+  EXPECT_FALSE(rl.isLimited());
+  EXPECT_EQ(count_passed(&rl, 100, 10 * ms), 100);
+}
+
+TEST(RateLimiter, Decimation)
+{
+  RateLimiter rl;
+  rl.configure(3, 0);
+  EXPECT_TRUE(rl.isLimited());
+  for (int i = 0; i < 30; i++) {
+    EXPECT_EQ(rl.pass(i * 33 * ms), i % 3 == 0) << "frame " << i;
+  }
+  rl.configure(0, 0);  // same as 1
+  EXPECT_FALSE(rl.isLimited());
+}
+
+TEST(RateLimiter, MaxRate)
+{
+  RateLimiter rl;
+  rl.configure(1, 10.0);
+  EXPECT_TRUE(rl.isLimited());
+  // 100Hz for 10s -> 100 frames at 10Hz, give or take the one let
+  // through early at the end
+  EXPECT_NEAR(count_passed(&rl, 1000, 10 * ms), 100, 1);
+  // and never closer than half a period
+  rl.configure(1, 10.0);
+  int64_t last = -1000 * ms;
+  for (int i = 0; i < 1000; i++) {
+    const int64_t t = 1000 * ms + i * 10 * ms;
+    if (rl.pass(t)) {
+      EXPECT_GE(t - last, 50 * ms);
+      last = t;
+    }
+  }
+}
+
+TEST(RateLimiter, JitterAtTheLimit)
+{
+  // a 10Hz limit on a 10Hz camera with jittery time stamps must not
+  // drop every other frame
+  RateLimiter rl;
+  rl.configure(1, 10.0);
+  EXPECT_EQ(count_passed(&rl, 200, 100 * ms, 3 * ms), 200);
+}
+
+TEST(RateLimiter, JitterBelowTheLimit)
+{
+  // 30Hz camera limited to 7Hz: the rate holds over time, even though
+  // 7 does not divide 30
+  RateLimiter rl;
+  rl.configure(1, 7.0);
+  const int passed = count_passed(&rl, 3000, 33333333, 2 * ms);
+  EXPECT_NEAR(passed, 700, 1);
+}
+
+TEST(RateLimiter, TimeJumps)
+{
+  RateLimiter rl;
+  rl.configure(1, 10.0);
+  EXPECT_NEAR(count_passed(&rl, 100, 10 * ms, 0, 1000 * ms), 10, 1);
+  // backwards, e.g. the camera clock was reset: must not stall
+  EXPECT_TRUE(rl.pass(5 * ms));
+  EXPECT_NEAR(count_passed(&rl, 100, 10 * ms, 0, 15 * ms), 10, 1);
+  // forward, e.g. after a pause in acquisition
+  EXPECT_TRUE(rl.pass(100000 * ms));
+  EXPECT_FALSE(rl.pass(100000 * ms + 10 * ms));
+  EXPECT_TRUE(rl.pass(100000 * ms + 100 * ms));
+}
+
+TEST(RateLimiter, DecimationAndRate)
+{
+  // every 2nd frame of 30Hz is 15Hz, limited to 5Hz
+  RateLimiter rl;
+  rl.configure(2, 5.0);
+  EXPECT_NEAR(count_passed(&rl, 3000, 33333333), 500, 1);
+}
+
+TEST(RateLimiter, ConfigureResets)
+{
+  RateLimiter rl;
+  rl.configure(1, 1.0);
+  EXPECT_TRUE(rl.pass(1000 * ms));
+  EXPECT_FALSE(rl.pass(1100 * ms));
+  rl.configure(1, 1.0);
+  EXPECT_TRUE(rl.pass(1200 * ms));
+}
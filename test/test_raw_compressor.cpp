@@ -0,0 +1,205 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/raw_compressor.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::RawCompressor;
+
+namespace
+{
+// image with row padding and some structure, so zstd has work to do
+std::vector<uint8_t> make_image(int width, int height, int unit, size_t step)
+{
+  std::vector<uint8_t> img(step * height, 0xEE);  // 0xEE: padding
+  uint32_t r = 12345;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width * unit; x++) {
+      r = r * 1103515245 + 12345;
+      img[y * step + x] = static_cast<uint8_t>((x + y) / 4 + ((r >> 16) & 7));
+    }
+  }
+  return (img);
+}
+
+void round_trip(int width, int height, int unit, bool split, bool expectSplit)
+{
+  const size_t rowBytes = width * unit;
+  const size_t step = rowBytes + 5;
+  const std::vector<uint8_t> img = make_image(width, height, unit, step);
+  RawCompressor::Input in;
+  in.data = img.data();
+  in.step = step;
+  in.width = width;
+  in.height = height;
+  in.bytesPerPixel = unit;
+  in.encoding = unit == 1 ? "bayer_rggb8" : "bayer_rggb16";
+  in.bayerSplit = split;
+  RawCompressor compressor;
+  std::vector<uint8_t> compressed;
+  std::string format;
+  ASSERT_EQ(compressor.compress(in, 1, &compressed, &format), "OK");
+  EXPECT_LT(compressed.size(), rowBytes * height);
+  EXPECT_NE(
+    format.find(expectSplit ? "split=1" : "split=0"), std::string::npos);
+
+  std::string encoding;
+  int w = 0, h = 0, bpp = 0;
+  std::vector<uint8_t> data;
+  ASSERT_EQ(
+    RawCompressor::decompress(
+      format, compressed, &encoding, &w, &h, &bpp, &data),
+    "OK");
+  EXPECT_EQ(encoding, in.encoding);
+  EXPECT_EQ(w, width);
+  EXPECT_EQ(h, height);
+  EXPECT_EQ(bpp, unit);
+  ASSERT_EQ(data.size(), rowBytes * height);
+  for (int y = 0; y < height; y++) {
+    ASSERT_TRUE(std::equal(
+      img.begin() + y * step, img.begin() + y * step + rowBytes,
+      data.begin() + y * rowBytes))
+      << "row " << y;
+  }
+}
+
+// compressed 4x4 mono8 image
+std::vector<uint8_t> compress_small(std::string * format)
+{
+  const std::vector<uint8_t> img = make_image(4, 4, 1, 4);
+  RawCompressor::Input in;
+  in.data = img.data();
+  in.step = 4;
+  in.width = 4;
+  in.height = 4;
+  in.encoding = "mono8";
+  RawCompressor compressor;
+  std::vector<uint8_t> compressed;
+  compressor.compress(in, 1, &compressed, format);
+  return (compressed);
+}
+
+std::string decompress(
+  const std::string & geometry, const std::vector<uint8_t> & compressed)
+{
+  std::string encoding;
+  int w, h, bpp;
+  std::vector<uint8_t> data;
+  return (RawCompressor::decompress(
+    "mono8; zstd; " + geometry, compressed, &encoding, &w, &h, &bpp, &data));
+}
+}  // namespace
+
+TEST(RawCompressor, RoundTrip8Bit) { round_trip(100, 30, 1, false, false); }
+
+TEST(RawCompressor, RoundTrip8BitSplit) { round_trip(100, 30, 1, true, true); }
+
+TEST(RawCompressor, RoundTrip16BitSplit)
+{
+  round_trip(98, 32, 2, true, true);
+}
+
+TEST(RawCompressor, OddSizeIsNotSplit) { round_trip(101, 31, 1, true, false); }
+
+TEST(RawCompressor, ReusedCompressor)
+{
+  // the compressor keeps its buffers between frames of different sizes
+  round_trip(200, 40, 2, true, true);
+  round_trip(64, 8, 1, false, false);
+}
+
+TEST(RawCompressor, BadFormat)
+{
+  std::string encoding;
+  int w, h, bpp;
+  std::vector<uint8_t> data;
+  EXPECT_NE(
+    RawCompressor::decompress(
+      "mono8; jpeg; width=4", {}, &encoding, &w, &h, &bpp, &data),
+    "OK");
+  EXPECT_NE(
+    RawCompressor::decompress(
+      "mono8; zstd; width=x", {}, &encoding, &w, &h, &bpp, &data),
+    "OK");
+  EXPECT_NE(
+    RawCompressor::decompress(
+      "mono8; zstd; width=4 height=4 bytes_per_pixel=1 split=0", {1, 2, 3},
+      &encoding, &w, &h, &bpp, &data),
+    "OK");
+}
+
+TEST(RawCompressor, BadSize)
+{
+  std::string format;
+  const std::vector<uint8_t> compressed = compress_small(&format);
+  EXPECT_EQ(
+    decompress("width=4 height=4 bytes_per_pixel=1 split=0", compressed),
+    "OK");
+  EXPECT_EQ(decompress("width=4 height=4", compressed), "OK");
+  for (const char * geometry :
+       {"width=0 height=4 bytes_per_pixel=1", "height=4 bytes_per_pixel=1",
+        "width=-4 height=-4 bytes_per_pixel=1",
+        "width=4 height=4 bytes_per_pixel=0",
+        "width=4 height=4 bytes_per_pixel=-1",
+        "width=4 height=4 bytes_per_pixel=33",
+        "width=65537 height=4 bytes_per_pixel=1",
+        "width=4 height=100000 bytes_per_pixel=1",
+        "width=4 height=4 bytes_per_pixel=99999999999"}) {
+    EXPECT_NE(decompress(geometry, compressed), "OK") << geometry;
+  }
+}
+
+TEST(RawCompressor, SizeMismatch)
+{
+  // Plausible sizes that do not match the data are rejected before the
+  // buffer is allocated. The largest would need 128GB.
+  std::string format;
+  const std::vector<uint8_t> compressed = compress_small(&format);
+  for (const char * geometry :
+       {"width=2 height=8 bytes_per_pixel=2",
+        "width=4 height=2 bytes_per_pixel=1",
+        "width=65536 height=65536 bytes_per_pixel=32"}) {
+    EXPECT_NE(decompress(geometry, compressed), "OK") << geometry;
+  }
+}
+
+TEST(RawCompressor, BadSplit)
+{
+  // compress() never splits images with odd sizes
+  const std::vector<uint8_t> img = make_image(5, 3, 1, 5);
+  RawCompressor::Input in;
+  in.data = img.data();
+  in.step = 5;
+  in.width = 5;
+  in.height = 3;
+  in.encoding = "bayer_rggb8";
+  RawCompressor compressor;
+  std::vector<uint8_t> compressed;
+  std::string format;
+  ASSERT_EQ(compressor.compress(in, 1, &compressed, &format), "OK");
+  EXPECT_EQ(decompress("width=5 height=3 split=0", compressed), "OK");
+  EXPECT_NE(decompress("width=5 height=3 split=1", compressed), "OK");
+  EXPECT_NE(decompress("width=3 height=5 split=1", compressed), "OK");
+  std::string small;
+  const std::vector<uint8_t> even = compress_small(&small);
+  EXPECT_EQ(decompress("width=4 height=4 split=1", even), "OK");
+  EXPECT_NE(decompress("width=4 height=4 split=2", even), "OK");
+  EXPECT_NE(decompress("width=4 height=4 split=-1", even), "OK");
+}
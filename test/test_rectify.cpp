@@ -0,0 +1,282 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/rectify.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::RectifyMap;
+
+namespace
+{
+// Synthetic stereo calibration: distortion, a small rotation about the
+// y axis, and a new camera matrix P with a different focal length and
+// center. All without skew, so the inverse of P * R is simple.
+struct Calibration
+{
+  std::string model;
+  double K[9];
+  std::vector<double> D;
+  double R[9];
+  double P[12];
+};
+
+Calibration make_calibration(
+  int width, int height, const std::string & model,
+  const std::vector<double> & D)
+{
+  const double f = 0.9 * width;
+  const double angle = 0.03;
+  Calibration c{
+    model,
+    {f, 0, 0.5 * width - 0.3, 0, 1.02 * f, 0.5 * height + 0.7, 0, 0, 1},
+    D,
+    {std::cos(angle), 0, std::sin(angle), 0, 1, 0, -std::sin(angle), 0,
+     std::cos(angle)},
+    {0.8 * f, 0, 0.5 * width + 1.1, 0, 0, 0.8 * f, 0.5 * height - 0.4, 0, 0,
+     0, 1, 0}};
+  return (c);
+}
+
+// Where output pixel (u, v) comes from in the raw image, the way
+// OpenCV's initUndistortRectifyMap() computes it, in double precision.
+void source_pixel(
+  const Calibration & c, int u, int v, double * sx, double * sy)
+{
+  // inverse of the new camera matrix, then R^-1 = R^T
+  const double xn = (u - c.P[2]) / c.P[0];
+  const double yn = (v - c.P[6]) / c.P[5];
+  const double X = c.R[0] * xn + c.R[3] * yn + c.R[6];
+  const double Y = c.R[1] * xn + c.R[4] * yn + c.R[7];
+  const double W = c.R[2] * xn + c.R[5] * yn + c.R[8];
+  const double x = X / W, y = Y / W;
+  double k[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  std::copy(c.D.begin(), c.D.end(), k);
+  const double r2 = x * x + y * y, r4 = r2 * r2, r6 = r4 * r2;
+  const double radial = (1 + k[0] * r2 + k[1] * r4 + k[4] * r6) /
+                        (1 + k[5] * r2 + k[6] * r4 + k[7] * r6);
+  const double xd = x * radial + 2 * k[2] * x * y + k[3] * (r2 + 2 * x * x);
+  const double yd = y * radial + k[2] * (r2 + 2 * y * y) + 2 * k[3] * x * y;
+  *sx = c.K[0] * xd + c.K[2];
+  *sy = c.K[4] * yd + c.K[5];
+}
+
+bool inside(double sx, double sy, int width, int height)
+{
+  return (sx >= -0.5 && sy >= -0.5 && sx <= width - 0.5 && sy <= height - 0.5);
+}
+
+// close to the edge of the valid area, where rounding may decide
+bool near_edge(double sx, double sy, int width, int height)
+{
+  const double eps = 1e-6;
+  return (
+    std::abs(sx + 0.5) < eps || std::abs(sy + 0.5) < eps ||
+    std::abs(sx - (width - 0.5)) < eps || std::abs(sy - (height - 0.5)) < eps);
+}
+
+// bilinear interpolation in double precision, clamped like the table
+double interpolate(
+  const std::vector<uint8_t> & img, size_t step, int channels, int width,
+  int height, double sx, double sy, int c)
+{
+  const int x0 = std::min(std::max(static_cast<int>(sx), 0), width - 2);
+  const int y0 = std::min(std::max(static_cast<int>(sy), 0), height - 2);
+  const double fx = std::min(std::max(sx - x0, 0.0), 1.0);
+  const double fy = std::min(std::max(sy - y0, 0.0), 1.0);
+  auto p = [&](int x, int y) { return (img[y * step + x * channels + c]); };
+  const double top = p(x0, y0) * (1 - fx) + p(x0 + 1, y0) * fx;
+  const double bottom = p(x0, y0 + 1) * (1 - fx) + p(x0 + 1, y0 + 1) * fx;
+  return (top * (1 - fy) + bottom * fy);
+}
+
+RectifyMap make_map(const Calibration & c, int width, int height)
+{
+  RectifyMap map;
+  EXPECT_EQ(map.init(c.model, c.K, c.D, c.R, c.P, width, height), "OK");
+  // in bands, as the worker threads do
+  for (int y = 0; y < height; y += 7) {
+    map.buildRows(y, std::min(y + 7, height));
+  }
+  return (map);
+}
+
+std::vector<uint8_t> remap(
+  const RectifyMap & map, const std::vector<uint8_t> & src, size_t srcStep,
+  int channels, size_t dstStep)
+{
+  std::vector<uint8_t> dst(dstStep * map.getHeight(), 0xEE);
+  for (int y = 0; y < map.getHeight(); y += 5) {
+    const int end = std::min(y + 5, map.getHeight());
+    map.remapRows(
+      src.data(), srcStep, channels, &dst[y * dstStep], dstStep, y, end);
+  }
+  return (dst);
+}
+
+const std::vector<double> plumbBob = {-0.28, 0.09, 0.0012, -0.0007, -0.015};
+const std::vector<double> rational = {0.6,   -0.2, 0.0008, 0.0011,
+                                      0.03, 0.95, -0.25,  0.05};
+}  // namespace
+
+TEST(Rectify, Identity)
+{
+  // without distortion, rotation and new projection, nothing moves
+  const int width = 37, height = 11;
+  const double K[9] = {30, 0, 18, 0, 30, 5, 0, 0, 1};
+  const double R[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  const double P[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  RectifyMap map;
+  ASSERT_EQ(map.init("plumb_bob", K, {}, R, P, width, height), "OK");
+  map.buildRows(0, height);
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> dist(0, 255);
+  for (int channels : {1, 3}) {
+    const size_t step = width * channels + 3;
+    std::vector<uint8_t> src(step * height);
+    for (auto & p : src) {
+      p = static_cast<uint8_t>(dist(rng));
+    }
+    const std::vector<uint8_t> dst =
+      remap(map, src, step, channels, width * channels);
+    for (int y = 0; y < height; y++) {
+      ASSERT_TRUE(std::equal(
+        src.begin() + y * step, src.begin() + y * step + width * channels,
+        dst.begin() + y * width * channels))
+        << "row " << y << " channels " << channels;
+    }
+  }
+}
+
+TEST(Rectify, Table)
+{
+  // Ramps in x and y make the output encode where it was read from
+  // (to 1/4 pixel), which checks the table against the double precision
+  // map, including which pixels fall outside of the image.
+  const int width = 61, height = 45;
+  for (const auto & d : {plumbBob, rational}) {
+    const Calibration c = make_calibration(
+      width, height, d.size() == 5 ? "plumb_bob" : "rational_polynomial", d);
+    const RectifyMap map = make_map(c, width, height);
+    const size_t srcStep = 3 * width;
+    std::vector<uint8_t> src(srcStep * height);
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        src[y * srcStep + 3 * x] = static_cast<uint8_t>(4 * x);
+        src[y * srcStep + 3 * x + 1] = static_cast<uint8_t>(4 * y);
+        src[y * srcStep + 3 * x + 2] = 200;
+      }
+    }
+    const std::vector<uint8_t> dst = remap(map, src, srcStep, 3, srcStep);
+    int numInside = 0;
+    for (int v = 0; v < height; v++) {
+      for (int u = 0; u < width; u++) {
+        double sx, sy;
+        source_pixel(c, u, v, &sx, &sy);
+        const uint8_t * p = &dst[v * srcStep + 3 * u];
+        if (near_edge(sx, sy, width, height)) {
+          continue;
+        }
+        if (!inside(sx, sy, width, height)) {
+          ASSERT_EQ(p[0] + p[1] + p[2], 0) << c.model << " at " << u << ","
+                                           << v;
+          continue;
+        }
+        numInside++;
+        // the ramps stop at the border, like the interpolation
+        const double ex = 4 * std::min(std::max(sx, 0.0), width - 1.0);
+        const double ey = 4 * std::min(std::max(sy, 0.0), height - 1.0);
+        ASSERT_NEAR(p[0], ex, 1.0) << c.model << " at " << u << "," << v;
+        ASSERT_NEAR(p[1], ey, 1.0) << c.model << " at " << u << "," << v;
+        ASSERT_EQ(p[2], 200) << c.model << " at " << u << "," << v;
+      }
+    }
+    // the calibration must leave some of both
+    EXPECT_GT(numInside, width * height / 2) << c.model;
+    EXPECT_LT(numInside, width * height) << c.model;
+  }
+}
+
+TEST(Rectify, Remap)
+{
+  // a smooth image, interpolated in double precision at the exact
+  // source position, on a width that is not a multiple of the vector
+  // width
+  const int width = 203, height = 97;
+  const Calibration c = make_calibration(width, height, "plumb_bob", plumbBob);
+  const RectifyMap map = make_map(c, width, height);
+  for (int channels : {1, 3}) {
+    const size_t srcStep = width * channels + 7;
+    std::vector<uint8_t> src(srcStep * height);
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        for (int ch = 0; ch < channels; ch++) {
+          const double s = 127.5 + 120 * std::sin(0.07 * x + 0.05 * y + ch) *
+                                     std::cos(0.04 * y - 0.3 * ch);
+          src[y * srcStep + x * channels + ch] =
+            static_cast<uint8_t>(std::lround(s));
+        }
+      }
+    }
+    const size_t dstStep = width * channels + 2;
+    const std::vector<uint8_t> dst =
+      remap(map, src, srcStep, channels, dstStep);
+    for (int v = 0; v < height; v++) {
+      for (int u = 0; u < width; u++) {
+        double sx, sy;
+        source_pixel(c, u, v, &sx, &sy);
+        if (near_edge(sx, sy, width, height)) {
+          continue;
+        }
+        for (int ch = 0; ch < channels; ch++) {
+          const int out = dst[v * dstStep + u * channels + ch];
+          if (!inside(sx, sy, width, height)) {
+            ASSERT_EQ(out, 0);
+            continue;
+          }
+          // 1/64 pixel weights and three roundings
+          ASSERT_NEAR(
+            out,
+            interpolate(src, srcStep, channels, width, height, sx, sy, ch),
+            2.0)
+            << channels << " channels at " << u << "," << v;
+        }
+      }
+      // the row padding is left alone
+      ASSERT_EQ(dst[v * dstStep + width * channels], 0xEE);
+    }
+  }
+}
+
+TEST(Rectify, Errors)
+{
+  const Calibration c = make_calibration(64, 48, "plumb_bob", plumbBob);
+  RectifyMap map;
+  EXPECT_NE(map.init(c.model, c.K, c.D, c.R, c.P, 1, 48), "OK");
+  EXPECT_NE(map.init(c.model, c.K, c.D, c.R, c.P, 64, 40000), "OK");
+  EXPECT_NE(map.init("fisheye", c.K, c.D, c.R, c.P, 64, 48), "OK");
+  EXPECT_NE(map.init("plumb_bob", c.K, rational, c.R, c.P, 64, 48), "OK");
+  const double zero[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  EXPECT_NE(map.init(c.model, zero, c.D, c.R, c.P, 64, 48), "OK");
+  double singular[12] = {1, 2, 3, 0, 2, 4, 6, 0, 0, 0, 1, 0};
+  EXPECT_NE(map.init(c.model, c.K, c.D, c.R, singular, 64, 48), "OK");
+  EXPECT_EQ(map.init("", c.K, {}, c.R, c.P, 64, 48), "OK");
+}
@@ -0,0 +1,252 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/statistics.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using flir_spinnaker_ros2::ImageStatistics;
+using flir_spinnaker_ros2::StatisticsConfig;
+
+namespace
+{
+struct Format
+{
+  const char * name;
+  int channels;
+  bool bayer;
+  int bytes;  // per value
+  int bits;
+};
+
+const Format formats[] = {
+  {"mono8", 1, false, 1, 8},    {"rgb8", 3, false, 1, 8},
+  {"bayer8", 1, true, 1, 8},    {"mono12", 1, false, 2, 12},
+  {"rgb16", 3, false, 2, 16},   {"bayer12", 1, true, 2, 12},
+  {"bayer16", 1, true, 2, 16},
+};
+
+// Random values, a quarter of them saturated or black. Deep images
+// also get values above the significant bits, which must be clamped.
+std::vector<uint8_t> make_image(
+  const Format & f, int width, int height, size_t step, std::mt19937 * rng)
+{
+  std::vector<uint8_t> img(step * height, 0xEE);
+  const int maxValue = f.bytes == 1 ? 255 : 65535;
+  std::uniform_int_distribution<int> dist(0, maxValue);
+  std::uniform_int_distribution<int> pick(0, 7);
+  for (int y = 0; y < height; y++) {
+    for (int i = 0; i < width * f.channels; i++) {
+      const int p = pick(*rng);
+      int v = dist(*rng);
+      if (p == 0) {
+        v = 0;
+      } else if (p == 1) {
+        v = (1 << f.bits) - 1;
+      } else if (f.bytes == 2 && p > 3) {
+        v &= (1 << f.bits) - 1;  // mostly within the significant bits
+      }
+      if (f.bytes == 1) {
+        img[y * step + i] = static_cast<uint8_t>(v);
+      } else {
+        const uint16_t v16 = static_cast<uint16_t>(v);
+        std::memcpy(&img[y * step + 2 * i], &v16, 2);
+      }
+    }
+  }
+  return (img);
+}
+
+struct Expected
+{
+  std::vector<uint32_t> histogram;
+  std::vector<double> channelSum, channelCount, gridSum, gridCount;
+  uint64_t saturated{0}, black{0}, total{0};
+};
+
+// Visits every pixel and decides on its own whether it is sampled,
+// and where it goes.
+Expected brute_force(
+  const Format & f, const StatisticsConfig & c, const uint8_t * src,
+  size_t step, int width, int height)
+{
+  Expected e;
+  e.histogram.assign(256, 0);
+  const int numChannels = f.bayer ? 4 : f.channels;
+  e.channelSum.assign(numChannels, 0);
+  e.channelCount.assign(numChannels, 0);
+  e.gridSum.assign(c.gridRows * c.gridCols, 0);
+  e.gridCount.assign(c.gridRows * c.gridCols, 0);
+  const int unit = f.bayer ? 2 : 1;
+  const int maxValue = (1 << f.bits) - 1;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      // the 2x2 blocks of Bayer images are sampled as a whole, and
+      // incomplete ones are skipped
+      const int bx = x / unit, by = y / unit;
+      if (bx % c.subsample != 0 || by % c.subsample != 0) {
+        continue;
+      }
+      if (f.bayer && (x | 1) >= width) {
+        continue;
+      }
+      const int gx = std::min((bx * unit) * c.gridCols / width, c.gridCols - 1);
+      const int gy = std::min(y * c.gridRows / height, c.gridRows - 1);
+      for (int ch = 0; ch < f.channels; ch++) {
+        const size_t i = x * f.channels + ch;
+        int v = src[y * step + i * f.bytes];
+        if (f.bytes == 2) {
+          uint16_t v16;
+          std::memcpy(&v16, src + y * step + 2 * i, 2);
+          v = std::min<int>(v16, maxValue);
+        }
+        const int bin = v >> (f.bits - 8);
+        e.histogram[bin]++;
+        e.total++;
+        e.saturated += bin >= c.saturationBin ? 1 : 0;
+        e.black += bin <= c.blackBin ? 1 : 0;
+        const int channel = f.bayer ? (y & 1) * 2 + (x & 1) : ch;
+        e.channelSum[channel] += v;
+        e.channelCount[channel]++;
+        e.gridSum[gy * c.gridCols + gx] += v;
+        e.gridCount[gy * c.gridCols + gx]++;
+      }
+    }
+  }
+  return (e);
+}
+
+void expect_means(
+  const std::vector<float> & actual, const std::vector<double> & sum,
+  const std::vector<double> & count, const std::string & what)
+{
+  ASSERT_EQ(actual.size(), sum.size()) << what;
+  for (size_t i = 0; i < sum.size(); i++) {
+    const double m = count[i] > 0 ? sum[i] / count[i] : 0;
+    EXPECT_NEAR(actual[i], m, 1e-6 * m + 1e-6) << what << " index " << i;
+  }
+}
+
+void check(
+  const Format & f, const StatisticsConfig & c, int width, int height,
+  int band, std::mt19937 * rng)
+{
+  const std::string what = std::string(f.name) + " " +
+                           std::to_string(width) + "x" +
+                           std::to_string(height) + " subsample " +
+                           std::to_string(c.subsample) + " band " +
+                           std::to_string(band);
+  const size_t step = width * f.channels * f.bytes + 6;
+  const std::vector<uint8_t> img = make_image(f, width, height, step, rng);
+  ImageStatistics empty;
+  empty.reset(c, width, height, f.channels, f.bayer, f.bits);
+  // in bands, merged like the driver does
+  ImageStatistics total = empty;
+  for (int y = 0; y < height; y += band) {
+    ImageStatistics part = empty;
+    part.accumulate(img.data(), step, y, std::min(y + band, height));
+    total.merge(part);
+  }
+  const Expected e = brute_force(f, c, img.data(), step, width, height);
+  EXPECT_EQ(total.getBits(), f.bits) << what;
+  EXPECT_EQ(total.getHistogram(), e.histogram) << what;
+  expect_means(total.getChannelMeans(), e.channelSum, e.channelCount, what);
+  expect_means(total.getGridMeans(), e.gridSum, e.gridCount, what);
+  EXPECT_FLOAT_EQ(
+    total.getSaturatedFraction(), static_cast<float>(e.saturated) / e.total)
+    << what;
+  EXPECT_FLOAT_EQ(
+    total.getBlackFraction(), static_cast<float>(e.black) / e.total)
+    << what;
+}
+}  // namespace
+
+TEST(Statistics, MatchesBruteForce)
+{
+  std::mt19937 rng(17);
+  StatisticsConfig c;
+  c.gridRows = 3;
+  c.gridCols = 4;
+  c.saturationBin = 250;
+  c.blackBin = 3;
+  for (const Format & f : formats) {
+    for (int subsample : {1, 2, 3}) {
+      c.subsample = subsample;
+      check(f, c, 37, 23, 23, &rng);  // odd, in one piece
+      check(f, c, 64, 30, 7, &rng);   // in odd sized bands
+      check(f, c, 9, 5, 2, &rng);
+    }
+  }
+}
+
+TEST(Statistics, Merge)
+{
+  // merging parts gives the same as one pass over the whole image
+  std::mt19937 rng(3);
+  const Format f = formats[2];
+  StatisticsConfig c;
+  c.subsample = 2;
+  c.gridRows = 2;
+  c.gridCols = 2;
+  const int width = 50, height = 40;
+  const size_t step = width;
+  const std::vector<uint8_t> img = make_image(f, width, height, step, &rng);
+  ImageStatistics whole;
+  whole.reset(c, width, height, 1, true, 8);
+  ImageStatistics merged = whole;
+  whole.accumulate(img.data(), step, 0, height);
+  for (int y = 0; y < height; y += 10) {
+    ImageStatistics part;
+    part.reset(c, width, height, 1, true, 8);
+    part.accumulate(img.data(), step, y, y + 10);
+    merged.merge(part);
+  }
+  EXPECT_EQ(merged.getHistogram(), whole.getHistogram());
+  EXPECT_EQ(merged.getChannelMeans(), whole.getChannelMeans());
+  EXPECT_EQ(merged.getGridMeans(), whole.getGridMeans());
+}
+
+TEST(Statistics, Reset)
+{
+  // invalid settings are fixed up, and a reset clears everything
+  std::mt19937 rng(5);
+  StatisticsConfig c;
+  c.subsample = 0;
+  c.gridRows = 0;
+  c.gridCols = -1;
+  ImageStatistics stats;
+  stats.reset(c, 16, 16, 1, false, 4);
+  EXPECT_EQ(stats.getConfig().subsample, 1);
+  EXPECT_EQ(stats.getConfig().gridRows, 1);
+  EXPECT_EQ(stats.getConfig().gridCols, 1);
+  EXPECT_EQ(stats.getBits(), 8);
+  EXPECT_EQ(stats.getRowAlignment(), 1);
+  const std::vector<uint8_t> img = make_image(formats[0], 16, 16, 16, &rng);
+  stats.accumulate(img.data(), 16, 0, 16);
+  c.subsample = 2;
+  stats.reset(c, 16, 16, 1, true, 20);
+  EXPECT_EQ(stats.getBits(), 16);
+  EXPECT_EQ(stats.getRowAlignment(), 4);
+  const std::vector<uint32_t> h = stats.getHistogram();
+  EXPECT_EQ(std::count(h.begin(), h.end(), 0u), 256);
+  EXPECT_EQ(stats.getSaturatedFraction(), 0);
+  EXPECT_EQ(stats.getChannelMeans(), std::vector<float>(4, 0));
+}
@@ -0,0 +1,221 @@
+// -*-c++-*--------------------------------------------------------------------
+// Copyright 2022 Bernd Pfrommer <bernd.pfrommer@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <flir_spinnaker_ros2/yuv.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using flir_spinnaker_ros2::YUV_BT601;
+using flir_spinnaker_ros2::YUV_BT709;
+using flir_spinnaker_ros2::YUV_NV12;
+using flir_spinnaker_ros2::YUV_UYVY;
+using flir_spinnaker_ros2::YUV_YUYV;
+using flir_spinnaker_ros2::yuv_format_from_string;
+using flir_spinnaker_ros2::yuv_from_rows;
+using flir_spinnaker_ros2::yuv_matrix_from_string;
+using flir_spinnaker_ros2::yuv_size;
+using flir_spinnaker_ros2::yuv_step;
+using flir_spinnaker_ros2::YuvFormat;
+using flir_spinnaker_ros2::YuvMatrix;
+
+namespace
+{
+struct Rgb
+{
+  int r, g, b;
+};
+
+Rgb get_rgb(
+  const std::vector<uint8_t> & img, int width, int channels, bool bgr, int x,
+  int y)
+{
+  const uint8_t * p = &img[(static_cast<size_t>(y) * width + x) * channels];
+  if (channels == 1) {
+    return (Rgb{p[0], p[0], p[0]});
+  }
+  return (bgr ? Rgb{p[2], p[1], p[0]} : Rgb{p[0], p[1], p[2]});
+}
+
+// the fixed point conversion, written out plainly: weights in units of
+// 1/256, rounded to nearest with ties going up
+uint8_t fixed_point(const Rgb & c, const int * w, int offset)
+{
+  const int s = c.r * w[0] + c.g * w[1] + c.b * w[2];
+  const int v =
+    static_cast<int>(std::floor((s + 128) / 256.0)) + offset;
+  return (static_cast<uint8_t>(std::min(std::max(v, 0), 255)));
+}
+
+// the exact limited range conversion, to check the fixed point weights
+void exact(const Rgb & c, YuvMatrix m, double * y, double * u, double * v)
+{
+  const double kr = m == YUV_BT601 ? 0.299 : 0.2126;
+  const double kb = m == YUV_BT601 ? 0.114 : 0.0722;
+  const double l = kr * c.r + (1 - kr - kb) * c.g + kb * c.b;
+  *y = 16 + 219.0 / 255.0 * l;
+  *u = 128 + 224.0 / 255.0 * (c.b - l) / (2 * (1 - kb));
+  *v = 128 + 224.0 / 255.0 * (c.r - l) / (2 * (1 - kr));
+}
+
+const int W601[3][3] = {{66, 129, 25}, {-38, -74, 112}, {112, -94, -18}};
+const int W709[3][3] = {{47, 157, 16}, {-26, -86, 112}, {112, -102, -10}};
+
+int avg(int a, int b) { return ((a + b + 1) >> 1); }
+
+Rgb avg(const Rgb & a, const Rgb & b)
+{
+  return (Rgb{avg(a.r, b.r), avg(a.g, b.g), avg(a.b, b.b)});
+}
+
+// reference conversion of the whole image, chroma from the rounded
+// average of 2 (4:2:2) or 2x2 (4:2:0) pixels
+std::vector<uint8_t> reference(
+  const std::vector<uint8_t> & img, int width, int height, int channels,
+  bool bgr, YuvMatrix matrix, YuvFormat format)
+{
+  const auto & w = matrix == YUV_BT601 ? W601 : W709;
+  std::vector<uint8_t> out(yuv_size(width, height, format));
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x += 2) {
+      const Rgb p0 = get_rgb(img, width, channels, bgr, x, y);
+      const Rgb p1 = get_rgb(img, width, channels, bgr, x + 1, y);
+      if (format == YUV_NV12) {
+        out[y * width + x] = fixed_point(p0, w[0], 16);
+        out[y * width + x + 1] = fixed_point(p1, w[0], 16);
+        if ((y & 1) == 0) {
+          const Rgb m = avg(
+            avg(p0, get_rgb(img, width, channels, bgr, x, y + 1)),
+            avg(p1, get_rgb(img, width, channels, bgr, x + 1, y + 1)));
+          uint8_t * uv = &out[width * height + (y / 2) * width + x];
+          uv[0] = fixed_point(m, w[1], 128);
+          uv[1] = fixed_point(m, w[2], 128);
+        }
+      } else {
+        const Rgb m = avg(p0, p1);
+        const uint8_t yuyv[4] = {
+          fixed_point(p0, w[0], 16), fixed_point(m, w[1], 128),
+          fixed_point(p1, w[0], 16), fixed_point(m, w[2], 128)};
+        uint8_t * o = &out[(static_cast<size_t>(y) * width + x) * 2];
+        const int order[2][4] = {{0, 1, 2, 3}, {1, 0, 3, 2}};
+        for (int i = 0; i < 4; i++) {
+          o[i] = yuyv[order[format == YUV_UYVY][i]];
+        }
+      }
+    }
+  }
+  return (out);
+}
+
+std::vector<uint8_t> random_image(size_t n, std::mt19937 * rng)
+{
+  std::uniform_int_distribution<int> dist(0, 255);
+  std::vector<uint8_t> img(n);
+  for (auto & v : img) {
+    v = static_cast<uint8_t>(dist(*rng));
+  }
+  return (img);
+}
+}  // namespace
+
+TEST(Yuv, Names)
+{
+  YuvFormat f;
+  ASSERT_TRUE(yuv_format_from_string("nv12", &f));
+  EXPECT_EQ(f, YUV_NV12);
+  ASSERT_TRUE(yuv_format_from_string("yuv422", &f));
+  EXPECT_EQ(f, YUV_UYVY);
+  ASSERT_TRUE(yuv_format_from_string("yuv422_yuy2", &f));
+  EXPECT_EQ(f, YUV_YUYV);
+  EXPECT_FALSE(yuv_format_from_string("i420", &f));
+  YuvMatrix m;
+  ASSERT_TRUE(yuv_matrix_from_string("bt709", &m));
+  EXPECT_EQ(m, YUV_BT709);
+  EXPECT_FALSE(yuv_matrix_from_string("bt2020", &m));
+  EXPECT_EQ(yuv_step(640, YUV_NV12), 640u);
+  EXPECT_EQ(yuv_step(640, YUV_UYVY), 1280u);
+  EXPECT_EQ(yuv_size(640, 480, YUV_NV12), 640u * 480 * 3 / 2);
+  EXPECT_EQ(yuv_size(640, 480, YUV_YUYV), 640u * 480 * 2);
+}
+
+TEST(Yuv, MatchesReference)
+{
+  std::mt19937 rng(1);
+  // widths around the vector sizes to exercise the scalar tails
+  for (int width : {2, 30, 32, 34, 64, 66, 98, 130}) {
+    for (int channels : {1, 3}) {
+      for (bool bgr : {false, true}) {
+        for (YuvMatrix matrix : {YUV_BT601, YUV_BT709}) {
+          for (YuvFormat format : {YUV_NV12, YUV_UYVY, YUV_YUYV}) {
+            const int height = 6;
+            // padded input rows
+            const size_t srcStep = width * channels + 3;
+            const auto padded = random_image(srcStep * height, &rng);
+            std::vector<uint8_t> img;
+            for (int y = 0; y < height; y++) {
+              img.insert(
+                img.end(), padded.begin() + y * srcStep,
+                padded.begin() + y * srcStep + width * channels);
+            }
+            // in two row ranges
+            std::vector<uint8_t> out(yuv_size(width, height, format), 0);
+            yuv_from_rows(
+              padded.data(), srcStep, width, height, channels, bgr, matrix,
+              format, out.data(), 0, 2);
+            yuv_from_rows(
+              padded.data() + 2 * srcStep, srcStep, width, height, channels,
+              bgr, matrix, format, out.data(), 2, height);
+            ASSERT_EQ(
+              out, reference(
+                     img, width, height, channels, bgr, matrix, format))
+              << "width " << width << " channels " << channels << " bgr "
+              << bgr << " matrix " << matrix << " format " << format;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Yuv, CloseToExact)
+{
+  // uniform colors, so chroma subsampling does not matter
+  const Rgb colors[] = {{0, 0, 0},     {255, 255, 255}, {255, 0, 0},
+                        {0, 255, 0},   {0, 0, 255},     {128, 128, 128},
+                        {200, 100, 50}};
+  const int width = 64;
+  const int height = 2;
+  for (YuvMatrix matrix : {YUV_BT601, YUV_BT709}) {
+    for (const Rgb & c : colors) {
+      std::vector<uint8_t> img;
+      for (int i = 0; i < width * height; i++) {
+        img.insert(img.end(), {uint8_t(c.r), uint8_t(c.g), uint8_t(c.b)});
+      }
+      std::vector<uint8_t> out(yuv_size(width, height, YUV_UYVY));
+      yuv_from_rows(
+        img.data(), width * 3, width, height, 3, false, matrix, YUV_UYVY,
+        out.data(), 0, height);
+      double y, u, v;
+      exact(c, matrix, &y, &u, &v);
+      EXPECT_NEAR(out[1], y, 1.5) << c.r << " " << c.g << " " << c.b;
+      EXPECT_NEAR(out[0], u, 1.5) << c.r << " " << c.g << " " << c.b;
+      EXPECT_NEAR(out[2], v, 1.5) << c.r << " " << c.g << " " << c.b;
+    }
+  }
+}